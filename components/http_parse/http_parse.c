@@ -0,0 +1,470 @@
+/*
+ * URL query and JSON request parsing
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "http_parse.h"
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+void http_url_decode(char *str)
+{
+    char *out = str;
+    for (char *in = str; *in; in++) {
+        int hi, lo;
+        if (*in == '%' && (hi = hex_value(in[1])) >= 0 && (lo = hex_value(in[2])) >= 0) {
+            *out++ = (char)(hi << 4 | lo);
+            in += 2;
+        } else if (*in == '+') {
+            *out++ = ' ';
+        } else {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
+}
+
+int http_query_parse(http_query_t *query, const char *str, size_t len)
+{
+    query->count = 0;
+    if (len >= sizeof(query->buf)) {
+        return -1;
+    }
+    memmove(query->buf, str, len);
+    query->buf[len] = '\0';
+
+    char *p = query->buf;
+    while (p) {
+        char *amp = strchr(p, '&');
+        if (amp) {
+            *amp++ = '\0';
+        }
+        if (*p && query->count < HTTP_QUERY_MAX_PARAMS) {
+            char *value = strchr(p, '=');
+            if (value) {
+                *value++ = '\0';
+            } else {
+                value = p + strlen(p);
+            }
+            http_url_decode(p);
+            http_url_decode(value);
+            query->params[query->count].key = p;
+            query->params[query->count].value = value;
+            query->count++;
+        }
+        p = amp;
+    }
+    return query->count;
+}
+
+const char *http_query_get(const http_query_t *query, const char *key)
+{
+    for (int i = 0; i < query->count; i++) {
+        if (strcmp(query->params[i].key, key) == 0) {
+            return query->params[i].value;
+        }
+    }
+    return NULL;
+}
+
+/* ---- JSON ---- */
+
+enum {
+    EXPECT_VALUE,
+    EXPECT_KEY,
+    EXPECT_COLON,
+    EXPECT_COMMA,       // After a value: ',' or the container's closing bracket
+};
+
+static int tok_new(json_tok_t *toks, int max_toks, int *count, uint8_t type, size_t start, size_t end)
+{
+    if (toks) {
+        if (*count >= max_toks) {
+            return JSON_ERR_NOMEM;
+        }
+        json_tok_t *tok = &toks[*count];
+        tok->type = type;
+        tok->size = 0;
+        tok->start = start;
+        tok->end = end;
+        tok->next = *count + 1;
+    }
+    return (*count)++;
+}
+
+// Scan a string starting after its opening quote; returns the offset of the closing quote
+static int scan_string(const char *js, size_t len, size_t pos)
+{
+    for (; pos < len; pos++) {
+        unsigned char c = js[pos];
+        if (c == '"') {
+            return pos;
+        }
+        if (c < 0x20) {
+            return JSON_ERR_INVAL;
+        }
+        if (c != '\\') {
+            continue;
+        }
+        if (++pos >= len) {
+            break;
+        }
+        if (js[pos] == 'u') {
+            for (int i = 1; i <= 4; i++) {
+                if (pos + i >= len) {
+                    return JSON_ERR_PART;
+                }
+                if (hex_value(js[pos + i]) < 0) {
+                    return JSON_ERR_INVAL;
+                }
+            }
+            pos += 4;
+        } else if (js[pos] == '\0' || !strchr("\"\\/bfnrt", js[pos])) {
+            return JSON_ERR_INVAL;
+        }
+    }
+    return JSON_ERR_PART;
+}
+
+// Count a value (or, in an object, a key) in its container
+static int count_child(json_tok_t *toks, int parent)
+{
+    if (!toks || parent < 0) {
+        return 0;
+    }
+    if (toks[parent].size == UINT16_MAX) {
+        return JSON_ERR_NOMEM;
+    }
+    toks[parent].size++;
+    return 0;
+}
+
+static bool is_delimiter(char c)
+{
+    return c == ',' || c == ']' || c == '}' || c == ':' || c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Number, true, false or null
+static bool primitive_valid(const char *p, size_t n)
+{
+    if ((n == 4 && memcmp(p, "true", 4) == 0) || (n == 5 && memcmp(p, "false", 5) == 0) ||
+        (n == 4 && memcmp(p, "null", 4) == 0)) {
+        return true;
+    }
+    const char *end = p + n;
+    if (p < end && *p == '-') {
+        p++;
+    }
+    if (p == end || *p < '0' || *p > '9') {
+        return false;
+    }
+    if (*p == '0') {
+        p++;
+    } else {
+        while (p < end && *p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+    if (p < end && *p == '.') {
+        const char *digits = ++p;
+        while (p < end && *p >= '0' && *p <= '9') {
+            p++;
+        }
+        if (p == digits) {
+            return false;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+        const char *digits = p;
+        while (p < end && *p >= '0' && *p <= '9') {
+            p++;
+        }
+        if (p == digits) {
+            return false;
+        }
+    }
+    return p == end;
+}
+
+int json_parse(const char *js, size_t len, json_tok_t *toks, int max_toks)
+{
+    int stack[JSON_MAX_DEPTH];          // Open containers (token index)
+    uint8_t stack_type[JSON_MAX_DEPTH];
+    int depth = 0;
+    int count = 0;
+    int state = EXPECT_VALUE;
+
+    for (size_t pos = 0; pos < len; pos++) {
+        char c = js[pos];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            continue;
+        }
+        if (depth == 0 && count > 0) {
+            return JSON_ERR_INVAL;      // Only whitespace may follow the top-level value
+        }
+        int parent = depth > 0 ? stack[depth - 1] : -1;
+        bool in_array = depth > 0 && stack_type[depth - 1] == JSON_ARRAY;
+        int tok;
+        switch (c) {
+            case '{':
+            case '[':
+                if (state != EXPECT_VALUE) {
+                    return JSON_ERR_INVAL;
+                }
+                if (depth == JSON_MAX_DEPTH) {
+                    return JSON_ERR_NOMEM;
+                }
+                tok = tok_new(toks, max_toks, &count, c == '{' ? JSON_OBJECT : JSON_ARRAY, pos, pos);
+                if (tok < 0) {
+                    return tok;
+                }
+                if (in_array && count_child(toks, parent) < 0) {
+                    return JSON_ERR_NOMEM;
+                }
+                stack[depth] = tok;
+                stack_type[depth] = c == '{' ? JSON_OBJECT : JSON_ARRAY;
+                depth++;
+                state = c == '{' ? EXPECT_KEY : EXPECT_VALUE;
+                break;
+
+            case '}':
+            case ']': {
+                uint8_t type = c == '}' ? JSON_OBJECT : JSON_ARRAY;
+                // A container may close right after a value, or when it is still empty
+                bool empty = parent >= 0 && parent == count - 1;
+                if (depth == 0 || stack_type[depth - 1] != type ||
+                    !(state == EXPECT_COMMA || (empty && state == (type == JSON_OBJECT ? EXPECT_KEY : EXPECT_VALUE)))) {
+                    return JSON_ERR_INVAL;
+                }
+                if (toks) {
+                    toks[parent].end = pos + 1;
+                    toks[parent].next = count;
+                }
+                depth--;
+                state = EXPECT_COMMA;
+                break;
+            }
+
+            case ',':
+                if (state != EXPECT_COMMA || depth == 0) {
+                    return JSON_ERR_INVAL;
+                }
+                state = stack_type[depth - 1] == JSON_OBJECT ? EXPECT_KEY : EXPECT_VALUE;
+                break;
+
+            case ':':
+                if (state != EXPECT_COLON) {
+                    return JSON_ERR_INVAL;
+                }
+                state = EXPECT_VALUE;
+                break;
+
+            case '"': {
+                if (state != EXPECT_VALUE && state != EXPECT_KEY) {
+                    return JSON_ERR_INVAL;
+                }
+                int close = scan_string(js, len, pos + 1);
+                if (close < 0) {
+                    return close;
+                }
+                tok = tok_new(toks, max_toks, &count, JSON_STRING, pos + 1, close);
+                if (tok < 0) {
+                    return tok;
+                }
+                if ((state == EXPECT_KEY || in_array) && count_child(toks, parent) < 0) {
+                    return JSON_ERR_NOMEM;
+                }
+                state = state == EXPECT_KEY ? EXPECT_COLON : EXPECT_COMMA;
+                pos = close;
+                break;
+            }
+
+            default: {
+                if (state != EXPECT_VALUE) {
+                    return JSON_ERR_INVAL;
+                }
+                size_t end = pos;
+                while (end < len && !is_delimiter(js[end])) {
+                    end++;
+                }
+                if (!primitive_valid(js + pos, end - pos)) {
+                    return end == len ? JSON_ERR_PART : JSON_ERR_INVAL;
+                }
+                tok = tok_new(toks, max_toks, &count, JSON_PRIMITIVE, pos, end);
+                if (tok < 0) {
+                    return tok;
+                }
+                if (in_array && count_child(toks, parent) < 0) {
+                    return JSON_ERR_NOMEM;
+                }
+                state = EXPECT_COMMA;
+                pos = end - 1;
+                break;
+            }
+        }
+    }
+    if (depth > 0 || count == 0 || state != EXPECT_COMMA) {
+        return JSON_ERR_PART;
+    }
+    return count;
+}
+
+int json_object_get(const char *js, const json_tok_t *toks, int obj, const char *key)
+{
+    if (obj < 0 || toks[obj].type != JSON_OBJECT) {
+        return -1;
+    }
+    int i = obj + 1;
+    for (int member = 0; member < toks[obj].size; member++) {
+        if (json_tok_eq(js, &toks[i], key)) {
+            return i + 1;
+        }
+        i = toks[i + 1].next;
+    }
+    return -1;
+}
+
+bool json_tok_eq(const char *js, const json_tok_t *tok, const char *str)
+{
+    size_t len = strlen(str);
+    return tok->type == JSON_STRING && tok->end - tok->start == len && memcmp(js + tok->start, str, len) == 0;
+}
+
+static unsigned read_hex4(const char *p)
+{
+    return hex_value(p[0]) << 12 | hex_value(p[1]) << 8 | hex_value(p[2]) << 4 | hex_value(p[3]);
+}
+
+bool json_tok_copy(const char *js, const json_tok_t *tok, char *out, size_t out_len)
+{
+    if (out_len == 0) {
+        return false;
+    }
+    out[0] = '\0';
+    if (tok->type != JSON_STRING) {
+        return false;
+    }
+    size_t n = 0;
+    const char *p = js + tok->start, *end = js + tok->end;
+    while (p < end) {
+        char utf8[4];
+        size_t utf8_len = 1;
+        if (*p != '\\') {
+            utf8[0] = *p++;
+        } else {
+            p++;
+            char e = *p++;
+            switch (e) {
+                case 'b': utf8[0] = '\b'; break;
+                case 'f': utf8[0] = '\f'; break;
+                case 'n': utf8[0] = '\n'; break;
+                case 'r': utf8[0] = '\r'; break;
+                case 't': utf8[0] = '\t'; break;
+                case 'u': {
+                    unsigned cp = read_hex4(p);
+                    p += 4;
+                    // A surrogate pair encodes one code point above U+FFFF
+                    if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                        unsigned low = read_hex4(p + 2);
+                        if (low >= 0xDC00 && low < 0xE000) {
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                            p += 6;
+                        }
+                    }
+                    if (cp == 0) {
+                        out[n] = '\0';
+                        return false;   // Would truncate the C string
+                    }
+                    if (cp < 0x80) {
+                        utf8[0] = cp;
+                    } else if (cp < 0x800) {
+                        utf8[0] = 0xC0 | cp >> 6;
+                        utf8[1] = 0x80 | (cp & 0x3F);
+                        utf8_len = 2;
+                    } else if (cp < 0x10000) {
+                        utf8[0] = 0xE0 | cp >> 12;
+                        utf8[1] = 0x80 | ((cp >> 6) & 0x3F);
+                        utf8[2] = 0x80 | (cp & 0x3F);
+                        utf8_len = 3;
+                    } else {
+                        utf8[0] = 0xF0 | cp >> 18;
+                        utf8[1] = 0x80 | ((cp >> 12) & 0x3F);
+                        utf8[2] = 0x80 | ((cp >> 6) & 0x3F);
+                        utf8[3] = 0x80 | (cp & 0x3F);
+                        utf8_len = 4;
+                    }
+                    break;
+                }
+                default: utf8[0] = e; break;   // \" \\ and \/
+            }
+        }
+        if (n + utf8_len >= out_len) {
+            out[n] = '\0';
+            return false;
+        }
+        memcpy(out + n, utf8, utf8_len);
+        n += utf8_len;
+    }
+    out[n] = '\0';
+    return true;
+}
+
+bool json_get_string(const char *js, const json_tok_t *toks, int obj, const char *key, char *out, size_t out_len)
+{
+    int value = json_object_get(js, toks, obj, key);
+    if (value < 0 || !json_tok_copy(js, &toks[value], out, out_len)) {
+        out[0] = '\0';
+        return false;
+    }
+    return true;
+}
+
+bool json_get_int(const char *js, const json_tok_t *toks, int obj, const char *key, long long *out)
+{
+    int value = json_object_get(js, toks, obj, key);
+    if (value < 0 || toks[value].type != JSON_PRIMITIVE) {
+        return false;
+    }
+    char number[24];
+    size_t n = toks[value].end - toks[value].start;
+    if (n >= sizeof(number)) {
+        return false;
+    }
+    memcpy(number, js + toks[value].start, n);
+    number[n] = '\0';
+    char *end;
+    long long parsed = strtoll(number, &end, 10);
+    if (end == number || *end != '\0') {
+        return false;
+    }
+    *out = parsed;
+    return true;
+}
+
+bool json_get_bool(const char *js, const json_tok_t *toks, int obj, const char *key, bool *out)
+{
+    int value = json_object_get(js, toks, obj, key);
+    if (value < 0 || toks[value].type != JSON_PRIMITIVE || (js[toks[value].start] != 't' && js[toks[value].start] != 'f')) {
+        return false;
+    }
+    *out = js[toks[value].start] == 't';
+    return true;
+}
@@ -0,0 +1,129 @@
+/*
+ * Request parsing shared by all HTTP handlers: URL query strings and JSON bodies.
+ *
+ * Neither parser allocates. The query parser splits a copy of the query held
+ * in http_query_t; the JSON tokenizer (in the style of jsmn) records tokens
+ * into a caller-supplied array, so one pass over the body is enough and key
+ * lookups afterwards only walk the members of one object.
+ *
+ * Plain C with no ESP-IDF dependencies so it can be benchmarked on the host
+ * (tools/parse_bench).
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTTP_QUERY_MAX_LEN      512     /**<! Matches the default CONFIG_HTTPD_MAX_URI_LEN */
+#define HTTP_QUERY_MAX_PARAMS   16
+
+typedef struct {
+    const char *key;
+    const char *value;          /**<! Empty string for "key" or "key=" */
+} http_query_param_t;
+
+/**
+ * @brief A parsed query string; keys and values are URL-decoded
+ */
+typedef struct {
+    char buf[HTTP_QUERY_MAX_LEN];
+    http_query_param_t params[HTTP_QUERY_MAX_PARAMS];
+    int count;
+} http_query_t;
+
+/**
+ * @brief Split and decode a query string ("a=1&b=x%20y"), without the leading '?'
+ *
+ * str may point into query->buf. Parameters beyond HTTP_QUERY_MAX_PARAMS are ignored.
+ *
+ * @return Number of parameters, or -1 when the query is longer than HTTP_QUERY_MAX_LEN - 1
+ */
+int http_query_parse(http_query_t *query, const char *str, size_t len);
+
+/**
+ * @brief Value of the first parameter named key, NULL when absent
+ */
+const char *http_query_get(const http_query_t *query, const char *key);
+
+/**
+ * @brief Decode %XX escapes and '+' in place
+ */
+void http_url_decode(char *str);
+
+/* JSON token types */
+#define JSON_OBJECT     1
+#define JSON_ARRAY      2
+#define JSON_STRING     3
+#define JSON_PRIMITIVE  4       /**<! Number, true, false or null */
+
+/* Errors returned by json_parse() */
+#define JSON_ERR_NOMEM  -1      /**<! More tokens than the array holds */
+#define JSON_ERR_INVAL  -2      /**<! Syntax error */
+#define JSON_ERR_PART   -3      /**<! The text ends inside a value */
+
+#define JSON_MAX_DEPTH  32
+
+/**
+ * @brief One JSON value
+ *
+ * Tokens are stored in document order. An object's members follow it as
+ * key/value pairs (the key is a JSON_STRING token), an array's elements
+ * follow it directly; next jumps over a value together with its children.
+ */
+typedef struct {
+    uint8_t type;               /**<! JSON_* */
+    uint16_t size;              /**<! Members of an object, elements of an array */
+    uint32_t start;             /**<! Offset of the value; strings exclude the quotes */
+    uint32_t end;
+    uint32_t next;              /**<! Index of the token after this value */
+} json_tok_t;
+
+/**
+ * @brief Tokenize one JSON value (normally the request body's object)
+ *
+ * @param toks Token array, or NULL to only validate and count the tokens needed
+ * @return Number of tokens, or a JSON_ERR_* code
+ */
+int json_parse(const char *js, size_t len, json_tok_t *toks, int max_toks);
+
+/**
+ * @brief Index of the value of key in the object token obj, -1 when absent or obj is not an object
+ */
+int json_object_get(const char *js, const json_tok_t *toks, int obj, const char *key);
+
+/**
+ * @brief Compare a string token with a C string (escapes are not decoded)
+ */
+bool json_tok_eq(const char *js, const json_tok_t *tok, const char *str);
+
+/**
+ * @brief Copy a string token, decoding escapes (\uXXXX to UTF-8)
+ *
+ * @return false when the token is not a string or does not fit; out is always terminated
+ */
+bool json_tok_copy(const char *js, const json_tok_t *tok, char *out, size_t out_len);
+
+/**
+ * @brief Copy the string member key of object obj; out is left empty when absent, not a string or too long
+ */
+bool json_get_string(const char *js, const json_tok_t *toks, int obj, const char *key, char *out, size_t out_len);
+
+/**
+ * @brief Read an integer member; false when absent or not an integer
+ */
+bool json_get_int(const char *js, const json_tok_t *toks, int obj, const char *key, long long *out);
+
+/**
+ * @brief Read a true/false member; false when absent or not a boolean
+ */
+bool json_get_bool(const char *js, const json_tok_t *toks, int obj, const char *key, bool *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,159 @@
+/*
+ * NVS partition image format, as written by the nvs_flash library and by
+ * ESP-IDF's nvs_partition_gen.py (version 2 pages, multi-page blobs).
+ *
+ * Plain C with no ESP-IDF dependencies so the same code runs on the device
+ * and in host tools (tools/partition_dump).
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NVS_IMAGE_PAGE_SIZE         4096
+#define NVS_IMAGE_ENTRY_SIZE        32
+#define NVS_IMAGE_ENTRIES_PER_PAGE  126
+#define NVS_IMAGE_KEY_SIZE          16      /**<! Including the terminator */
+#define NVS_IMAGE_STR_MAX_SIZE      4000    /**<! Including the terminator */
+
+/* Page states (first word of every page) */
+#define NVS_IMAGE_PAGE_EMPTY        0xFFFFFFFF
+#define NVS_IMAGE_PAGE_ACTIVE       0xFFFFFFFE
+#define NVS_IMAGE_PAGE_FULL         0xFFFFFFFC
+#define NVS_IMAGE_PAGE_FREEING      0xFFFFFFF8
+#define NVS_IMAGE_PAGE_VERSION      0xFE    /**<! Version 2: blobs split into BLOB_DATA chunks + BLOB_IDX */
+
+/* Entry types as stored on flash */
+#define NVS_IMAGE_TYPE_U8           0x01
+#define NVS_IMAGE_TYPE_I8           0x11
+#define NVS_IMAGE_TYPE_U16          0x02
+#define NVS_IMAGE_TYPE_I16          0x12
+#define NVS_IMAGE_TYPE_U32          0x04
+#define NVS_IMAGE_TYPE_I32          0x14
+#define NVS_IMAGE_TYPE_U64          0x08
+#define NVS_IMAGE_TYPE_I64          0x18
+#define NVS_IMAGE_TYPE_STR          0x21
+#define NVS_IMAGE_TYPE_BLOB         0x41    /**<! Version 1 single-page blob */
+#define NVS_IMAGE_TYPE_BLOB_DATA    0x42
+#define NVS_IMAGE_TYPE_BLOB_IDX     0x48
+
+/* Error codes returned by the writer */
+#define NVS_IMAGE_OK                0
+#define NVS_IMAGE_ERR_INVALID_ARG   -1      /**<! Bad key, namespace or value size */
+#define NVS_IMAGE_ERR_NO_SPACE      -2      /**<! The data does not fit the partition */
+#define NVS_IMAGE_ERR_EMIT          -3      /**<! The page callback failed */
+
+/**
+ * @brief Callback receiving each finished page, in order
+ *
+ * @return 0 to continue, anything else aborts the image with NVS_IMAGE_ERR_EMIT
+ */
+typedef int (*nvs_image_emit_t)(void *ctx, const uint8_t *page);
+
+/**
+ * @brief Builds an NVS partition image one page at a time, the way nvs_partition_gen.py does
+ *
+ * Only one page is held in memory; every completed page is handed to the
+ * emit callback. With a NULL callback the writer only checks that the data
+ * fits, which allows validating input before anything is written.
+ */
+typedef struct {
+    uint8_t page[NVS_IMAGE_PAGE_SIZE];
+    size_t page_count;      /**<! Pages in the partition */
+    size_t pages_emitted;
+    uint32_t seq;           /**<! Sequence number of the current page */
+    int next_entry;         /**<! First free entry of the current page */
+    uint8_t ns_count;
+    size_t entry_count;     /**<! Values written (namespaces excluded) */
+    nvs_image_emit_t emit;
+    void *ctx;
+    int err;                /**<! First error; later calls are no-ops */
+} nvs_image_writer_t;
+
+/**
+ * @brief Start an image for a partition of the given size (a multiple of the page size)
+ */
+void nvs_image_writer_init(nvs_image_writer_t *w, size_t partition_size, nvs_image_emit_t emit, void *ctx);
+
+/**
+ * @brief Add a namespace; its index is used for the entries that follow
+ */
+int nvs_image_add_namespace(nvs_image_writer_t *w, const char *name, uint8_t *ns_index);
+
+/**
+ * @brief Add an integer entry; type is one of the NVS_IMAGE_TYPE_U8 .. I64 codes
+ *
+ * The value is stored little-endian in the type's width.
+ */
+int nvs_image_add_int(nvs_image_writer_t *w, uint8_t ns_index, const char *key, uint8_t type, uint64_t value);
+
+/**
+ * @brief Add a NUL-terminated string entry (at most NVS_IMAGE_STR_MAX_SIZE - 1 characters)
+ */
+int nvs_image_add_string(nvs_image_writer_t *w, uint8_t ns_index, const char *key, const char *value);
+
+/**
+ * @brief Add a blob, split into BLOB_DATA chunks across pages plus a BLOB_IDX entry
+ */
+int nvs_image_add_blob(nvs_image_writer_t *w, uint8_t ns_index, const char *key, const void *data, size_t len);
+
+/**
+ * @brief Emit the current page as the active page and the remaining pages as empty
+ */
+int nvs_image_writer_finish(nvs_image_writer_t *w);
+
+/**
+ * @brief One written entry of a page, as seen by nvs_image_read_page()
+ */
+typedef struct {
+    uint8_t ns_index;           /**<! 0 for namespace entries */
+    uint8_t type;               /**<! NVS_IMAGE_TYPE_* */
+    uint8_t span;               /**<! Entries used, including string/blob data entries */
+    uint8_t chunk_index;        /**<! Blob chunk number, 0xFF for other types */
+    char key[NVS_IMAGE_KEY_SIZE];
+    const uint8_t *data;        /**<! The 8 inline data bytes */
+    const uint8_t *payload;     /**<! String or blob chunk contents, NULL for other types */
+    size_t payload_len;
+    bool crc_ok;                /**<! Entry CRC and, for strings and blob chunks, data CRC match */
+} nvs_image_item_t;
+
+/**
+ * @brief Callback for each written entry; return non-zero to stop reading the page
+ */
+typedef int (*nvs_image_item_cb_t)(void *ctx, const nvs_image_item_t *item);
+
+/**
+ * @brief Check a page header
+ *
+ * @param state Page state (NVS_IMAGE_PAGE_*), may be NULL
+ * @param seq Sequence number, may be NULL
+ * @return true for an empty page or a page whose header CRC matches
+ */
+bool nvs_image_page_header(const uint8_t *page, uint32_t *state, uint32_t *seq);
+
+/**
+ * @brief Visit the written entries of a page in order; erased and empty entries are skipped
+ *
+ * @return 0 when the whole page was read, otherwise the callback's return value
+ */
+int nvs_image_read_page(const uint8_t *page, nvs_image_item_cb_t cb, void *ctx);
+
+/**
+ * @brief Integer value of an entry, sign-extended for the signed types
+ */
+int64_t nvs_image_item_int(const nvs_image_item_t *item);
+
+/**
+ * @brief CRC-32 as used by NVS (zlib-compatible, pass 0xFFFFFFFF to start)
+ */
+uint32_t nvs_image_crc32(uint32_t crc, const void *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,349 @@
+/*
+ * NVS partition image reader and writer - the writer produces the same layout as nvs_partition_gen.py
+ */
+
+#include <string.h>
+
+#include "nvs_image.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_rom_crc.h"
+#endif
+
+// Page layout: 32-byte header, 32-byte entry state bitmap, then 126 entries
+#define PAGE_HEADER_SIZE    32
+#define PAGE_BITMAP_OFFSET  32
+#define PAGE_ENTRY_OFFSET   64
+
+// Entry layout
+#define ENTRY_NS            0
+#define ENTRY_TYPE          1
+#define ENTRY_SPAN          2
+#define ENTRY_CHUNK         3
+#define ENTRY_CRC           4
+#define ENTRY_KEY           8
+#define ENTRY_DATA          24
+
+#define CHUNK_ANY           0xFF
+
+// Entry states in the page bitmap
+#define ENTRY_STATE_EMPTY   0x3
+#define ENTRY_STATE_WRITTEN 0x2
+
+uint32_t nvs_image_crc32(uint32_t crc, const void *data, size_t len)
+{
+#ifdef ESP_PLATFORM
+    return esp_rom_crc32_le(crc, data, len);
+#else
+    const uint8_t *p = data;
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+#endif
+}
+
+static void put_le(uint8_t *dst, uint64_t value, int width)
+{
+    for (int i = 0; i < width; i++) {
+        dst[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint64_t get_le(const uint8_t *src, int width)
+{
+    uint64_t value = 0;
+    for (int i = width - 1; i >= 0; i--) {
+        value = (value << 8) | src[i];
+    }
+    return value;
+}
+
+static uint32_t entry_crc(const uint8_t *entry)
+{
+    uint32_t crc = nvs_image_crc32(0xFFFFFFFF, entry, ENTRY_CRC);
+    return nvs_image_crc32(crc, entry + ENTRY_KEY, NVS_IMAGE_ENTRY_SIZE - ENTRY_KEY);
+}
+
+static int entry_state(const uint8_t *page, int index)
+{
+    return (page[PAGE_BITMAP_OFFSET + index / 4] >> ((index % 4) * 2)) & 0x3;
+}
+
+static void page_begin(nvs_image_writer_t *w)
+{
+    memset(w->page, 0xFF, sizeof(w->page));
+    put_le(w->page, NVS_IMAGE_PAGE_ACTIVE, 4);
+    put_le(w->page + 4, w->seq, 4);
+    w->page[8] = NVS_IMAGE_PAGE_VERSION;
+    put_le(w->page + 28, nvs_image_crc32(0xFFFFFFFF, w->page + 4, 24), 4);
+    w->next_entry = 0;
+}
+
+static void page_emit(nvs_image_writer_t *w, uint32_t state)
+{
+    put_le(w->page, state, 4);
+    if (w->emit && w->emit(w->ctx, w->page) != 0) {
+        w->err = NVS_IMAGE_ERR_EMIT;
+    }
+    w->pages_emitted++;
+}
+
+// Make room for span consecutive entries, moving on to a new page if needed.
+// The last page of the partition is left empty, as the NVS library requires.
+static int reserve(nvs_image_writer_t *w, int span)
+{
+    if (w->err) {
+        return w->err;
+    }
+    if (w->next_entry + span <= NVS_IMAGE_ENTRIES_PER_PAGE) {
+        return NVS_IMAGE_OK;
+    }
+    if (w->pages_emitted + 2 >= w->page_count) {
+        w->err = NVS_IMAGE_ERR_NO_SPACE;
+        return w->err;
+    }
+    page_emit(w, NVS_IMAGE_PAGE_FULL);
+    w->seq++;
+    page_begin(w);
+    return w->err;
+}
+
+static void mark_written(nvs_image_writer_t *w, int index)
+{
+    // Two bits per entry: 0b11 empty, 0b10 written
+    w->page[PAGE_BITMAP_OFFSET + index / 4] &= ~(1 << ((index % 4) * 2));
+}
+
+static uint8_t *write_entry(nvs_image_writer_t *w, uint8_t ns_index, uint8_t type, uint8_t span,
+                            uint8_t chunk, const char *key, const uint8_t data[8])
+{
+    uint8_t *entry = w->page + PAGE_ENTRY_OFFSET + w->next_entry * NVS_IMAGE_ENTRY_SIZE;
+    entry[ENTRY_NS] = ns_index;
+    entry[ENTRY_TYPE] = type;
+    entry[ENTRY_SPAN] = span;
+    entry[ENTRY_CHUNK] = chunk;
+    memset(entry + ENTRY_KEY, 0, NVS_IMAGE_KEY_SIZE);
+    memcpy(entry + ENTRY_KEY, key, strlen(key));
+    memcpy(entry + ENTRY_DATA, data, 8);
+
+    put_le(entry + ENTRY_CRC, entry_crc(entry), 4);
+
+    mark_written(w, w->next_entry++);
+    return entry;
+}
+
+// Header entry plus data entries for a string or blob chunk; the caller reserved the span
+static void write_var_entry(nvs_image_writer_t *w, uint8_t ns_index, uint8_t type, uint8_t chunk,
+                            const char *key, const uint8_t *value, size_t len)
+{
+    int data_entries = (int)((len + NVS_IMAGE_ENTRY_SIZE - 1) / NVS_IMAGE_ENTRY_SIZE);
+    uint8_t data[8];
+    memset(data, 0xFF, sizeof(data));
+    put_le(data, len, 2);
+    put_le(data + 4, nvs_image_crc32(0xFFFFFFFF, value, len), 4);
+    write_entry(w, ns_index, type, (uint8_t)(1 + data_entries), chunk, key, data);
+
+    memcpy(w->page + PAGE_ENTRY_OFFSET + w->next_entry * NVS_IMAGE_ENTRY_SIZE, value, len);
+    for (int i = 0; i < data_entries; i++) {
+        mark_written(w, w->next_entry++);
+    }
+}
+
+static bool valid_key(const char *key)
+{
+    size_t len = key ? strlen(key) : 0;
+    return len > 0 && len < NVS_IMAGE_KEY_SIZE;
+}
+
+void nvs_image_writer_init(nvs_image_writer_t *w, size_t partition_size, nvs_image_emit_t emit, void *ctx)
+{
+    memset(w, 0, sizeof(*w));
+    w->page_count = partition_size / NVS_IMAGE_PAGE_SIZE;
+    w->emit = emit;
+    w->ctx = ctx;
+    if (partition_size % NVS_IMAGE_PAGE_SIZE != 0 || w->page_count < 2) {
+        w->err = NVS_IMAGE_ERR_INVALID_ARG;
+    }
+    page_begin(w);
+}
+
+int nvs_image_add_namespace(nvs_image_writer_t *w, const char *name, uint8_t *ns_index)
+{
+    if (!w->err && (!valid_key(name) || w->ns_count == 254)) {
+        w->err = NVS_IMAGE_ERR_INVALID_ARG;
+    }
+    if (reserve(w, 1) != NVS_IMAGE_OK) {
+        return w->err;
+    }
+    uint8_t data[8];
+    memset(data, 0xFF, sizeof(data));
+    data[0] = ++w->ns_count;
+    write_entry(w, 0, NVS_IMAGE_TYPE_U8, 1, CHUNK_ANY, name, data);
+    *ns_index = w->ns_count;
+    return NVS_IMAGE_OK;
+}
+
+int nvs_image_add_int(nvs_image_writer_t *w, uint8_t ns_index, const char *key, uint8_t type, uint64_t value)
+{
+    int width = type & 0x0F;
+    if (!w->err && (!valid_key(key) || (width != 1 && width != 2 && width != 4 && width != 8) || (type & 0xE0))) {
+        w->err = NVS_IMAGE_ERR_INVALID_ARG;
+    }
+    if (reserve(w, 1) != NVS_IMAGE_OK) {
+        return w->err;
+    }
+    uint8_t data[8];
+    memset(data, 0xFF, sizeof(data));
+    put_le(data, value, width);
+    write_entry(w, ns_index, type, 1, CHUNK_ANY, key, data);
+    w->entry_count++;
+    return NVS_IMAGE_OK;
+}
+
+int nvs_image_add_string(nvs_image_writer_t *w, uint8_t ns_index, const char *key, const char *value)
+{
+    size_t len = strlen(value) + 1;
+    if (!w->err && (!valid_key(key) || len > NVS_IMAGE_STR_MAX_SIZE)) {
+        w->err = NVS_IMAGE_ERR_INVALID_ARG;
+    }
+    // Strings never cross a page boundary
+    if (reserve(w, 1 + (int)((len + NVS_IMAGE_ENTRY_SIZE - 1) / NVS_IMAGE_ENTRY_SIZE)) != NVS_IMAGE_OK) {
+        return w->err;
+    }
+    write_var_entry(w, ns_index, NVS_IMAGE_TYPE_STR, CHUNK_ANY, key, (const uint8_t *)value, len);
+    w->entry_count++;
+    return NVS_IMAGE_OK;
+}
+
+int nvs_image_add_blob(nvs_image_writer_t *w, uint8_t ns_index, const char *key, const void *data, size_t len)
+{
+    if (!w->err && !valid_key(key)) {
+        w->err = NVS_IMAGE_ERR_INVALID_ARG;
+    }
+    // Fill the rest of the current page with a chunk, then continue on new pages
+    const uint8_t *p = data;
+    size_t offset = 0;
+    int chunks = 0;
+    do {
+        // A chunk needs its header entry plus at least one data entry; indices 0..127 are VER_0
+        if (!w->err && chunks == 128) {
+            w->err = NVS_IMAGE_ERR_INVALID_ARG;
+        }
+        if (reserve(w, 2) != NVS_IMAGE_OK) {
+            return w->err;
+        }
+        size_t room = (size_t)(NVS_IMAGE_ENTRIES_PER_PAGE - w->next_entry - 1) * NVS_IMAGE_ENTRY_SIZE;
+        size_t n = len - offset < room ? len - offset : room;
+        write_var_entry(w, ns_index, NVS_IMAGE_TYPE_BLOB_DATA, (uint8_t)chunks, key, p + offset, n);
+        offset += n;
+        chunks++;
+    } while (offset < len);
+
+    if (reserve(w, 1) != NVS_IMAGE_OK) {
+        return w->err;
+    }
+    uint8_t index[8];
+    memset(index, 0xFF, sizeof(index));
+    put_le(index, len, 4);
+    index[4] = (uint8_t)chunks;
+    index[5] = 0;   // Chunk indices start at 0 (VER_0)
+    write_entry(w, ns_index, NVS_IMAGE_TYPE_BLOB_IDX, 1, CHUNK_ANY, key, index);
+    w->entry_count++;
+    return NVS_IMAGE_OK;
+}
+
+int nvs_image_writer_finish(nvs_image_writer_t *w)
+{
+    if (w->err) {
+        return w->err;
+    }
+    page_emit(w, NVS_IMAGE_PAGE_ACTIVE);
+    memset(w->page, 0xFF, sizeof(w->page));
+    while (!w->err && w->pages_emitted < w->page_count) {
+        page_emit(w, NVS_IMAGE_PAGE_EMPTY);
+    }
+    return w->err;
+}
+
+bool nvs_image_page_header(const uint8_t *page, uint32_t *state, uint32_t *seq)
+{
+    uint32_t page_state = (uint32_t)get_le(page, 4);
+    if (state) {
+        *state = page_state;
+    }
+    if (seq) {
+        *seq = (uint32_t)get_le(page + 4, 4);
+    }
+    if (page_state == NVS_IMAGE_PAGE_EMPTY) {
+        return true;
+    }
+    if (page_state != NVS_IMAGE_PAGE_ACTIVE && page_state != NVS_IMAGE_PAGE_FULL && page_state != NVS_IMAGE_PAGE_FREEING) {
+        return false;
+    }
+    return nvs_image_crc32(0xFFFFFFFF, page + 4, 24) == (uint32_t)get_le(page + 28, 4);
+}
+
+int nvs_image_read_page(const uint8_t *page, nvs_image_item_cb_t cb, void *ctx)
+{
+    int index = 0;
+    while (index < NVS_IMAGE_ENTRIES_PER_PAGE) {
+        if (entry_state(page, index) != ENTRY_STATE_WRITTEN) {
+            index++;
+            continue;
+        }
+        const uint8_t *entry = page + PAGE_ENTRY_OFFSET + index * NVS_IMAGE_ENTRY_SIZE;
+        nvs_image_item_t item = {
+            .ns_index = entry[ENTRY_NS],
+            .type = entry[ENTRY_TYPE],
+            .span = entry[ENTRY_SPAN],
+            .chunk_index = entry[ENTRY_CHUNK],
+            .data = entry + ENTRY_DATA,
+            .crc_ok = entry_crc(entry) == (uint32_t)get_le(entry + ENTRY_CRC, 4),
+        };
+        memcpy(item.key, entry + ENTRY_KEY, NVS_IMAGE_KEY_SIZE - 1);
+        item.key[NVS_IMAGE_KEY_SIZE - 1] = '\0';
+
+        // A corrupt span would run past the page; treat the entry as a single one
+        if (item.span == 0 || index + item.span > NVS_IMAGE_ENTRIES_PER_PAGE) {
+            item.span = 1;
+            item.crc_ok = false;
+        }
+        if (item.type == NVS_IMAGE_TYPE_STR || item.type == NVS_IMAGE_TYPE_BLOB || item.type == NVS_IMAGE_TYPE_BLOB_DATA) {
+            size_t len = (size_t)get_le(item.data, 2);
+            if (len > (size_t)(item.span - 1) * NVS_IMAGE_ENTRY_SIZE) {
+                len = (size_t)(item.span - 1) * NVS_IMAGE_ENTRY_SIZE;
+                item.crc_ok = false;
+            }
+            item.payload = entry + NVS_IMAGE_ENTRY_SIZE;
+            item.payload_len = len;
+            if (nvs_image_crc32(0xFFFFFFFF, item.payload, len) != (uint32_t)get_le(item.data + 4, 4)) {
+                item.crc_ok = false;
+            }
+        }
+
+        int ret = cb(ctx, &item);
+        if (ret != 0) {
+            return ret;
+        }
+        index += item.span;
+    }
+    return 0;
+}
+
+int64_t nvs_image_item_int(const nvs_image_item_t *item)
+{
+    int width = item->type & 0x0F;
+    if (width != 1 && width != 2 && width != 4 && width != 8) {
+        return 0;
+    }
+    uint64_t value = get_le(item->data, width);
+    if ((item->type & 0x10) && width < 8 && (value >> (width * 8 - 1)) & 1) {
+        value |= ~0ULL << (width * 8);
+    }
+    return (int64_t)value;
+}
@@ -0,0 +1,217 @@
+#!/usr/bin/env python3
+"""Build-time asset pipeline for the embedded recovery UI.
+
+Splits the inline <style> and <script> blocks out of root.html, minifies the
+three resulting assets, fingerprints the CSS/JS by content hash and writes
+gzip (and optionally Brotli) variants ready for EMBED_FILES. A C route table
+(ui_assets.c) describing every asset is generated alongside them so main.c can
+register one handler per URI without knowing the fingerprints.
+
+Usage: build_ui_assets.py --input root.html --output-dir <dir> [--brotli <exe>]
+"""
+
+import argparse
+import gzip
+import hashlib
+import os
+import re
+import subprocess
+import sys
+
+IMMUTABLE = 'public, max-age=31536000, immutable'
+REVALIDATE = 'no-cache'
+
+
+def minify_css(css):
+    css = re.sub(r'/\*.*?\*/', '', css, flags=re.S)
+    css = re.sub(r'\s+', ' ', css)
+    css = re.sub(r'\s*([{}:;,>])\s*', r'\1', css)
+    css = css.replace(';}', '}')
+    return css.strip()
+
+
+def minify_js(js):
+    """Conservative JS minifier: drops comments and indentation, keeps line breaks.
+
+    Strings, template literals (including ${} nesting) and regex literals are
+    copied verbatim so the output is always semantically identical.
+    """
+    out = []
+    i = 0
+    n = len(js)
+    brace_stack = []  # True for a '{' opened by a template '${'
+    last_sig = ''
+
+    def copy_quoted(start, quote):
+        j = start + 1
+        while j < n and js[j] != quote:
+            j += 2 if js[j] == '\\' else 1
+        return j + 1
+
+    def copy_template(start):
+        # Returns index after the closing backtick or of the '${' opener
+        j = start
+        while j < n:
+            c = js[j]
+            if c == '\\':
+                j += 2
+            elif c == '`':
+                return j + 1, False
+            elif c == '$' and j + 1 < n and js[j + 1] == '{':
+                return j + 2, True
+            else:
+                j += 1
+        return j, False
+
+    while i < n:
+        c = js[i]
+        nxt = js[i + 1] if i + 1 < n else ''
+        if c in '"\'':
+            j = copy_quoted(i, c)
+            out.append(js[i:j])
+            last_sig = c
+            i = j
+        elif c == '`' or (c == '}' and brace_stack and brace_stack[-1]):
+            if c == '}':
+                brace_stack.pop()
+            j, opened = copy_template(i + 1)
+            out.append(js[i:j])
+            if opened:
+                brace_stack.append(True)
+                last_sig = '{'
+            else:
+                last_sig = '`'
+            i = j
+        elif c == '/' and nxt == '/':
+            while i < n and js[i] != '\n':
+                i += 1
+        elif c == '/' and nxt == '*':
+            end = js.find('*/', i + 2)
+            i = n if end < 0 else end + 2
+            out.append(' ')
+        elif c == '/' and (last_sig == '' or last_sig in '(,=:[!&|?{};+-*%<>~^\n'):
+            j = i + 1
+            in_class = False
+            while j < n and (in_class or js[j] != '/'):
+                if js[j] == '\\':
+                    j += 1
+                elif js[j] == '[':
+                    in_class = True
+                elif js[j] == ']':
+                    in_class = False
+                j += 1
+            j += 1
+            while j < n and js[j].isalpha():
+                j += 1
+            out.append(js[i:j])
+            last_sig = '/'
+            i = j
+        else:
+            if c == '{':
+                brace_stack.append(False)
+            elif c == '}' and brace_stack:
+                brace_stack.pop()
+            out.append(c)
+            if not c.isspace():
+                last_sig = c
+            i += 1
+
+    lines = []
+    for line in ''.join(out).split('\n'):
+        line = line.strip()
+        if line:
+            lines.append(line)
+    return '\n'.join(lines)
+
+
+def minify_html(html):
+    # The static markup has no <pre>/<textarea>, so collapsing whitespace never changes rendering
+    html = re.sub(r'<!--.*?-->', '', html, flags=re.S)
+    html = re.sub(r'\s+', ' ', html)
+    return html.strip()
+
+
+def fingerprint(data):
+    return hashlib.sha256(data).hexdigest()[:10]
+
+
+def symbol_for(filename):
+    # Mirrors the symbol naming used by ESP-IDF's EMBED_FILES
+    return '_binary_' + re.sub(r'[^A-Za-z0-9]', '_', filename)
+
+
+def write_file(path, data):
+    with open(path, 'wb') as f:
+        f.write(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--input', required=True)
+    parser.add_argument('--output-dir', required=True)
+    parser.add_argument('--brotli', help='brotli encoder executable; omit to embed gzip only')
+    args = parser.parse_args()
+
+    with open(args.input, encoding='utf-8') as f:
+        html = f.read()
+
+    style = re.search(r'<style>(.*?)</style>', html, flags=re.S)
+    script = re.search(r'<script>(.*?)</script>', html, flags=re.S)
+    if not style or not script:
+        sys.exit('build_ui_assets: expected one inline <style> and one inline <script> block')
+
+    css = minify_css(style.group(1)).encode('utf-8')
+    js = minify_js(script.group(1)).encode('utf-8')
+    css_uri = '/assets/app.%s.css' % fingerprint(css)
+    js_uri = '/assets/app.%s.js' % fingerprint(js)
+
+    html = html.replace(style.group(0), '<link rel="stylesheet" href="%s">' % css_uri)
+    html = html.replace(script.group(0), '<script src="%s"></script>' % js_uri)
+    html = minify_html(html).encode('utf-8')
+
+    # (uri, embedded file stem, content type, cache policy, body)
+    assets = [
+        ('/', 'root.html', 'text/html', REVALIDATE, html),
+        (css_uri, 'app.css', 'text/css', IMMUTABLE, css),
+        (js_uri, 'app.js', 'application/javascript', IMMUTABLE, js),
+    ]
+
+    os.makedirs(args.output_dir, exist_ok=True)
+    rows = []
+    externs = []
+    for uri, stem, content_type, cache_control, body in assets:
+        gz_name = stem + '.gz'
+        write_file(os.path.join(args.output_dir, gz_name), gzip.compress(body, 9, mtime=0))
+        externs.append(gz_name)
+        br_name = None
+        if args.brotli:
+            br_name = stem + '.br'
+            br = subprocess.run([args.brotli, '-q', '11', '-c'], input=body, stdout=subprocess.PIPE, check=True).stdout
+            write_file(os.path.join(args.output_dir, br_name), br)
+            externs.append(br_name)
+        rows.append((uri, content_type, fingerprint(body), cache_control, gz_name, br_name))
+
+    c = ['/* Generated by build_ui_assets.py - do not edit */', '#include "ui_assets.h"', '']
+    for name in externs:
+        sym = symbol_for(name)
+        c.append('extern const uint8_t %s_start[] asm("%s_start");' % (sym, sym))
+        c.append('extern const uint8_t %s_end[] asm("%s_end");' % (sym, sym))
+    c.append('')
+    c.append('const ui_asset_t ui_assets[] = {')
+    for uri, content_type, etag, cache_control, gz_name, br_name in rows:
+        gz = symbol_for(gz_name)
+        br = ('%s_start, %s_end' % (symbol_for(br_name), symbol_for(br_name))) if br_name else 'NULL, NULL'
+        c.append('    { "%s", "%s", "%s", "%s", %s_start, %s_end, %s },'
+                 % (uri, content_type, etag, cache_control, gz, gz, br))
+    c.append('};')
+    c.append('')
+    c.append('const size_t ui_assets_count = sizeof(ui_assets) / sizeof(ui_assets[0]);')
+    c.append('')
+    write_file(os.path.join(args.output_dir, 'ui_assets.c'), '\n'.join(c).encode('utf-8'))
+
+    for uri, _, _, _, body in assets:
+        print('  %-32s %6d bytes minified' % (uri, len(body)))
+
+
+if __name__ == '__main__':
+    main()
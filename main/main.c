@@ -5,6 +5,9 @@
 */
 
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -15,18 +18,23 @@
 #include "esp_partition.h"
 #include "esp_http_server.h"
 #include "esp_mac.h"
+#include "esp_random.h"
 #include "esp_task_wdt.h"
 #include "esp_ota_ops.h"
 #include "esp_spiffs.h"
+#include "esp_littlefs.h"
+#include "mbedtls/sha256.h"
 #include "dns_server.h"
+#include "lwip/sockets.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "nvs_flash.h"
+#include "nvs_image.h"
+#include "http_parse.h"
 #include "hal/wdt_hal.h"
-
-// Embedded web UI (gzipped)
-extern const char root_start[] asm("_binary_root_html_gz_start");
-extern const char root_end[] asm("_binary_root_html_gz_end");
+#include "ui_assets.h"
 
 static const char *TAG = "esp_recovery_factory";
 
@@ -80,1359 +88,4899 @@ static void load_wifi_config_from_nvs(wifi_config_t *wifi_config)
     wifi_config->ap.max_connection = CONFIG_ESP_MAX_STA_CONN;
 }
 
-// HTTP GET Handler - Serves the UI
-static esp_err_t root_get_handler(httpd_req_t *req)
+// Check whether a comma separated header value lists the given token (e.g. "br" in Accept-Encoding)
+static bool header_has_token(const char *value, const char *token)
 {
-    const uint32_t root_len = root_end - root_start;
-    ESP_LOGI(TAG, "Serving compressed UI (%u bytes)", root_len);
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
-    httpd_resp_send(req, root_start, root_len);
-    return ESP_OK;
+    size_t token_len = strlen(token);
+    const char *p = value;
+    while (*p) {
+        while (*p == ' ' || *p == ',') {
+            p++;
+        }
+        const char *end = p;
+        while (*end && *end != ',' && *end != ';' && *end != ' ') {
+            end++;
+        }
+        if ((size_t)(end - p) == token_len && strncmp(p, token, token_len) == 0) {
+            // "br;q=0" explicitly refuses the encoding
+            const char *q = strstr(end, ";q=");
+            const char *next = strchr(end, ',');
+            if (q && (!next || q < next)) {
+                return strtof(q + 3, NULL) > 0.0f;
+            }
+            return true;
+        }
+        while (*end && *end != ',') {
+            end++;
+        }
+        p = end;
+    }
+    return false;
 }
 
-// HTTP POST Handler - Handles firmware/binary upload to any partition
-static esp_err_t upload_post_handler(httpd_req_t *req)
+// Parse the request's URL query into query; false when there is none (or it is too long)
+static bool query_parse(httpd_req_t *req, http_query_t *query)
 {
-    int total_len = req->content_len;
-    int received = 0;
-    int ret;
-    
-    // Get partition label from query parameter
-    char label[64] = {0};
-    if (httpd_req_get_url_query_str(req, label, sizeof(label)) == ESP_OK) {
-        char *label_ptr = strchr(label, '=');
-        if (label_ptr) {
-            label_ptr++;
-            memmove(label, label_ptr, strlen(label_ptr) + 1);
-            int i = 0, j = 0;
-            while (label[i]) {
-                if (label[i] == '%' && i + 2 < sizeof(label)) {
-                    int hex;
-                    sscanf(&label[i + 1], "%2x", &hex);
-                    label[j++] = (char)hex;
-                    i += 3;
-                } else {
-                    label[j++] = label[i++];
-                }
-            }
-            label[j] = '\0';
-        }
+    query->count = 0;
+    size_t len = httpd_req_get_url_query_len(req);
+    if (len == 0) {
+        return false;
     }
+    if (len >= sizeof(query->buf)) {
+        ESP_LOGW(TAG, "Query string too long (%u bytes)", (unsigned)len);
+        return false;
+    }
+    if (httpd_req_get_url_query_str(req, query->buf, sizeof(query->buf)) != ESP_OK) {
+        return false;
+    }
+    return http_query_parse(query, query->buf, len) > 0;
+}
 
-    if (strlen(label) == 0) {
-        ESP_LOGE(TAG, "Partition label not provided");
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition label required");
-        return ESP_FAIL;
+// Copy a query parameter; out is left empty when the key is absent or the value does not fit
+static bool query_get_param(const http_query_t *query, const char *key, char *out, size_t out_len)
+{
+    out[0] = '\0';
+    const char *value = http_query_get(query, key);
+    if (!value || strlen(value) >= out_len) {
+        return false;
     }
+    strcpy(out, value);
+    return true;
+}
 
-    ESP_LOGI(TAG, "Upload started. Total content length: %d bytes. Target partition: %s", total_len, label);
+// Buffered chunked response writer - batches many small writes (e.g. JSON list
+// entries) into few httpd_resp_send_chunk calls and never truncates output
+#define CHUNK_WRITER_BUF_SIZE 1024
 
-    if (total_len > MAX_OTA_DATA_SIZE) {
-        ESP_LOGE(TAG, "Binary too large (%d > %d)", total_len, MAX_OTA_DATA_SIZE);
-        httpd_resp_send_err(req, HTTPD_413_CONTENT_TOO_LARGE, "Binary too large");
-        return ESP_FAIL;
+typedef struct {
+    httpd_req_t *req;
+    esp_err_t err;
+    size_t len;
+    bool started;           // A chunk (and so the status line) has been sent
+    char buf[CHUNK_WRITER_BUF_SIZE];
+} chunk_writer_t;
+
+static void chunk_writer_init(chunk_writer_t *w, httpd_req_t *req)
+{
+    w->req = req;
+    w->err = ESP_OK;
+    w->len = 0;
+    w->started = false;
+}
+
+static esp_err_t chunk_writer_flush(chunk_writer_t *w)
+{
+    if (w->err == ESP_OK && w->len > 0) {
+        w->err = httpd_resp_send_chunk(w->req, w->buf, w->len);
+        w->started = true;
     }
+    w->len = 0;
+    return w->err;
+}
 
-    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, label);
-    if (!partition) {
-        ESP_LOGE(TAG, "Failed to find partition with label: %s", label);
-        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Partition not found");
-        return ESP_FAIL;
+static void chunk_writer_write(chunk_writer_t *w, const char *data, size_t len)
+{
+    while (len > 0 && w->err == ESP_OK) {
+        size_t n = CHUNK_WRITER_BUF_SIZE - w->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(w->buf + w->len, data, n);
+        w->len += n;
+        data += n;
+        len -= n;
+        if (w->len == CHUNK_WRITER_BUF_SIZE) {
+            chunk_writer_flush(w);
+        }
     }
+}
 
-    ESP_LOGI(TAG, "Writing to partition: %s (0x%lx, size: 0x%lx)", partition->label, partition->address, partition->size);
+static void chunk_writer_printf(chunk_writer_t *w, const char *fmt, ...)
+{
+    char tmp[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, args);
+    va_end(args);
+    if (n < 0) {
+        return;
+    }
+    if ((size_t)n < sizeof(tmp)) {
+        chunk_writer_write(w, tmp, n);
+        return;
+    }
 
-    size_t write_offset = 0;
-    int pages_compared = 0;
-    int pages_written = 0;
-    
-    // Buffers for optimized writing
-    char *page_buf = malloc(4096);           // 4KB buffer for reading pages
-    char *existing_buf = malloc(4096);       // 4KB buffer for comparing
-    char *write_buf = malloc(256 * 1024);    // 256KB accumulation buffer
-    
-    if (!page_buf || !existing_buf || !write_buf) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
-        if (page_buf) free(page_buf);
-        if (existing_buf) free(existing_buf);
-        if (write_buf) free(write_buf);
-        return ESP_FAIL;
+    char *big = malloc(n + 1);
+    if (!big) {
+        w->err = ESP_ERR_NO_MEM;
+        return;
     }
-    
-    size_t write_buf_offset = 0;             // Offset within write_buf
-    size_t write_buf_start_addr = 0;         // Starting partition address for write_buf
-    bool write_buf_active = false;           // Whether we're accumulating changes
-    
-    while (received < total_len) {
-        int to_recv = (total_len - received) > 4096 ? 4096 : (total_len - received);
-        
-        // Receive full 4KB or partial for last chunk
-        int recv_bytes = 0;
-        while (recv_bytes < to_recv) {
-            ret = httpd_req_recv(req, page_buf + recv_bytes, to_recv - recv_bytes);
-            if (ret <= 0) {
-                if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-                    ESP_LOGE(TAG, "Upload socket timeout");
-                }
-                goto error_out;
-            }
-            recv_bytes += ret;
-        }
-        
-        // Pad partial final page with 0xFF
-        if (recv_bytes < 4096) {
-            memset(page_buf + recv_bytes, 0xFF, 4096 - recv_bytes);
+    va_start(args, fmt);
+    vsnprintf(big, n + 1, fmt, args);
+    va_end(args);
+    chunk_writer_write(w, big, n);
+    free(big);
+}
+
+// Write a quoted, escaped JSON string
+static void chunk_writer_json_string(chunk_writer_t *w, const char *str)
+{
+    chunk_writer_write(w, "\"", 1);
+    const char *run = str;
+    for (const char *p = str; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '"' || c == '\\' || c < 0x20) {
+            chunk_writer_write(w, run, p - run);
+            char esc[8];
+            int n = (c == '"' || c == '\\') ? snprintf(esc, sizeof(esc), "\\%c", c)
+                                             : snprintf(esc, sizeof(esc), "\\u%04x", c);
+            chunk_writer_write(w, esc, n);
+            run = p + 1;
         }
-        
-        // Read existing data to compare
-        esp_err_t read_err = esp_partition_read(partition, write_offset, existing_buf, 4096);
-        
-        // Check if this page differs
-        bool data_differs = (read_err != ESP_OK) || (memcmp(page_buf, existing_buf, 4096) != 0);
-        pages_compared++;
-        
-        if (data_differs) {
-            // Page differs - add to accumulation buffer
-            if (!write_buf_active) {
-                write_buf_active = true;
-                write_buf_start_addr = write_offset;
-                write_buf_offset = 0;
-            }
-            
-            // Copy page to write buffer
-            memcpy(write_buf + write_buf_offset, page_buf, 4096);
-            write_buf_offset += 4096;
-            
-            // Check if accumulation buffer is full or if this is the last page
-            bool buf_full = (write_buf_offset >= 256 * 1024);
-            bool is_last_page = (received + to_recv >= total_len);
-            
-            if (buf_full || is_last_page) {
-                // Flush accumulation buffer
-                size_t erase_len = ((write_buf_offset + 4095) / 4096) * 4096;  // Round up to 4KB
-                
-                esp_err_t err = esp_partition_erase_range(partition, write_buf_start_addr, erase_len);
-                if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to erase partition at 0x%lx: %d", write_buf_start_addr, err);
-                    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to erase partition");
-                    goto error_out;
-                }
-                
-                err = esp_partition_write(partition, write_buf_start_addr, write_buf, write_buf_offset);
-                if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to write partition: %s", esp_err_to_name(err));
-                    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Write failed");
-                    goto error_out;
-                }
-                
-                pages_written += (write_buf_offset / 4096);
-                write_buf_active = false;
-                write_buf_offset = 0;
-            }
-        } else {
-            // Page matches existing - flush any pending writes
-            if (write_buf_active) {
-                size_t erase_len = ((write_buf_offset + 4095) / 4096) * 4096;  // Round up to 4KB
-                
-                esp_err_t err = esp_partition_erase_range(partition, write_buf_start_addr, erase_len);
-                if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to erase partition at 0x%lx: %d", write_buf_start_addr, err);
-                    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to erase partition");
-                    goto error_out;
-                }
-                
-                err = esp_partition_write(partition, write_buf_start_addr, write_buf, write_buf_offset);
-                if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to write partition: %s", esp_err_to_name(err));
-                    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Write failed");
-                    goto error_out;
-                }
-                
-                pages_written += (write_buf_offset / 4096);
-                write_buf_active = false;
-                write_buf_offset = 0;
-            }
+    }
+    chunk_writer_write(w, run, strlen(run));
+    chunk_writer_write(w, "\"", 1);
+}
+
+// Write binary data as base64 (no quotes or line breaks)
+static void chunk_writer_base64(chunk_writer_t *w, const uint8_t *data, size_t len)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char out[4];
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t group = (uint32_t)data[i] << 16;
+        if (i + 1 < len) {
+            group |= (uint32_t)data[i + 1] << 8;
         }
-        
-        write_offset += 4096;
-        received += to_recv;
-        
-        if (received % (64 * 1024) == 0) {
-            ESP_LOGI(TAG, "Upload progress: %d/%d bytes (%.1f%%) - %d/%d pages written", 
-                     received, total_len, (float)received / total_len * 100, pages_written, pages_compared);
+        if (i + 2 < len) {
+            group |= data[i + 2];
         }
+        out[0] = alphabet[(group >> 18) & 0x3F];
+        out[1] = alphabet[(group >> 12) & 0x3F];
+        out[2] = i + 1 < len ? alphabet[(group >> 6) & 0x3F] : '=';
+        out[3] = i + 2 < len ? alphabet[group & 0x3F] : '=';
+        chunk_writer_write(w, out, 4);
     }
+}
 
-    free(page_buf);
-    free(existing_buf);
-    free(write_buf);
+// Flush and terminate the chunked response
+static esp_err_t chunk_writer_finish(chunk_writer_t *w)
+{
+    chunk_writer_flush(w);
+    if (w->err == ESP_OK) {
+        w->err = httpd_resp_send_chunk(w->req, NULL, 0);
+    }
+    return w->err;
+}
 
-    if (received != total_len) {
-        ESP_LOGE(TAG, "Upload incomplete: received %d / %d bytes", received, total_len);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Upload incomplete");
-        return ESP_FAIL;
+// HTTP GET Handler - Serves the UI assets from the generated route table
+static esp_err_t ui_asset_handler(httpd_req_t *req)
+{
+    const ui_asset_t *asset = req->user_ctx;
+    const uint8_t *body = asset->gzip_start;
+    size_t body_len = asset->gzip_end - asset->gzip_start;
+    const char *encoding = "gzip";
+
+    char accept_encoding[128] = {0};
+    if (asset->br_start &&
+        httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept_encoding, sizeof(accept_encoding)) == ESP_OK &&
+        header_has_token(accept_encoding, "br")) {
+        body = asset->br_start;
+        body_len = asset->br_end - asset->br_start;
+        encoding = "br";
     }
 
-    ESP_LOGI(TAG, "Binary uploaded successfully to partition '%s'. Total: %d bytes (%d pages compared, %d pages written)", 
-             label, received, pages_compared, pages_written);
-    
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, "{\"status\":\"success\", \"message\":\"Binary uploaded successfully\"}", HTTPD_RESP_USE_STRLEN);
+    // One ETag per representation so caches never mix up gzip and Brotli bodies
+    char etag[32];
+    snprintf(etag, sizeof(etag), "\"%s-%s\"", asset->hash, encoding[0] == 'b' ? "br" : "gz");
+    httpd_resp_set_hdr(req, "Cache-Control", asset->cache_control);
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    httpd_resp_set_hdr(req, "ETag", etag);
 
-    return ESP_OK;
+    // Any representation of the current build is still valid for the client's cache entry
+    char if_none_match[128] = {0};
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        (strstr(if_none_match, asset->hash) || strcmp(if_none_match, "*") == 0)) {
+        ESP_LOGI(TAG, "UI asset %s not modified", asset->uri);
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
+    }
 
-error_out:
-    free(page_buf);
-    free(existing_buf);
-    free(write_buf);
-    return ESP_FAIL;
+    ESP_LOGI(TAG, "Serving UI asset %s (%s, %u bytes)", asset->uri, encoding, (unsigned)body_len);
+    httpd_resp_set_type(req, asset->content_type);
+    httpd_resp_set_hdr(req, "Content-Encoding", encoding);
+    httpd_resp_send(req, (const char *)body, body_len);
+    return ESP_OK;
 }
 
-// HTTP Partition Upload Handler - Upload binary data to any partition
+// Shared transfer buffer pool - large receive buffers are allocated on first
+// use and then reused, so bulk transfers never pay per-request malloc/free of
+// big blocks or fall back to tiny stack buffers.
+#define XFER_BUF_SIZE (16 * 1024)
+#define XFER_BUF_COUNT 2
 
-// HTTP Status Handler - Returns partition information
-static esp_err_t status_get_handler(httpd_req_t *req)
+static char *xfer_bufs[XFER_BUF_COUNT];
+static bool xfer_buf_in_use[XFER_BUF_COUNT];
+static SemaphoreHandle_t xfer_pool_lock;
+
+static char *xfer_buf_acquire(void)
 {
-    char *response = malloc(2048);
-    if (!response) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
-        return ESP_FAIL;
-    }
-    
-    // Get currently running partition
-    const esp_partition_t *running_partition = esp_ota_get_running_partition();
-    const char *running_label = running_partition ? running_partition->label : "";
-    
-    // Get currently selected boot partition
-    const esp_partition_t *boot_partition = esp_ota_get_boot_partition();
-    const char *boot_label = boot_partition ? boot_partition->label : "";
-    
-    char *response_ptr = response;
-    int response_size = 2048;
-    int remaining = response_size - 1;
-    
-    response_ptr += snprintf(response_ptr, remaining, "{\"running_partition\":\"%s\", \"boot_partition\":\"%s\", \"partitions\":[\n", running_label, boot_label);
-    remaining = response_size - 1 - (response_ptr - response);
-    
-    esp_partition_iterator_t it = esp_partition_find(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, NULL);
-    int partition_count = 0;
-    
-    while (it != NULL) {
-        const esp_partition_t *partition = esp_partition_get(it);
-        
-        // Include Factory, OTA, SPIFFS, and NVS partitions
-        bool include = false;
-        if (partition->type == ESP_PARTITION_TYPE_APP && 
-            (partition->subtype == ESP_PARTITION_SUBTYPE_APP_FACTORY ||
-             (partition->subtype >= ESP_PARTITION_SUBTYPE_APP_OTA_MIN && partition->subtype <= ESP_PARTITION_SUBTYPE_APP_OTA_MAX))) {
-            include = true;
-        }
-        if (partition->type == ESP_PARTITION_TYPE_DATA && 
-            (partition->subtype == ESP_PARTITION_SUBTYPE_DATA_SPIFFS ||
-             partition->subtype == ESP_PARTITION_SUBTYPE_DATA_NVS)) {
-            include = true;
+    char *buf = NULL;
+    xSemaphoreTake(xfer_pool_lock, portMAX_DELAY);
+    for (int i = 0; i < XFER_BUF_COUNT; i++) {
+        if (xfer_buf_in_use[i]) {
+            continue;
         }
-        
-        if (include) {
-            if (partition_count > 0) {
-                response_ptr += snprintf(response_ptr, remaining, ",\n");
-                remaining = response_size - 1 - (response_ptr - response);
+        if (!xfer_bufs[i]) {
+            xfer_bufs[i] = malloc(XFER_BUF_SIZE);
+            if (!xfer_bufs[i]) {
+                break;
             }
-            
-            response_ptr += snprintf(response_ptr, remaining,
-                                    "  {\"label\":\"%s\", \"address\":\"0x%lx\", \"size\":%lu, \"type\":%d, \"subtype\":%d}",
-                                    partition->label,
-                                    partition->address,
-                                    partition->size,
-                                    partition->type,
-                                    partition->subtype);
-            remaining = response_size - 1 - (response_ptr - response);
-            partition_count++;
         }
-        
-        it = esp_partition_next(it);
+        xfer_buf_in_use[i] = true;
+        buf = xfer_bufs[i];
+        break;
     }
-    esp_partition_iterator_release(it);
-    
-    response_ptr += snprintf(response_ptr, remaining, "\n]}");
-    
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, response, strlen(response));
-    free(response);
-    return ESP_OK;
+    xSemaphoreGive(xfer_pool_lock);
+    return buf;
 }
 
-// HTTP Clear Partition Handler
-static esp_err_t clear_partition_handler(httpd_req_t *req)
+static void xfer_buf_release(char *buf)
 {
-    char label[64] = {0};
-    char *buf = malloc(512);
-    if (!buf) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
-        return ESP_FAIL;
+    xSemaphoreTake(xfer_pool_lock, portMAX_DELAY);
+    for (int i = 0; i < XFER_BUF_COUNT; i++) {
+        if (xfer_bufs[i] == buf) {
+            xfer_buf_in_use[i] = false;
+        }
     }
-    int ret = httpd_req_recv(req, buf, 512);
-    
-    if (ret <= 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
-        free(buf);
-        return ESP_FAIL;
+    xSemaphoreGive(xfer_pool_lock);
+}
+
+// Partition locks - long transfers run on async workers, so two requests can reach the
+// same partition at once. Raw rewrites (upload, clear, SPIFFS format, NVS import) hold a
+// partition exclusively; downloads, filesystem mounts and NVS key access share it. A
+// conflicting request gets 409 instead of waiting behind a transfer that may take minutes,
+// while requests on other partitions proceed in parallel.
+#define PARTITION_LOCK_SLOTS 8
+
+typedef struct {
+    const esp_partition_t *partition;   // NULL while the slot is unused
+    int readers;
+    bool writer;
+} partition_lock_t;
+
+static partition_lock_t partition_locks[PARTITION_LOCK_SLOTS];
+static SemaphoreHandle_t partition_lock_table_lock;
+
+// A NULL partition is never locked, so callers may lock before checking a lookup
+static bool partition_lock_try(const esp_partition_t *partition, bool exclusive)
+{
+    if (!partition) {
+        return true;
     }
     
-    char *label_ptr = strstr(buf, "\"label\":\"");
-    if (label_ptr) {
-        label_ptr += strlen("\"label\":\"");
-        int i = 0;
-        while (label_ptr[i] != '"' && i < 63) {
-            label[i] = label_ptr[i];
-            i++;
+    bool locked = false;
+    partition_lock_t *slot = NULL;
+    xSemaphoreTake(partition_lock_table_lock, portMAX_DELAY);
+    for (int i = 0; i < PARTITION_LOCK_SLOTS; i++) {
+        if (partition_locks[i].partition == partition) {
+            slot = &partition_locks[i];
+            break;
+        }
+        if (!slot && !partition_locks[i].partition) {
+            slot = &partition_locks[i];
         }
-        label[i] = '\0';
     }
-    free(buf);
-    
-    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (slot && !slot->writer && (!exclusive || slot->readers == 0)) {
+        slot->partition = partition;
+        if (exclusive) {
+            slot->writer = true;
+        } else {
+            slot->readers++;
+        }
+        locked = true;
+    }
+    xSemaphoreGive(partition_lock_table_lock);
+    return locked;
+}
+
+static void partition_unlock(const esp_partition_t *partition, bool exclusive)
+{
     if (!partition) {
-        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Partition not found");
-        return ESP_FAIL;
+        return;
     }
     
-    ESP_LOGI(TAG, "Clearing partition: %s", label);
-    esp_err_t err = esp_partition_erase_range(partition, 0, partition->size);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to erase partition: %s", esp_err_to_name(err));
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to erase partition");
-        return ESP_FAIL;
+    xSemaphoreTake(partition_lock_table_lock, portMAX_DELAY);
+    for (int i = 0; i < PARTITION_LOCK_SLOTS; i++) {
+        partition_lock_t *slot = &partition_locks[i];
+        if (slot->partition != partition) {
+            continue;
+        }
+        if (exclusive) {
+            slot->writer = false;
+        } else if (slot->readers > 0) {
+            slot->readers--;
+        }
+        if (!slot->writer && slot->readers == 0) {
+            slot->partition = NULL;
+        }
+        break;
     }
-    
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, "{\"status\":\"success\", \"message\":\"Partition cleared\"}", HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+    xSemaphoreGive(partition_lock_table_lock);
 }
 
-// HTTP Download Partition Handler
-static esp_err_t download_partition_handler(httpd_req_t *req)
+static void partition_busy_response(httpd_req_t *req, const esp_partition_t *partition)
+{
+    ESP_LOGW(TAG, "Partition %s is in use, rejecting %s", partition->label, req->uri);
+    httpd_resp_set_status(req, "409 Conflict");
+    httpd_resp_sendstr(req, "Partition is in use by another request");
+}
+
+// Lock a partition for a request, sending 409 Conflict when another request holds it
+static bool partition_lock_req(httpd_req_t *req, const esp_partition_t *partition, bool exclusive)
+{
+    if (partition_lock_try(partition, exclusive)) {
+        return true;
+    }
+    partition_busy_response(req, partition);
+    return false;
+}
+
+// Receive exactly len bytes of the request body (less only on error)
+static int recv_full(httpd_req_t *req, char *buf, size_t len)
 {
-    char label[64];
-    if (httpd_req_get_url_query_str(req, label, sizeof(label)) == ESP_OK) {
-        char *label_ptr = strchr(label, '=');
-        if (label_ptr) {
-            label_ptr++;
-            memmove(label, label_ptr, strlen(label_ptr) + 1);
+    size_t filled = 0;
+    while (filled < len) {
+        int ret = httpd_req_recv(req, buf + filled, len - filled);
+        if (ret <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                ESP_LOGE(TAG, "Upload socket timeout");
+            }
+            return ret;
         }
+        filled += ret;
     }
-    
-    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, label);
-    if (!partition) {
-        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Partition not found");
-        return ESP_FAIL;
+    return filled;
+}
+
+// Receive the whole request body into a NUL-terminated heap buffer.
+// Sends the error response and returns NULL on failure.
+static char *read_body(httpd_req_t *req, size_t max_len)
+{
+    if (req->content_len == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Request body required");
+        return NULL;
     }
-    
-    ESP_LOGI(TAG, "Downloading partition: %s (size: %lu)", label, partition->size);
-    
-    char filename[128];
-    snprintf(filename, sizeof(filename), "attachment; filename=\"partition_%s.bin\"", label);
-    httpd_resp_set_hdr(req, "Content-Disposition", filename);
-    httpd_resp_set_type(req, "application/octet-stream");
-    
+    if (req->content_len > max_len) {
+        httpd_resp_send_err(req, HTTPD_413_CONTENT_TOO_LARGE, "Request body too large");
+        return NULL;
+    }
+    char *body = malloc(req->content_len + 1);
+    if (!body) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return NULL;
+    }
+    if (recv_full(req, body, req->content_len) != (int)req->content_len) {
+        free(body);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
+        return NULL;
+    }
+    body[req->content_len] = '\0';
+    return body;
+}
+
+#define JSON_DOC_FIXED_TOKENS 16
+#define JSON_SMALL_MAX_BODY 1024    // Single-object request bodies (clear, delete, format, set_boot)
+
+// A JSON request body and its tokens; token 0 is the top-level object
+typedef struct {
+    char *body;
+    json_tok_t *toks;
+    int count;
+    json_tok_t fixed[JSON_DOC_FIXED_TOKENS];    // Small bodies need no token allocation
+} json_doc_t;
+
+// Receive a JSON object body and tokenize it. Small bodies are parsed in one pass into
+// the fixed tokens, larger ones are counted first and get an exactly sized token array.
+// Sends the error response and returns false on failure.
+static bool read_json(httpd_req_t *req, size_t max_len, json_doc_t *doc)
+{
+    doc->toks = doc->fixed;
+    doc->body = read_body(req, max_len);
+    if (!doc->body) {
+        return false;
+    }
+    int count = json_parse(doc->body, req->content_len, doc->fixed, JSON_DOC_FIXED_TOKENS);
+    if (count == JSON_ERR_NOMEM) {
+        count = json_parse(doc->body, req->content_len, NULL, 0);
+        if (count > 0) {
+            doc->toks = malloc(count * sizeof(json_tok_t));
+            if (!doc->toks) {
+                doc->toks = doc->fixed;
+                free(doc->body);
+                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+                return false;
+            }
+            count = json_parse(doc->body, req->content_len, doc->toks, count);
+        }
+    }
+    if (count < 0 || doc->toks[0].type != JSON_OBJECT) {
+        ESP_LOGW(TAG, "Invalid JSON body (%d)", count);
+        if (doc->toks != doc->fixed) {
+            free(doc->toks);
+        }
+        free(doc->body);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return false;
+    }
+    doc->count = count;
+    return true;
+}
+
+static void json_doc_free(json_doc_t *doc)
+{
+    if (doc->toks != doc->fixed) {
+        free(doc->toks);
+    }
+    free(doc->body);
+}
+
+// Token index of the member key of the body object when it is an array, -1 otherwise
+static int json_doc_array(const json_doc_t *doc, const char *key)
+{
+    int array = json_object_get(doc->body, doc->toks, 0, key);
+    return array >= 0 && doc->toks[array].type == JSON_ARRAY ? array : -1;
+}
+
+// Shell-style wildcard match: '*' matches any run of characters (including '/'), '?' one character
+static bool glob_match(const char *pattern, const char *name)
+{
+    const char *star = NULL, *resume = NULL;
+    while (*name) {
+        if (*pattern == '*') {
+            star = pattern++;
+            resume = name;
+        } else if (*pattern == '?' || *pattern == *name) {
+            pattern++;
+            name++;
+        } else if (star) {
+            pattern = star + 1;
+            name = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
+
+// Filesystem mount cache - mounting SPIFFS scans the whole partition, so recently
+// used SPIFFS and LittleFS partitions stay mounted between requests. Entries are
+// reference counted while a handler uses them and evicted least-recently-used
+// when a slot is needed.
+#define FS_MOUNT_CACHE_SIZE 2
+
+// Partition subtype reserved for LittleFS (ESP_PARTITION_SUBTYPE_DATA_LITTLEFS in newer IDF)
+#define PARTITION_SUBTYPE_DATA_LITTLEFS 0x83
+#define LITTLEFS_BLOCK_SIZE 4096
+#define FS_WALK_MAX_DEPTH 8
+
+// Cached content hash of one file, kept for as long as the partition stays mounted
+typedef struct fs_hash_entry {
+    struct fs_hash_entry *next;
+    long size;
+    uint8_t sha256[32];
+    char name[];
+} fs_hash_entry_t;
+
+typedef struct {
+    char label[17];
+    char base_path[20];
+    const esp_partition_t *partition;
+    int refcount;           // Every reference holds a shared partition lock
+    bool mounted;
+    bool littlefs;          // LittleFS rather than SPIFFS - real directories, no GC needed
+    bool stale;             // Raw partition was rewritten while in use - unmount on release
+    TickType_t last_used;
+    fs_hash_entry_t *hashes;    // Manifest hash cache, dropped with the mount
+    uint32_t hash_gen;      // Bumped on every file change; a hash computed across one is not cached
+    bool gc_pending;        // Files were written or deleted since the last complete GC
+    bool gc_running;        // The GC task is erasing blocks of this partition right now
+    uint32_t gc_passes;     // Background GC passes run on this mount
+    uint32_t gc_retries;    // Passes since the mount last changed
+    esp_err_t gc_last_result;
+    TickType_t gc_last_run;
+} fs_mount_t;
+
+static fs_mount_t fs_mounts[FS_MOUNT_CACHE_SIZE];
+static SemaphoreHandle_t fs_mount_lock;
+
+static void fs_mount_unmount_locked(fs_mount_t *mount)
+{
+    ESP_LOGI(TAG, "Unmounting %s partition %s", mount->littlefs ? "LittleFS" : "SPIFFS", mount->label);
+    if (mount->littlefs) {
+        esp_vfs_littlefs_unregister(mount->label);
+    } else {
+        esp_vfs_spiffs_unregister(mount->label);
+    }
+    while (mount->hashes) {
+        fs_hash_entry_t *next = mount->hashes->next;
+        free(mount->hashes);
+        mount->hashes = next;
+    }
+    memset(mount, 0, sizeof(*mount));
+}
+
+// LittleFS keeps its superblock in block 0 or 1 with the "littlefs" magic 8 bytes in;
+// SPIFFS has no fixed signature, so a data partition without it is taken as SPIFFS
+static bool partition_is_littlefs(const esp_partition_t *partition)
+{
+    char magic[16];
+    for (size_t block = 0; block < 2; block++) {
+        size_t offset = block * LITTLEFS_BLOCK_SIZE;
+        if (offset + sizeof(magic) <= partition->size &&
+            esp_partition_read(partition, offset, magic, sizeof(magic)) == ESP_OK &&
+            memcmp(magic + 8, "littlefs", 8) == 0) {
+            return true;
+        }
+    }
+    return partition->subtype == PARTITION_SUBTYPE_DATA_LITTLEFS;
+}
+
+// Mount (or reuse) a SPIFFS or LittleFS partition and take a reference on it
+static esp_err_t fs_mount_acquire(const esp_partition_t *partition, fs_mount_t **out)
+{
+    esp_err_t ret = ESP_OK;
+    fs_mount_t *slot = NULL;
+    const char *label = partition->label;
+
+    if (!partition_lock_try(partition, false)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(fs_mount_lock, portMAX_DELAY);
+    for (int i = 0; i < FS_MOUNT_CACHE_SIZE; i++) {
+        if (fs_mounts[i].mounted && !fs_mounts[i].stale && strcmp(fs_mounts[i].label, label) == 0) {
+            slot = &fs_mounts[i];
+            goto found;
+        }
+    }
+
+    // Prefer an empty slot, otherwise evict the least recently used idle mount
+    for (int i = 0; i < FS_MOUNT_CACHE_SIZE; i++) {
+        fs_mount_t *candidate = &fs_mounts[i];
+        if (!candidate->mounted) {
+            slot = candidate;
+            break;
+        }
+        if (candidate->refcount == 0 && (!slot || candidate->last_used < slot->last_used)) {
+            slot = candidate;
+        }
+    }
+    if (!slot) {
+        ESP_LOGE(TAG, "No free SPIFFS mount slot for %s", label);
+        ret = ESP_ERR_NO_MEM;
+        goto out;
+    }
+    if (slot->mounted) {
+        fs_mount_unmount_locked(slot);
+    }
+
+    strlcpy(slot->label, label, sizeof(slot->label));
+    snprintf(slot->base_path, sizeof(slot->base_path), "/%s", label);
+    slot->partition = partition;
+    slot->littlefs = partition_is_littlefs(partition);
+    if (slot->littlefs) {
+        esp_vfs_littlefs_conf_t conf = {
+            .base_path = slot->base_path,
+            .partition_label = slot->label,
+            .format_if_mount_failed = false,
+        };
+        ret = esp_vfs_littlefs_register(&conf);
+    } else {
+        esp_vfs_spiffs_conf_t conf = {
+            .base_path = slot->base_path,
+            .partition_label = slot->label,
+            .max_files = 5,
+            .format_if_mount_failed = false,
+        };
+        ret = esp_vfs_spiffs_register(&conf);
+    }
+    // Every registration goes through this cache, so ESP_ERR_INVALID_STATE (already
+    // registered) means an entry was lost; fail rather than use a mount nobody tracks
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to mount %s partition %s: %s", slot->littlefs ? "LittleFS" : "SPIFFS", label, esp_err_to_name(ret));
+        memset(slot, 0, sizeof(*slot));
+        ret = ESP_FAIL;
+        goto out;
+    }
+    ESP_LOGI(TAG, "Mounted %s partition %s at %s", slot->littlefs ? "LittleFS" : "SPIFFS", label, slot->base_path);
+    slot->mounted = true;
+    slot->gc_pending = !slot->littlefs;     // SPIFFS pages deleted before this mount may still need erasing
+
+found:
+    slot->refcount++;
+    slot->last_used = xTaskGetTickCount();
+    *out = slot;
+out:
+    xSemaphoreGive(fs_mount_lock);
+    if (ret != ESP_OK) {
+        partition_unlock(partition, false);
+    }
+    return ret;
+}
+
+static void fs_mount_release(fs_mount_t *mount)
+{
+    partition_unlock(mount->partition, false);
+    xSemaphoreTake(fs_mount_lock, portMAX_DELAY);
+    mount->refcount--;
+    mount->last_used = xTaskGetTickCount();
+    if (mount->refcount == 0 && mount->stale) {
+        fs_mount_unmount_locked(mount);
+    }
+    xSemaphoreGive(fs_mount_lock);
+}
+
+static bool fs_gc_running_locked(const char *label)
+{
+    for (int i = 0; i < FS_MOUNT_CACHE_SIZE; i++) {
+        if (fs_mounts[i].gc_running && strcmp(fs_mounts[i].label, label) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Drop a cached mount because its raw partition is about to be rewritten or erased.
+// A GC pass already erasing blocks of the partition is waited for; marking the mount
+// stale keeps the GC task from starting another one.
+static void fs_mount_invalidate(const char *label)
+{
+    xSemaphoreTake(fs_mount_lock, portMAX_DELAY);
+    for (int i = 0; i < FS_MOUNT_CACHE_SIZE; i++) {
+        fs_mount_t *mount = &fs_mounts[i];
+        if (mount->mounted && strcmp(mount->label, label) == 0) {
+            if (mount->refcount == 0) {
+                fs_mount_unmount_locked(mount);
+            } else {
+                mount->stale = true;
+            }
+        }
+    }
+    while (fs_gc_running_locked(label)) {
+        xSemaphoreGive(fs_mount_lock);
+        vTaskDelay(pdMS_TO_TICKS(10));
+        xSemaphoreTake(fs_mount_lock, portMAX_DELAY);
+    }
+    xSemaphoreGive(fs_mount_lock);
+}
+
+static void fs_hash_remove_locked(fs_mount_t *mount, const char *name)
+{
+    for (fs_hash_entry_t **link = &mount->hashes; *link; link = &(*link)->next) {
+        if (strcmp((*link)->name, name) == 0) {
+            fs_hash_entry_t *entry = *link;
+            *link = entry->next;
+            free(entry);
+            break;
+        }
+    }
+}
+
+// Note a file that is being written or deleted: forget its cached hash and
+// let the background GC reclaim the SPIFFS pages it leaves behind. Writers call
+// this both before they start and after they close the file.
+static void fs_file_changed(fs_mount_t *mount, const char *name)
+{
+    xSemaphoreTake(fs_mount_lock, portMAX_DELAY);
+    fs_hash_remove_locked(mount, name);
+    mount->hash_gen++;
+    mount->gc_pending = !mount->littlefs;
+    mount->gc_retries = 0;
+    xSemaphoreGive(fs_mount_lock);
+}
+
+// Background SPIFFS GC - deleted and overwritten pages must be erased before
+// they can be reused, and SPIFFS otherwise does that inline in the middle of a
+// write once clean blocks run out. While no handler has touched SPIFFS for a
+// few seconds, this task erases them a few blocks at a time on mounts that
+// have seen writes or deletes.
+#define SPIFFS_GC_INTERVAL_MS   2000
+#define SPIFFS_GC_IDLE_MS       3000
+#define SPIFFS_GC_MAX_PASSES    64      // Give up on a mount until it changes again
+
+static void spiffs_gc_task(void *arg)
+{
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(SPIFFS_GC_INTERVAL_MS));
+        
+        fs_mount_t *mount = NULL;
+        TickType_t now = xTaskGetTickCount();
+        xSemaphoreTake(fs_mount_lock, portMAX_DELAY);
+        bool idle = true;
+        for (int i = 0; i < FS_MOUNT_CACHE_SIZE; i++) {
+            fs_mount_t *candidate = &fs_mounts[i];
+            if (!candidate->mounted) {
+                continue;
+            }
+            if (candidate->refcount > 0 || now - candidate->last_used < pdMS_TO_TICKS(SPIFFS_GC_IDLE_MS)) {
+                idle = false;
+                break;
+            }
+            if (!mount && candidate->gc_pending && !candidate->stale) {
+                mount = candidate;
+            }
+        }
+        if (!idle || !mount) {
+            xSemaphoreGive(fs_mount_lock);
+            continue;
+        }
+        // Hold a reference without touching last_used so the mount is not evicted mid-pass.
+        // Raw rewrites of the partition (upload, clear) wait in fs_mount_invalidate() until
+        // gc_running drops, rather than being refused while the pass runs.
+        mount->refcount++;
+        mount->gc_running = true;
+        xSemaphoreGive(fs_mount_lock);
+        
+        // Ask for half of the unused space to be clean; each call erases at most a few blocks
+        size_t total_bytes = 0, used_bytes = 0;
+        esp_err_t ret = esp_spiffs_info(mount->label, &total_bytes, &used_bytes);
+        if (ret == ESP_OK) {
+            size_t target = used_bytes < total_bytes ? (total_bytes - used_bytes) / 2 : 0;
+            ret = esp_spiffs_gc(mount->label, target);
+        }
+        
+        xSemaphoreTake(fs_mount_lock, portMAX_DELAY);
+        mount->gc_passes++;
+        mount->gc_retries++;
+        mount->gc_last_result = ret;
+        mount->gc_last_run = xTaskGetTickCount();
+        if (ret == ESP_OK || mount->gc_retries >= SPIFFS_GC_MAX_PASSES) {
+            mount->gc_pending = false;
+        }
+        ESP_LOGD(TAG, "SPIFFS GC pass %lu on %s: %s", (unsigned long)mount->gc_passes, mount->label, esp_err_to_name(ret));
+        mount->gc_running = false;
+        mount->refcount--;
+        if (mount->refcount == 0 && mount->stale) {
+            fs_mount_unmount_locked(mount);
+        }
+        xSemaphoreGive(fs_mount_lock);
+    }
+}
+
+// Find a SPIFFS or LittleFS partition by label, sending the error response on failure
+static const esp_partition_t *fs_find_partition(httpd_req_t *req, const char *partition_name)
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partition_name);
+    if (!partition) {
+        ESP_LOGE(TAG, "Filesystem partition not found: %s", partition_name);
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Partition not found");
+        return NULL;
+    }
+    if (partition->subtype != ESP_PARTITION_SUBTYPE_DATA_SPIFFS && !partition_is_littlefs(partition)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Not a SPIFFS or LittleFS partition");
+        return NULL;
+    }
+    return partition;
+}
+
+// Find a filesystem partition and mount it through the cache
+static fs_mount_t *fs_open_partition(httpd_req_t *req, const char *partition_name)
+{
+    const esp_partition_t *partition = fs_find_partition(req, partition_name);
+    if (!partition) {
+        return NULL;
+    }
+
+    fs_mount_t *mount = NULL;
+    esp_err_t ret = fs_mount_acquire(partition, &mount);
+    if (ret == ESP_ERR_INVALID_STATE) {
+        partition_busy_response(req, partition);
+        return NULL;
+    }
+    if (ret != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to mount partition");
+        return NULL;
+    }
+    return mount;
+}
+
+// Usage of a mounted partition from whichever filesystem it holds
+static esp_err_t fs_info(fs_mount_t *mount, size_t *total_bytes, size_t *used_bytes)
+{
+    if (mount->littlefs) {
+        return esp_littlefs_info(mount->label, total_bytes, used_bytes);
+    }
+    return esp_spiffs_info(mount->label, total_bytes, used_bytes);
+}
+
+// Create the missing parent directories of a file path on LittleFS (SPIFFS is flat
+// and simply stores the '/' in the name)
+static void fs_make_parents(fs_mount_t *mount, const char *filepath)
+{
+    if (!mount->littlefs) {
+        return;
+    }
+    char path[300];
+    strlcpy(path, filepath, sizeof(path));
+    for (char *slash = strchr(path + strlen(mount->base_path) + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(path, 0775);
+        *slash = '/';
+    }
+}
+
+// Recursive walk over the regular files of a mount, yielding paths relative to
+// its root. On SPIFFS this is a single flat directory.
+typedef struct {
+    const char *base_path;
+    DIR *dirs[FS_WALK_MAX_DEPTH];
+    size_t dir_len[FS_WALK_MAX_DEPTH];  // Length of path that names each open directory
+    int depth;
+    char path[256];
+} fs_walk_t;
+
+static bool fs_walk_open(fs_walk_t *walk, fs_mount_t *mount)
+{
+    walk->base_path = mount->base_path;
+    walk->depth = 0;
+    walk->dir_len[0] = 0;
+    walk->path[0] = '\0';
+    walk->dirs[0] = opendir(mount->base_path);
+    if (!walk->dirs[0]) {
+        walk->depth = -1;
+        return false;
+    }
+    return true;
+}
+
+static const char *fs_walk_next(fs_walk_t *walk)
+{
+    while (walk->depth >= 0) {
+        struct dirent *entry = readdir(walk->dirs[walk->depth]);
+        if (!entry) {
+            closedir(walk->dirs[walk->depth--]);
+            continue;
+        }
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        size_t len = walk->dir_len[walk->depth];
+        int n = snprintf(walk->path + len, sizeof(walk->path) - len, "%s%s", len ? "/" : "", entry->d_name);
+        if (n < 0 || len + n >= sizeof(walk->path)) {
+            continue;
+        }
+        if (entry->d_type == DT_DIR) {
+            char dirpath[300];
+            snprintf(dirpath, sizeof(dirpath), "%s/%s", walk->base_path, walk->path);
+            DIR *dir = walk->depth + 1 < FS_WALK_MAX_DEPTH ? opendir(dirpath) : NULL;
+            if (dir) {
+                walk->depth++;
+                walk->dirs[walk->depth] = dir;
+                walk->dir_len[walk->depth] = len + n;
+            }
+            continue;
+        }
+        if (entry->d_type == DT_REG) {
+            return walk->path;
+        }
+    }
+    return NULL;
+}
+
+static void fs_walk_close(fs_walk_t *walk)
+{
+    while (walk->depth >= 0) {
+        closedir(walk->dirs[walk->depth--]);
+    }
+}
+
+// Differential flash writer - each 4KB sector is compared with the flash contents and
+// only runs of changed sectors are erased and written, one erase+write per run.
+// Run buffers come from a small pool, allocated on first use like the transfer buffers,
+// so writers to different partitions can run side by side without each needing a large
+// block of heap. With every run buffer taken, diff_writer_init() returns
+// ESP_ERR_INVALID_STATE and the caller reports busy rather than out of memory.
+#define DIFF_SECTOR_SIZE 4096
+#define DIFF_RUN_BUF_SIZE (32 * 1024)       // 8 sectors, so one flush erases for well under a second
+#define DIFF_RUN_BUF_COUNT 2
+
+static char *diff_run_bufs[DIFF_RUN_BUF_COUNT];
+static bool diff_run_buf_in_use[DIFF_RUN_BUF_COUNT];
+
+typedef struct {
+    const esp_partition_t *partition;
+    size_t offset;              // Partition offset of the next sector
+    char *existing;             // Current flash contents of the sector being compared
+    char *run;                  // Changed sectors waiting to be written
+    size_t run_start;
+    size_t run_len;
+    int pages_compared;
+    int pages_written;
+} diff_writer_t;
+
+// Take a run buffer from the pool (guarded by the transfer pool's lock)
+static esp_err_t diff_run_buf_acquire(char **out)
+{
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    xSemaphoreTake(xfer_pool_lock, portMAX_DELAY);
+    for (int i = 0; i < DIFF_RUN_BUF_COUNT; i++) {
+        if (diff_run_buf_in_use[i]) {
+            continue;
+        }
+        if (!diff_run_bufs[i]) {
+            diff_run_bufs[i] = malloc(DIFF_RUN_BUF_SIZE);
+            if (!diff_run_bufs[i]) {
+                err = ESP_ERR_NO_MEM;
+                break;
+            }
+        }
+        diff_run_buf_in_use[i] = true;
+        *out = diff_run_bufs[i];
+        err = ESP_OK;
+        break;
+    }
+    xSemaphoreGive(xfer_pool_lock);
+    return err;
+}
+
+static void diff_run_buf_release(char *buf)
+{
+    xSemaphoreTake(xfer_pool_lock, portMAX_DELAY);
+    for (int i = 0; i < DIFF_RUN_BUF_COUNT; i++) {
+        if (diff_run_bufs[i] == buf) {
+            diff_run_buf_in_use[i] = false;
+        }
+    }
+    xSemaphoreGive(xfer_pool_lock);
+}
+
+static esp_err_t diff_writer_init(diff_writer_t *dw, const esp_partition_t *partition)
+{
+    memset(dw, 0, sizeof(*dw));
+    dw->partition = partition;
+    dw->existing = malloc(DIFF_SECTOR_SIZE);
+    if (!dw->existing) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = diff_run_buf_acquire(&dw->run);
+    if (err != ESP_OK) {
+        free(dw->existing);
+        dw->existing = NULL;
+        if (err == ESP_ERR_INVALID_STATE) {
+            ESP_LOGW(TAG, "All %d differential writers busy, refusing write to %s", DIFF_RUN_BUF_COUNT, partition->label);
+        }
+    }
+    return err;
+}
+
+// Answer a failed diff_writer_init(): 503 while every run buffer is in use, else 500
+static void diff_writer_init_error(httpd_req_t *req, esp_err_t err)
+{
+    if (err == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "5");
+        httpd_resp_sendstr(req, "Another flash write is in progress, retry shortly");
+    } else {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+    }
+}
+
+// Erase and write the pending run of changed sectors
+static esp_err_t diff_writer_flush(diff_writer_t *dw)
+{
+    if (dw->run_len == 0) {
+        return ESP_OK;
+    }
+    esp_err_t err = esp_partition_erase_range(dw->partition, dw->run_start, dw->run_len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to erase partition at 0x%x: %s", (unsigned)dw->run_start, esp_err_to_name(err));
+        return err;
+    }
+    err = esp_partition_write(dw->partition, dw->run_start, dw->run, dw->run_len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write partition: %s", esp_err_to_name(err));
+        return err;
+    }
+    dw->pages_written += dw->run_len / DIFF_SECTOR_SIZE;
+    dw->run_len = 0;
+    return ESP_OK;
+}
+
+// Feed the next full sector; unchanged sectors end the current run
+static esp_err_t diff_writer_sector(diff_writer_t *dw, const void *sector)
+{
+    if (dw->offset + DIFF_SECTOR_SIZE > dw->partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    esp_err_t read_err = esp_partition_read(dw->partition, dw->offset, dw->existing, DIFF_SECTOR_SIZE);
+    bool data_differs = (read_err != ESP_OK) || (memcmp(sector, dw->existing, DIFF_SECTOR_SIZE) != 0);
+    dw->pages_compared++;
+    
+    esp_err_t err = ESP_OK;
+    if (data_differs) {
+        if (dw->run_len == 0) {
+            dw->run_start = dw->offset;
+        }
+        memcpy(dw->run + dw->run_len, sector, DIFF_SECTOR_SIZE);
+        dw->run_len += DIFF_SECTOR_SIZE;
+        if (dw->run_len >= DIFF_RUN_BUF_SIZE) {
+            err = diff_writer_flush(dw);
+        }
+    } else {
+        err = diff_writer_flush(dw);
+    }
+    dw->offset += DIFF_SECTOR_SIZE;
+    return err;
+}
+
+static void diff_writer_free(diff_writer_t *dw)
+{
+    free(dw->existing);
+    if (dw->run) {
+        diff_run_buf_release(dw->run);
+    }
+    dw->existing = dw->run = NULL;
+}
+
+// NVS change generation - bumped by every NVS write made through this app. Together with
+// a random per-boot id it is the ETag of /nvs/list, so unchanged lists revalidate with 304.
+static uint32_t nvs_generation;
+static uint32_t nvs_boot_id;
+static portMUX_TYPE nvs_generation_lock = portMUX_INITIALIZER_UNLOCKED;   // Imports run on async workers
+
+static void nvs_changed(void)
+{
+    taskENTER_CRITICAL(&nvs_generation_lock);
+    nvs_generation++;
+    taskEXIT_CRITICAL(&nvs_generation_lock);
+}
+
+static void nvs_etag(char *out, size_t len)
+{
+    snprintf(out, len, "\"nvs-%08lx-%lu\"", (unsigned long)nvs_boot_id, (unsigned long)nvs_generation);
+}
+
+// Shared lock for key access to an NVS partition, so keys are never read or written while
+// an upload, clear or import rewrites it. Unknown partitions are left to the NVS API to report.
+static bool nvs_lock_shared(httpd_req_t *req, const char *partition_name, const esp_partition_t **partition)
+{
+    *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, partition_name);
+    return partition_lock_req(req, *partition, false);
+}
+
+// HTTP POST Handler - Handles firmware/binary upload to any partition
+static esp_err_t upload_post_handler(httpd_req_t *req)
+{
+    int total_len = req->content_len;
+    int received = 0;
+    int ret;
+    
+    // Get partition label from query parameter
+    char label[64] = {0};
+    http_query_t query;
+    if (query_parse(req, &query)) {
+        query_get_param(&query, "label", label, sizeof(label));
+    }
+
+    if (strlen(label) == 0) {
+        ESP_LOGE(TAG, "Partition label not provided");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition label required");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Upload started. Total content length: %d bytes. Target partition: %s", total_len, label);
+
+    if (total_len > MAX_OTA_DATA_SIZE) {
+        ESP_LOGE(TAG, "Binary too large (%d > %d)", total_len, MAX_OTA_DATA_SIZE);
+        httpd_resp_send_err(req, HTTPD_413_CONTENT_TOO_LARGE, "Binary too large");
+        return ESP_FAIL;
+    }
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (!partition) {
+        ESP_LOGE(TAG, "Failed to find partition with label: %s", label);
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Partition not found");
+        return ESP_FAIL;
+    }
+
+    if (!partition_lock_req(req, partition, true)) {
+        return ESP_FAIL;
+    }
+
+    // A cached SPIFFS/LittleFS mount would keep serving the old filesystem state
+    if (partition->type == ESP_PARTITION_TYPE_DATA) {
+        fs_mount_invalidate(partition->label);
+        if (partition->subtype == ESP_PARTITION_SUBTYPE_DATA_NVS) {
+            nvs_changed();
+        }
+    }
+
+    ESP_LOGI(TAG, "Writing to partition: %s (0x%lx, size: 0x%lx)", partition->label, partition->address, partition->size);
+
+    diff_writer_t dw;
+    char *page_buf = malloc(DIFF_SECTOR_SIZE);
+    esp_err_t init_err = page_buf ? diff_writer_init(&dw, partition) : ESP_ERR_NO_MEM;
+    if (init_err != ESP_OK) {
+        free(page_buf);
+        partition_unlock(partition, true);
+        diff_writer_init_error(req, init_err);
+        return ESP_FAIL;
+    }
+    
+    while (received < total_len) {
+        int to_recv = (total_len - received) > DIFF_SECTOR_SIZE ? DIFF_SECTOR_SIZE : (total_len - received);
+        
+        // Receive full 4KB or partial for last chunk
+        int recv_bytes = 0;
+        while (recv_bytes < to_recv) {
+            ret = httpd_req_recv(req, page_buf + recv_bytes, to_recv - recv_bytes);
+            if (ret <= 0) {
+                if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                    ESP_LOGE(TAG, "Upload socket timeout");
+                }
+                goto error_out;
+            }
+            recv_bytes += ret;
+        }
+        
+        // Pad partial final page with 0xFF
+        if (recv_bytes < DIFF_SECTOR_SIZE) {
+            memset(page_buf + recv_bytes, 0xFF, DIFF_SECTOR_SIZE - recv_bytes);
+        }
+        
+        esp_err_t err = diff_writer_sector(&dw, page_buf);
+        if (err == ESP_OK && received + to_recv >= total_len) {
+            err = diff_writer_flush(&dw);
+        }
+        if (err != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR,
+                                err == ESP_ERR_INVALID_SIZE ? "Binary larger than partition" : "Write failed");
+            goto error_out;
+        }
+        
+        received += to_recv;
+        
+        if (received % (64 * 1024) == 0) {
+            ESP_LOGI(TAG, "Upload progress: %d/%d bytes (%.1f%%) - %d/%d pages written", 
+                     received, total_len, (float)received / total_len * 100, dw.pages_written, dw.pages_compared);
+        }
+    }
+
+    free(page_buf);
+    diff_writer_free(&dw);
+    partition_unlock(partition, true);
+
+    if (received != total_len) {
+        ESP_LOGE(TAG, "Upload incomplete: received %d / %d bytes", received, total_len);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Upload incomplete");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Binary uploaded successfully to partition '%s'. Total: %d bytes (%d pages compared, %d pages written)", 
+             label, received, dw.pages_compared, dw.pages_written);
+    
+    char response[160];
+    snprintf(response, sizeof(response),
+             "{\"status\":\"success\", \"message\":\"Binary uploaded successfully\", \"pages_compared\":%d, \"pages_written\":%d}",
+             dw.pages_compared, dw.pages_written);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
+
+    return ESP_OK;
+
+error_out:
+    free(page_buf);
+    diff_writer_free(&dw);
+    partition_unlock(partition, true);
+    return ESP_FAIL;
+}
+
+// HTTP Partition Upload Handler - Upload binary data to any partition
+
+// HTTP Status Handler - Returns partition information
+static esp_err_t status_get_handler(httpd_req_t *req)
+{
+    char *response = malloc(2048);
+    if (!response) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    
+    // Get currently running partition
+    const esp_partition_t *running_partition = esp_ota_get_running_partition();
+    const char *running_label = running_partition ? running_partition->label : "";
+    
+    // Get currently selected boot partition
+    const esp_partition_t *boot_partition = esp_ota_get_boot_partition();
+    const char *boot_label = boot_partition ? boot_partition->label : "";
+    
+    char *response_ptr = response;
+    int response_size = 2048;
+    int remaining = response_size - 1;
+    
+    response_ptr += snprintf(response_ptr, remaining, "{\"running_partition\":\"%s\", \"boot_partition\":\"%s\", \"partitions\":[\n", running_label, boot_label);
+    remaining = response_size - 1 - (response_ptr - response);
+    
+    esp_partition_iterator_t it = esp_partition_find(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, NULL);
+    int partition_count = 0;
+    
+    while (it != NULL) {
+        const esp_partition_t *partition = esp_partition_get(it);
+        
+        // Include Factory, OTA, SPIFFS, LittleFS and NVS partitions
+        bool include = false;
+        if (partition->type == ESP_PARTITION_TYPE_APP && 
+            (partition->subtype == ESP_PARTITION_SUBTYPE_APP_FACTORY ||
+             (partition->subtype >= ESP_PARTITION_SUBTYPE_APP_OTA_MIN && partition->subtype <= ESP_PARTITION_SUBTYPE_APP_OTA_MAX))) {
+            include = true;
+        }
+        if (partition->type == ESP_PARTITION_TYPE_DATA && 
+            (partition->subtype == ESP_PARTITION_SUBTYPE_DATA_SPIFFS ||
+             partition->subtype == PARTITION_SUBTYPE_DATA_LITTLEFS ||
+             partition->subtype == ESP_PARTITION_SUBTYPE_DATA_NVS)) {
+            include = true;
+        }
+        
+        if (include) {
+            if (partition_count > 0) {
+                response_ptr += snprintf(response_ptr, remaining, ",\n");
+                remaining = response_size - 1 - (response_ptr - response);
+            }
+            
+            // Filesystem partitions report what they actually hold (LittleFS is often flashed into "spiffs" slots)
+            const char *fs = "";
+            if (partition->type == ESP_PARTITION_TYPE_DATA && partition->subtype != ESP_PARTITION_SUBTYPE_DATA_NVS) {
+                fs = partition_is_littlefs(partition) ? ", \"fs\":\"littlefs\"" : ", \"fs\":\"spiffs\"";
+            }
+            response_ptr += snprintf(response_ptr, remaining,
+                                    "  {\"label\":\"%s\", \"address\":\"0x%lx\", \"size\":%lu, \"type\":%d, \"subtype\":%d%s}",
+                                    partition->label,
+                                    partition->address,
+                                    partition->size,
+                                    partition->type,
+                                    partition->subtype,
+                                    fs);
+            remaining = response_size - 1 - (response_ptr - response);
+            partition_count++;
+        }
+        
+        it = esp_partition_next(it);
+    }
+    esp_partition_iterator_release(it);
+    
+    response_ptr += snprintf(response_ptr, remaining, "\n]}");
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response, strlen(response));
+    free(response);
+    return ESP_OK;
+}
+
+// HTTP Clear Partition Handler
+static esp_err_t clear_partition_handler(httpd_req_t *req)
+{
+    char label[64] = {0};
+    
+    json_doc_t doc;
+    if (!read_json(req, JSON_SMALL_MAX_BODY, &doc)) {
+        return ESP_FAIL;
+    }
+    json_get_string(doc.body, doc.toks, 0, "label", label, sizeof(label));
+    json_doc_free(&doc);
+    
+    if (strlen(label) == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition label required");
+        return ESP_FAIL;
+    }
+    
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (!partition) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Partition not found");
+        return ESP_FAIL;
+    }
+    if (!partition_lock_req(req, partition, true)) {
+        return ESP_FAIL;
+    }
+    
+    if (partition->type == ESP_PARTITION_TYPE_DATA) {
+        fs_mount_invalidate(partition->label);
+        if (partition->subtype == ESP_PARTITION_SUBTYPE_DATA_NVS) {
+            nvs_changed();
+        }
+    }
+
+    ESP_LOGI(TAG, "Clearing partition: %s", label);
+    esp_err_t err = esp_partition_erase_range(partition, 0, partition->size);
+    partition_unlock(partition, true);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to erase partition: %s", esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to erase partition");
+        return ESP_FAIL;
+    }
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, "{\"status\":\"success\", \"message\":\"Partition cleared\"}", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+// HTTP Download Partition Handler
+static esp_err_t download_partition_handler(httpd_req_t *req)
+{
+    char label[64] = {0};
+    http_query_t query;
+    if (query_parse(req, &query)) {
+        query_get_param(&query, "label", label, sizeof(label));
+    }
+    if (strlen(label) == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition label required");
+        return ESP_FAIL;
+    }
+    
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (!partition) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Partition not found");
+        return ESP_FAIL;
+    }
+    if (!partition_lock_req(req, partition, false)) {
+        return ESP_FAIL;
+    }
+    
+    ESP_LOGI(TAG, "Downloading partition: %s (size: %lu)", label, partition->size);
+    
+    char filename[128];
+    snprintf(filename, sizeof(filename), "attachment; filename=\"partition_%s.bin\"", label);
+    httpd_resp_set_hdr(req, "Content-Disposition", filename);
+    httpd_resp_set_type(req, "application/octet-stream");
+    
     char *buf = malloc(4096);
     if (!buf) {
+        partition_unlock(partition, false);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    
+    size_t sent = 0;
+    while (sent < partition->size) {
+        size_t to_read = (partition->size - sent) > 4096 ? 4096 : (partition->size - sent);
+        esp_err_t err = esp_partition_read(partition, sent, buf, to_read);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read partition: %s", esp_err_to_name(err));
+            free(buf);
+            partition_unlock(partition, false);
+            return ESP_FAIL;
+        }
+        
+        if (httpd_resp_send_chunk(req, buf, to_read) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to send chunk");
+            free(buf);
+            partition_unlock(partition, false);
+            return ESP_FAIL;
+        }
+        sent += to_read;
+    }
+    
+    httpd_resp_send_chunk(req, NULL, 0);
+    free(buf);
+    partition_unlock(partition, false);
+    
+    ESP_LOGI(TAG, "Partition download complete: %zu bytes", sent);
+    return ESP_OK;
+}
+
+// HTTP 404 Handler
+static esp_err_t http_404_handler(httpd_req_t *req, httpd_err_code_t err)
+{
+    httpd_resp_set_status(req, "404 Not Found");
+    httpd_resp_set_hdr(req, "Location", "/");
+    httpd_resp_send(req, "Redirect to recovery interface", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+// HTTP Reset Handler
+static esp_err_t reset_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Reset request received - rebooting device");
+    httpd_resp_send(req, "Device is rebooting...", HTTPD_RESP_USE_STRLEN);
+    
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    esp_restart();
+    
+    return ESP_OK;
+}
+
+// HTTP SPIFFS Info Handler - filesystem type, usage and background GC state of a partition
+static esp_err_t spiffs_info_handler(httpd_req_t *req)
+{
+    char partition_name[64] = {0};
+    http_query_t query;
+    
+    if (query_parse(req, &query)) {
+        query_get_param(&query, "partition", partition_name, sizeof(partition_name));
+    }
+    
+    if (strlen(partition_name) == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition name required");
+        return ESP_FAIL;
+    }
+    
+    fs_mount_t *mount = fs_open_partition(req, partition_name);
+    if (!mount) {
+        return ESP_FAIL;
+    }
+    
+    size_t total_bytes = 0, used_bytes = 0;
+    esp_err_t ret = fs_info(mount, &total_bytes, &used_bytes);
+    if (ret != ESP_OK) {
+        fs_mount_release(mount);
+        ESP_LOGE(TAG, "Failed to get SPIFFS info for %s: %s", partition_name, esp_err_to_name(ret));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to get filesystem info");
+        return ESP_FAIL;
+    }
+    
+    xSemaphoreTake(fs_mount_lock, portMAX_DELAY);
+    const char *fs_name = mount->littlefs ? "littlefs" : "spiffs";
+    bool gc_pending = mount->gc_pending;
+    uint32_t gc_passes = mount->gc_passes;
+    esp_err_t gc_last_result = mount->gc_last_result;
+    long gc_last_run_ms = gc_passes > 0 ? (long)pdTICKS_TO_MS(xTaskGetTickCount() - mount->gc_last_run) : -1;
+    xSemaphoreGive(fs_mount_lock);
+    fs_mount_release(mount);
+    
+    char response[320];
+    snprintf(response, sizeof(response),
+             "{\"partition\":\"%s\",\"fs\":\"%s\",\"total\":%u,\"used\":%u,\"free\":%u,"
+             "\"gc\":{\"pending\":%s,\"passes\":%lu,\"last_result\":\"%s\",\"last_error\":%d,\"last_run_ms_ago\":%ld}}",
+             partition_name, fs_name, (unsigned)total_bytes, (unsigned)used_bytes,
+             (unsigned)(used_bytes < total_bytes ? total_bytes - used_bytes : 0),
+             gc_pending ? "true" : "false", (unsigned long)gc_passes,
+             gc_passes == 0 ? "none" : gc_last_result == ESP_OK ? "ok" : "error",
+             gc_passes > 0 ? (int)gc_last_result : 0, gc_last_run_ms);
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, response);
+    return ESP_OK;
+}
+
+// HTTP SPIFFS List Files Handler - streams ?offset=&limit=&prefix= pages of the file list,
+// or of one ?dir= directory on LittleFS
+static esp_err_t spiffs_list_handler(httpd_req_t *req)
+{
+    char partition_name[64] = {0};
+    char prefix[128] = {0};
+    char dir_name[128] = {0};
+    char number[16];
+    long offset = 0;
+    long limit = -1;        // -1 = no limit
+    http_query_t query;
+    
+    if (query_parse(req, &query)) {
+        query_get_param(&query, "partition", partition_name, sizeof(partition_name));
+        query_get_param(&query, "prefix", prefix, sizeof(prefix));
+        query_get_param(&query, "dir", dir_name, sizeof(dir_name));
+        if (query_get_param(&query, "offset", number, sizeof(number))) {
+            offset = strtol(number, NULL, 10);
+        }
+        if (query_get_param(&query, "limit", number, sizeof(number))) {
+            limit = strtol(number, NULL, 10);
+        }
+    }
+    
+    if (strlen(partition_name) == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition name required");
+        return ESP_FAIL;
+    }
+    if (offset < 0) {
+        offset = 0;
+    }
+    
+    fs_mount_t *mount = fs_open_partition(req, partition_name);
+    if (!mount) {
+        return ESP_FAIL;
+    }
+    char mount_path[160];
+    snprintf(mount_path, sizeof(mount_path), "%s%s%s", mount->base_path, dir_name[0] ? "/" : "", dir_name);
+    size_t prefix_len = strlen(prefix);
+    
+    chunk_writer_t *w = malloc(sizeof(chunk_writer_t));
+    if (!w) {
+        fs_mount_release(mount);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    chunk_writer_init(w, req);
+    httpd_resp_set_type(req, "application/json");
+    chunk_writer_printf(w, "{\"files\":[");
+    
+    // Matching entries are counted for "total", but only the requested page is stat()ed
+    long matched = 0;
+    long emitted = 0;
+    DIR *dir = opendir(mount_path);
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL && w->err == ESP_OK) {
+            bool is_dir = entry->d_type == DT_DIR;
+            if ((entry->d_type != DT_REG && !is_dir) ||
+                strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            if (prefix_len > 0 && strncmp(entry->d_name, prefix, prefix_len) != 0) {
+                continue;
+            }
+            long index = matched++;
+            if (index < offset || (limit >= 0 && emitted >= limit)) {
+                continue;
+            }
+            
+            struct stat file_stat = {0};
+            char filepath[512];
+            snprintf(filepath, sizeof(filepath), "%s/%s", mount_path, entry->d_name);
+            if (!is_dir && stat(filepath, &file_stat) != 0) {
+                continue;
+            }
+            
+            if (emitted > 0) {
+                chunk_writer_write(w, ",", 1);
+            }
+            chunk_writer_write(w, "{\"name\":", 8);
+            chunk_writer_json_string(w, entry->d_name);
+            chunk_writer_printf(w, ",\"type\":\"%s\",\"size\":%ld}", is_dir ? "dir" : "file", (long)file_stat.st_size);
+            emitted++;
+        }
+        closedir(dir);
+    }
+    
+    chunk_writer_printf(w, "],\"fs\":\"%s\",\"offset\":%ld,\"count\":%ld,\"total\":%ld}",
+                        mount->littlefs ? "littlefs" : "spiffs", offset, emitted, matched);
+    esp_err_t err = chunk_writer_finish(w);
+    free(w);
+    
+    // Release the partition (stays mounted in the cache)
+    fs_mount_release(mount);
+    
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to send SPIFFS file list: %s", esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// SPIFFS stores (page size - 5 byte header) of data per page plus index pages;
+// estimate the space a file of len bytes needs so uploads can be refused up front
+#define SPIFFS_PAGE_DATA_SIZE (CONFIG_SPIFFS_PAGE_SIZE - 5)
+
+static size_t spiffs_estimate_usage(size_t len)
+{
+    size_t data_pages = (len + SPIFFS_PAGE_DATA_SIZE - 1) / SPIFFS_PAGE_DATA_SIZE;
+    size_t index_pages = 1 + data_pages / (CONFIG_SPIFFS_PAGE_SIZE / 2);
+    return (data_pages + index_pages) * CONFIG_SPIFFS_PAGE_SIZE;
+}
+
+// LittleFS allocates whole blocks; allow one extra for the metadata pair update
+static size_t fs_estimate_usage(fs_mount_t *mount, size_t len)
+{
+    if (mount->littlefs) {
+        return ((len + LITTLEFS_BLOCK_SIZE - 1) / LITTLEFS_BLOCK_SIZE + 1) * LITTLEFS_BLOCK_SIZE;
+    }
+    return spiffs_estimate_usage(len);
+}
+
+// stdio buffer for SPIFFS files: a whole number of logical pages
+#define SPIFFS_FILE_BUF_SIZE (CONFIG_SPIFFS_PAGE_SIZE * 16)
+
+// HTTP SPIFFS Upload Handler
+static esp_err_t spiffs_upload_handler(httpd_req_t *req)
+{
+    char filename[128] = {0};
+    char partition_name[64] = {0};
+    http_query_t query;
+    
+    // Get filename and partition from query parameters
+    if (query_parse(req, &query)) {
+        query_get_param(&query, "name", filename, sizeof(filename));
+        query_get_param(&query, "partition", partition_name, sizeof(partition_name));
+    }
+    
+    if (strlen(filename) == 0 || strlen(partition_name) == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Filename and partition required");
+        return ESP_FAIL;
+    }
+    
+    fs_mount_t *mount = fs_open_partition(req, partition_name);
+    if (!mount) {
+        return ESP_FAIL;
+    }
+    const char *mount_path = mount->base_path;
+    
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "%s/%s", mount_path, filename);
+    
+    int total_len = req->content_len;
+    
+    // Refuse the body before receiving it if it cannot fit (an overwritten file's space is reclaimed)
+    size_t total_bytes = 0, used_bytes = 0;
+    if (fs_info(mount, &total_bytes, &used_bytes) == ESP_OK) {
+        size_t free_bytes = total_bytes > used_bytes ? total_bytes - used_bytes : 0;
+        struct stat existing;
+        if (stat(filepath, &existing) == 0) {
+            free_bytes += fs_estimate_usage(mount, existing.st_size);
+        }
+        if (fs_estimate_usage(mount, total_len) > free_bytes) {
+            ESP_LOGE(TAG, "Not enough SPIFFS space for %s: %d bytes, %u free", filepath, total_len, (unsigned)free_bytes);
+            fs_mount_release(mount);
+            httpd_resp_send_err(req, HTTPD_413_CONTENT_TOO_LARGE, "Not enough space on partition");
+            return ESP_FAIL;
+        }
+    }
+    
+    char *buf = xfer_buf_acquire();
+    if (!buf) {
+        fs_mount_release(mount);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    
+    fs_file_changed(mount, filename);
+    fs_make_parents(mount, filepath);
+    FILE *file = fopen(filepath, "wb");
+    if (!file) {
+        ESP_LOGE(TAG, "Failed to open file for writing: %s", filepath);
+        xfer_buf_release(buf);
+        fs_mount_release(mount);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to create file");
+        return ESP_FAIL;
+    }
+    setvbuf(file, NULL, _IOFBF, SPIFFS_FILE_BUF_SIZE);
+    
+    int received = 0;
+    
+    ESP_LOGI(TAG, "Uploading file to SPIFFS: %s (size: %d bytes)", filepath, total_len);
+    
+    // Fill the whole transfer buffer before each write so SPIFFS sees page-multiple writes
+    while (received < total_len) {
+        int to_recv = (total_len - received) > XFER_BUF_SIZE ? XFER_BUF_SIZE : (total_len - received);
+        int ret_recv = recv_full(req, buf, to_recv);
+        if (ret_recv <= 0) {
+            break;
+        }
+        
+        if (fwrite(buf, 1, ret_recv, file) != ret_recv) {
+            ESP_LOGE(TAG, "Failed to write file");
+            fclose(file);
+            unlink(filepath);
+            fs_file_changed(mount, filename);
+            xfer_buf_release(buf);
+            fs_mount_release(mount);
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Write failed");
+            return ESP_FAIL;
+        }
+        
+        received += ret_recv;
+    }
+    
+    xfer_buf_release(buf);
+    bool close_ok = (fclose(file) == 0);
+    
+    if (received != total_len || !close_ok) {
+        ESP_LOGE(TAG, "Upload incomplete: received %d / %d bytes", received, total_len);
+        unlink(filepath);
+        fs_file_changed(mount, filename);
+        fs_mount_release(mount);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Upload incomplete");
+        return ESP_FAIL;
+    }
+    
+    fs_file_changed(mount, filename);
+    ESP_LOGI(TAG, "File uploaded successfully: %s", filepath);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, "{\"status\":\"success\", \"message\":\"File uploaded\"}", HTTPD_RESP_USE_STRLEN);
+    
+    // Release the partition (stays mounted in the cache)
+    fs_mount_release(mount);
+    
+    return ESP_OK;
+}
+
+// Streaming tar (ustar/GNU/pax) extractor - members are written to the mounted
+// filesystem as their bytes arrive, so archives never need to fit in RAM
+#define TAR_BLOCK_SIZE 512
+
+typedef enum {
+    TAR_STATE_HEADER,
+    TAR_STATE_META,         // GNU long name ('L') or pax extended header ('x') payload
+    TAR_STATE_FILE_DATA,
+    TAR_STATE_SKIP,         // Payload of members we do not extract
+    TAR_STATE_PADDING,
+    TAR_STATE_END,
+} tar_state_t;
+
+typedef struct {
+    tar_state_t state;
+    fs_mount_t *mount;
+    char block[TAR_BLOCK_SIZE];
+    size_t block_fill;
+    char meta_type;
+    char pending_name[256];     // Name from a preceding 'L' or pax 'path=' record
+    uint64_t remaining;         // Bytes left in the current member's payload
+    size_t padding;             // Bytes left to the next 512-byte boundary
+    FILE *file;
+    char filepath[300];
+    int files_written;
+    uint64_t bytes_written;
+    int members_skipped;
+    const char *error;
+    bool bad_archive;           // The error is in the archive itself (400), not the device (500)
+} tar_extract_t;
+
+static esp_err_t tar_reject(tar_extract_t *tar, const char *error)
+{
+    tar->error = error;
+    tar->bad_archive = true;
+    return ESP_FAIL;
+}
+
+static uint64_t tar_parse_octal(const char *field, size_t len)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < len && field[i]; i++) {
+        if (field[i] >= '0' && field[i] <= '7') {
+            value = (value << 3) | (field[i] - '0');
+        } else if (field[i] != ' ') {
+            break;
+        }
+    }
+    return value;
+}
+
+static bool tar_header_checksum_ok(const char *block)
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++) {
+        sum += (i >= 148 && i < 156) ? ' ' : (uint8_t)block[i];
+    }
+    return sum == tar_parse_octal(block + 148, 8);
+}
+
+// Pick the stored name for a member: strip "./", leading and trailing '/'
+static void tar_member_name(tar_extract_t *tar, const char *block, char *out, size_t out_len)
+{
+    char name[256];
+    if (tar->pending_name[0]) {
+        strlcpy(name, tar->pending_name, sizeof(name));
+        tar->pending_name[0] = '\0';
+    } else if (memcmp(block + 257, "ustar", 5) == 0 && block[345]) {
+        snprintf(name, sizeof(name), "%.155s/%.100s", block + 345, block);
+    } else {
+        snprintf(name, sizeof(name), "%.100s", block);
+    }
+
+    const char *p = name;
+    while (strncmp(p, "./", 2) == 0 || *p == '/') {
+        p += (*p == '/') ? 1 : 2;
+    }
+    strlcpy(out, p, out_len);
+    size_t len = strlen(out);
+    while (len > 0 && out[len - 1] == '/') {
+        out[--len] = '\0';
+    }
+}
+
+// Extract "path=" from pax extended header records ("<len> <key>=<value>\n").
+// data is not NUL terminated, so every field is bounded by the record length.
+static bool tar_apply_pax(tar_extract_t *tar, const char *data, size_t len)
+{
+    size_t pos = 0;
+    while (pos < len) {
+        size_t rec_len = 0;
+        size_t digits = 0;
+        while (pos + digits < len && data[pos + digits] >= '0' && data[pos + digits] <= '9' && digits < 4) {
+            rec_len = rec_len * 10 + (data[pos + digits] - '0');
+            digits++;
+        }
+        // Shortest record: "<len> k=\n"
+        if (digits == 0 || rec_len < digits + 4 || rec_len > len - pos ||
+            data[pos + digits] != ' ' || data[pos + rec_len - 1] != '\n') {
+            return false;
+        }
+        const char *kv = data + pos + digits + 1;
+        size_t kv_len = rec_len - digits - 2;          // Without the space and the '\n'
+        if (kv_len >= 5 && memcmp(kv, "path=", 5) == 0) {
+            size_t value_len = kv_len - 5;
+            if (value_len >= sizeof(tar->pending_name)) {
+                return false;
+            }
+            memcpy(tar->pending_name, kv + 5, value_len);
+            tar->pending_name[value_len] = '\0';
+        }
+        pos += rec_len;
+    }
+    return true;
+}
+
+// Drop any hash cached while the member was being written
+static void tar_file_changed(tar_extract_t *tar)
+{
+    fs_file_changed(tar->mount, tar->filepath + strlen(tar->mount->base_path) + 1);
+}
+
+static void tar_finish_member(tar_extract_t *tar)
+{
+    tar->state = tar->padding ? TAR_STATE_PADDING : TAR_STATE_HEADER;
+}
+
+static esp_err_t tar_process_header(tar_extract_t *tar)
+{
+    const char *block = tar->block;
+    bool all_zero = true;
+    for (int i = 0; i < TAR_BLOCK_SIZE && all_zero; i++) {
+        all_zero = (block[i] == 0);
+    }
+    if (all_zero) {
+        tar->state = TAR_STATE_END;
+        return ESP_OK;
+    }
+    if (!tar_header_checksum_ok(block)) {
+        return tar_reject(tar, "Invalid tar header checksum");
+    }
+
+    char type = block[156];
+    tar->remaining = tar_parse_octal(block + 124, 12);
+    tar->padding = (TAR_BLOCK_SIZE - (tar->remaining % TAR_BLOCK_SIZE)) % TAR_BLOCK_SIZE;
+
+    if (type == 'L' || type == 'x') {
+        // Only one block of metadata is buffered; refuse more rather than drop records
+        if (tar->remaining > TAR_BLOCK_SIZE) {
+            return tar_reject(tar, type == 'L' ? "Long name too long" : "Pax header larger than 512 bytes");
+        }
+        tar->meta_type = type;
+        tar->block_fill = 0;
+        tar->state = TAR_STATE_META;
+        return ESP_OK;
+    }
+
+    char name[256];
+    tar_member_name(tar, block, name, sizeof(name));
+    if (type == '5' && tar->mount->littlefs && name[0] != '\0') {
+        // Directory members are recreated on LittleFS so empty directories survive
+        snprintf(tar->filepath, sizeof(tar->filepath), "%s/%s/", tar->mount->base_path, name);
+        fs_make_parents(tar->mount, tar->filepath);
+        tar->state = tar->remaining ? TAR_STATE_SKIP : TAR_STATE_HEADER;
+        return ESP_OK;
+    }
+    if ((type != '0' && type != '\0' && type != '7') || name[0] == '\0') {
+        tar->members_skipped++;
+        tar->state = tar->remaining ? TAR_STATE_SKIP : TAR_STATE_HEADER;
+        return ESP_OK;
+    }
+
+    snprintf(tar->filepath, sizeof(tar->filepath), "%s/%s", tar->mount->base_path, name);
+    fs_file_changed(tar->mount, name);
+    fs_make_parents(tar->mount, tar->filepath);
+    tar->file = fopen(tar->filepath, "wb");
+    if (!tar->file) {
+        ESP_LOGE(TAG, "Failed to create %s from archive", tar->filepath);
+        tar->error = "Failed to create file (name too long or filesystem full?)";
+        return ESP_FAIL;
+    }
+    setvbuf(tar->file, NULL, _IOFBF, SPIFFS_FILE_BUF_SIZE);
+    ESP_LOGI(TAG, "Extracting %s (%llu bytes)", tar->filepath, (unsigned long long)tar->remaining);
+
+    tar->state = TAR_STATE_FILE_DATA;
+    if (tar->remaining == 0) {
+        fclose(tar->file);
+        tar->file = NULL;
+        tar_file_changed(tar);
+        tar->files_written++;
+        tar_finish_member(tar);
+    }
+    return ESP_OK;
+}
+
+// Feed the next piece of the archive stream
+static esp_err_t tar_extract_feed(tar_extract_t *tar, const char *data, size_t len)
+{
+    while (len > 0) {
+        size_t n;
+        switch (tar->state) {
+        case TAR_STATE_HEADER:
+            n = TAR_BLOCK_SIZE - tar->block_fill;
+            n = n < len ? n : len;
+            memcpy(tar->block + tar->block_fill, data, n);
+            tar->block_fill += n;
+            if (tar->block_fill == TAR_BLOCK_SIZE) {
+                tar->block_fill = 0;
+                if (tar_process_header(tar) != ESP_OK) {
+                    return ESP_FAIL;
+                }
+            }
+            break;
+
+        case TAR_STATE_META:
+            // The header limited the payload to one block
+            n = tar->remaining < len ? tar->remaining : len;
+            memcpy(tar->block + tar->block_fill, data, n);
+            tar->block_fill += n;
+            tar->remaining -= n;
+            if (tar->remaining == 0) {
+                if (tar->meta_type == 'L') {
+                    size_t name_len = strnlen(tar->block, tar->block_fill);
+                    if (name_len >= sizeof(tar->pending_name)) {
+                        return tar_reject(tar, "Long name too long");
+                    }
+                    memcpy(tar->pending_name, tar->block, name_len);
+                    tar->pending_name[name_len] = '\0';
+                } else if (!tar_apply_pax(tar, tar->block, tar->block_fill)) {
+                    return tar_reject(tar, "Malformed pax header");
+                }
+                tar->block_fill = 0;
+                tar_finish_member(tar);
+            }
+            break;
+
+        case TAR_STATE_FILE_DATA:
+            n = tar->remaining < len ? tar->remaining : len;
+            if (fwrite(data, 1, n, tar->file) != n) {
+                tar->error = "Write failed";
+                return ESP_FAIL;
+            }
+            tar->remaining -= n;
+            tar->bytes_written += n;
+            if (tar->remaining == 0) {
+                bool close_ok = (fclose(tar->file) == 0);
+                tar->file = NULL;
+                if (!close_ok) {
+                    unlink(tar->filepath);
+                    tar_file_changed(tar);
+                    tar->error = "Write failed";
+                    return ESP_FAIL;
+                }
+                tar_file_changed(tar);
+                tar->files_written++;
+                tar_finish_member(tar);
+            }
+            break;
+
+        case TAR_STATE_SKIP:
+            n = tar->remaining < len ? tar->remaining : len;
+            tar->remaining -= n;
+            if (tar->remaining == 0) {
+                tar_finish_member(tar);
+            }
+            break;
+
+        case TAR_STATE_PADDING:
+            n = tar->padding < len ? tar->padding : len;
+            tar->padding -= n;
+            if (tar->padding == 0) {
+                tar->state = TAR_STATE_HEADER;
+            }
+            break;
+
+        case TAR_STATE_END:
+        default:
+            // Trailing zero blocks and any record padding are ignored
+            n = len;
+            break;
+        }
+        data += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+// Abort extraction, removing a partially written member
+static void tar_extract_abort(tar_extract_t *tar)
+{
+    if (tar->file) {
+        fclose(tar->file);
+        tar->file = NULL;
+        unlink(tar->filepath);
+        tar_file_changed(tar);
+    }
+}
+
+// HTTP SPIFFS Archive Upload Handler - extracts a tar stream with one mount and one response
+static esp_err_t spiffs_upload_archive_handler(httpd_req_t *req)
+{
+    char partition_name[64] = {0};
+    http_query_t query;
+    
+    if (query_parse(req, &query)) {
+        query_get_param(&query, "partition", partition_name, sizeof(partition_name));
+    }
+    
+    if (strlen(partition_name) == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition name required");
+        return ESP_FAIL;
+    }
+    
+    fs_mount_t *mount = fs_open_partition(req, partition_name);
+    if (!mount) {
+        return ESP_FAIL;
+    }
+    
+    // The payload of a tar is never larger than the archive itself
+    size_t total_bytes = 0, used_bytes = 0;
+    if (fs_info(mount, &total_bytes, &used_bytes) == ESP_OK && used_bytes < total_bytes &&
+        req->content_len > total_bytes - used_bytes) {
+        ESP_LOGW(TAG, "Archive (%u bytes) may not fit in %u free bytes, extracting anyway",
+                 (unsigned)req->content_len, (unsigned)(total_bytes - used_bytes));
+    }
+    
+    char *buf = xfer_buf_acquire();
+    tar_extract_t *tar = calloc(1, sizeof(tar_extract_t));
+    if (!buf || !tar) {
+        if (buf) xfer_buf_release(buf);
+        free(tar);
+        fs_mount_release(mount);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    tar->mount = mount;
+    
+    ESP_LOGI(TAG, "Extracting archive to SPIFFS partition %s (%u bytes)", mount->label, (unsigned)req->content_len);
+    
+    size_t received = 0;
+    esp_err_t err = ESP_OK;
+    while (received < req->content_len) {
+        size_t to_recv = req->content_len - received;
+        int ret = httpd_req_recv(req, buf, to_recv > XFER_BUF_SIZE ? XFER_BUF_SIZE : to_recv);
+        if (ret <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                ESP_LOGE(TAG, "Upload socket timeout");
+            }
+            tar->error = "Upload incomplete";
+            err = ESP_FAIL;
+            break;
+        }
+        received += ret;
+        err = tar_extract_feed(tar, buf, ret);
+        if (err != ESP_OK) {
+            break;
+        }
+    }
+    if (err == ESP_OK && tar->state != TAR_STATE_END && tar->state != TAR_STATE_HEADER) {
+        err = tar_reject(tar, "Archive truncated");
+    }
+    
+    xfer_buf_release(buf);
+    tar_extract_abort(tar);
+    
+    char response[192];
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Archive extraction failed after %d files: %s", tar->files_written, tar->error);
+        snprintf(response, sizeof(response), "{\"status\":\"error\", \"message\":\"%s\", \"files\":%d}",
+                 tar->error, tar->files_written);
+        httpd_resp_set_status(req, tar->bad_archive ? "400 Bad Request" : "500 Internal Server Error");
+    } else {
+        ESP_LOGI(TAG, "Archive extracted: %d files, %llu bytes, %d members skipped",
+                 tar->files_written, (unsigned long long)tar->bytes_written, tar->members_skipped);
+        snprintf(response, sizeof(response), "{\"status\":\"success\", \"message\":\"Archive extracted\", \"files\":%d, \"bytes\":%llu, \"skipped\":%d}",
+                 tar->files_written, (unsigned long long)tar->bytes_written, tar->members_skipped);
+    }
+    free(tar);
+    fs_mount_release(mount);
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
+    return err;
+}
+
+// Streaming tar writer for /spiffs/export. Output goes through one fixed buffer,
+// so memory use does not depend on the size or number of files. There is no gzip
+// option: a deflate compressor needs about 300KB, more than the heap has without PSRAM.
+#define TAR_EXPORT_OUT_SIZE 8192
+
+typedef struct {
+    httpd_req_t *req;
+    esp_err_t err;
+    size_t out_len;
+    uint8_t out[TAR_EXPORT_OUT_SIZE];
+} tar_export_t;
+
+static void tar_export_flush(tar_export_t *ex)
+{
+    if (ex->err == ESP_OK && ex->out_len > 0) {
+        ex->err = httpd_resp_send_chunk(ex->req, (const char *)ex->out, ex->out_len);
+    }
+    ex->out_len = 0;
+}
+
+// Append bytes of the tar stream
+static void tar_export_write(tar_export_t *ex, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    while (len > 0 && ex->err == ESP_OK) {
+        size_t n = sizeof(ex->out) - ex->out_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(ex->out + ex->out_len, p, n);
+        ex->out_len += n;
+        p += n;
+        len -= n;
+        if (ex->out_len == sizeof(ex->out)) {
+            tar_export_flush(ex);
+        }
+    }
+}
+
+static void tar_export_pad(tar_export_t *ex, uint64_t len)
+{
+    static const char zeros[TAR_BLOCK_SIZE];
+    size_t padding = (TAR_BLOCK_SIZE - (len % TAR_BLOCK_SIZE)) % TAR_BLOCK_SIZE;
+    tar_export_write(ex, zeros, padding);
+}
+
+// ustar header; names longer than 100 bytes get a GNU long name record first
+static void tar_export_header(tar_export_t *ex, const char *name, char type, uint64_t size, uint32_t mtime)
+{
+    char block[TAR_BLOCK_SIZE];
+    size_t name_len = strlen(name);
+    if (name_len > 100 && type != 'L') {
+        tar_export_header(ex, "././@LongLink", 'L', name_len + 1, 0);
+        tar_export_write(ex, name, name_len + 1);
+        tar_export_pad(ex, name_len + 1);
+    }
+
+    memset(block, 0, sizeof(block));
+    memcpy(block, name, name_len > 100 ? 100 : name_len);
+    snprintf(block + 100, 8, "%07o", 0644);
+    snprintf(block + 108, 8, "%07o", 0);
+    snprintf(block + 116, 8, "%07o", 0);
+    snprintf(block + 124, 12, "%011llo", (unsigned long long)size);
+    snprintf(block + 136, 12, "%011lo", (unsigned long)mtime);
+    block[156] = type;
+    memcpy(block + 257, "ustar", 6);
+    memcpy(block + 263, "00", 2);
+
+    uint32_t sum = 0;
+    memset(block + 148, ' ', 8);
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++) {
+        sum += (uint8_t)block[i];
+    }
+    snprintf(block + 148, 8, "%06lo", (unsigned long)(sum & 0777777));    // At most 512 * 255, fits six digits
+    block[155] = ' ';
+    tar_export_write(ex, block, sizeof(block));
+}
+
+// Terminate the archive (two zero blocks), then the response
+static esp_err_t tar_export_finish(tar_export_t *ex)
+{
+    static const char zeros[TAR_BLOCK_SIZE * 2];
+    tar_export_write(ex, zeros, sizeof(zeros));
+    tar_export_flush(ex);
+    if (ex->err == ESP_OK) {
+        ex->err = httpd_resp_send_chunk(ex->req, NULL, 0);
+    }
+    return ex->err;
+}
+
+// HTTP SPIFFS Export Handler - the whole filesystem as one tar
+static esp_err_t spiffs_export_handler(httpd_req_t *req)
+{
+    char partition_name[64] = {0};
+    char gzip_param[8] = {0};
+    http_query_t query;
+    
+    if (query_parse(req, &query)) {
+        query_get_param(&query, "partition", partition_name, sizeof(partition_name));
+        query_get_param(&query, "gzip", gzip_param, sizeof(gzip_param));
+    }
+    
+    if (strlen(partition_name) == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition name required");
+        return ESP_FAIL;
+    }
+    // Refused rather than ignored, so a script asking for .tar.gz never saves a plain tar under that name
+    if (gzip_param[0] != '\0' && strcmp(gzip_param, "0") != 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "gzip export is not supported; compress the tar on the host");
+        return ESP_FAIL;
+    }
+    
+    fs_mount_t *mount = fs_open_partition(req, partition_name);
+    if (!mount) {
+        return ESP_FAIL;
+    }
+    
+    tar_export_t *ex = calloc(1, sizeof(tar_export_t));
+    char *buf = xfer_buf_acquire();
+    if (!ex || !buf) {
+        free(ex);
+        if (buf) xfer_buf_release(buf);
+        fs_mount_release(mount);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    ex->req = req;
+    
+    char disposition[128];
+    snprintf(disposition, sizeof(disposition), "attachment; filename=\"%s.tar\"", partition_name);
+    httpd_resp_set_hdr(req, "Content-Disposition", disposition);
+    httpd_resp_set_type(req, "application/x-tar");
+    
+    int files = 0;
+    fs_walk_t walk;
+    if (fs_walk_open(&walk, mount)) {
+        const char *name;
+        while ((name = fs_walk_next(&walk)) != NULL && ex->err == ESP_OK) {
+            char filepath[300];
+            struct stat file_stat;
+            snprintf(filepath, sizeof(filepath), "%s/%s", mount->base_path, name);
+            FILE *file = fopen(filepath, "rb");
+            if (!file) {
+                continue;
+            }
+            if (fstat(fileno(file), &file_stat) != 0) {
+                fclose(file);
+                continue;
+            }
+            
+            // The header promises st_size bytes; a file that shrinks meanwhile is zero-filled
+            uint64_t size = file_stat.st_size;
+            uint64_t sent = 0;
+            tar_export_header(ex, name, '0', size, (uint32_t)file_stat.st_mtime);
+            while (sent < size && ex->err == ESP_OK) {
+                size_t to_read = (size - sent) > XFER_BUF_SIZE ? XFER_BUF_SIZE : (size_t)(size - sent);
+                size_t n = fread(buf, 1, to_read, file);
+                if (n < to_read) {
+                    memset(buf + n, 0, to_read - n);
+                }
+                tar_export_write(ex, buf, to_read);
+                sent += to_read;
+            }
+            tar_export_pad(ex, size);
+            fclose(file);
+            files++;
+        }
+        fs_walk_close(&walk);
+    }
+    
+    esp_err_t err = tar_export_finish(ex);
+    free(ex);
+    xfer_buf_release(buf);
+    fs_mount_release(mount);
+    
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Export of %s aborted: %s", partition_name, esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Exported %d files from %s", files, partition_name);
+    return ESP_OK;
+}
+
+static void hex_encode(const uint8_t *data, size_t len, char *out)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+        out[i * 2] = digits[data[i] >> 4];
+        out[i * 2 + 1] = digits[data[i] & 0x0F];
+    }
+    out[len * 2] = '\0';
+}
+
+// SHA-256 of a file, served from the mount's hash cache while the size still matches.
+// File uploads share the partition lock with manifests, so a file may be written while
+// it is hashed; the result is then returned but not cached.
+static esp_err_t fs_file_sha256(fs_mount_t *mount, const char *name, long size, uint8_t out[32])
+{
+    xSemaphoreTake(fs_mount_lock, portMAX_DELAY);
+    for (fs_hash_entry_t *entry = mount->hashes; entry; entry = entry->next) {
+        if (entry->size == size && strcmp(entry->name, name) == 0) {
+            memcpy(out, entry->sha256, 32);
+            xSemaphoreGive(fs_mount_lock);
+            return ESP_OK;
+        }
+    }
+    uint32_t gen = mount->hash_gen;
+    xSemaphoreGive(fs_mount_lock);
+
+    char filepath[300];
+    snprintf(filepath, sizeof(filepath), "%s/%s", mount->base_path, name);
+    FILE *file = fopen(filepath, "rb");
+    if (!file) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    size_t buf_len = XFER_BUF_SIZE;
+    char *buf = xfer_buf_acquire();
+    bool pooled = (buf != NULL);
+    if (!buf) {
+        buf_len = 4096;
+        buf = malloc(buf_len);
+    }
+    if (!buf) {
+        fclose(file);
+        return ESP_ERR_NO_MEM;
+    }
+
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    size_t n;
+    while ((n = fread(buf, 1, buf_len, file)) > 0) {
+        mbedtls_sha256_update(&ctx, (const unsigned char *)buf, n);
+    }
+    bool read_ok = !ferror(file);
+    fclose(file);
+    mbedtls_sha256_finish(&ctx, out);
+    mbedtls_sha256_free(&ctx);
+    if (pooled) {
+        xfer_buf_release(buf);
+    } else {
+        free(buf);
+    }
+    if (!read_ok) {
+        return ESP_FAIL;
+    }
+
+    fs_hash_entry_t *entry = malloc(sizeof(fs_hash_entry_t) + strlen(name) + 1);
+    if (entry) {
+        entry->size = size;
+        memcpy(entry->sha256, out, 32);
+        strcpy(entry->name, name);
+        xSemaphoreTake(fs_mount_lock, portMAX_DELAY);
+        if (mount->hash_gen == gen) {
+            fs_hash_remove_locked(mount, name);
+            entry->next = mount->hashes;
+            mount->hashes = entry;
+            entry = NULL;
+        }
+        xSemaphoreGive(fs_mount_lock);
+        free(entry);
+    }
+    return ESP_OK;
+}
+
+// HTTP SPIFFS Manifest Handler - name, size and SHA-256 of every file
+static esp_err_t spiffs_manifest_handler(httpd_req_t *req)
+{
+    char partition_name[64] = {0};
+    http_query_t query;
+    
+    if (query_parse(req, &query)) {
+        query_get_param(&query, "partition", partition_name, sizeof(partition_name));
+    }
+    
+    if (strlen(partition_name) == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition name required");
+        return ESP_FAIL;
+    }
+    
+    fs_mount_t *mount = fs_open_partition(req, partition_name);
+    if (!mount) {
+        return ESP_FAIL;
+    }
+    
+    chunk_writer_t *w = malloc(sizeof(chunk_writer_t));
+    if (!w) {
+        fs_mount_release(mount);
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
         return ESP_FAIL;
     }
+    chunk_writer_init(w, req);
+    httpd_resp_set_type(req, "application/json");
+    chunk_writer_printf(w, "{\"files\":[");
+    
+    int count = 0;
+    fs_walk_t walk;
+    if (fs_walk_open(&walk, mount)) {
+        const char *name;
+        while ((name = fs_walk_next(&walk)) != NULL && w->err == ESP_OK) {
+            char filepath[300];
+            struct stat file_stat;
+            uint8_t sha256[32];
+            char sha256_hex[65];
+            snprintf(filepath, sizeof(filepath), "%s/%s", mount->base_path, name);
+            if (stat(filepath, &file_stat) != 0 ||
+                fs_file_sha256(mount, name, file_stat.st_size, sha256) != ESP_OK) {
+                continue;
+            }
+            hex_encode(sha256, sizeof(sha256), sha256_hex);
+            
+            if (count++ > 0) {
+                chunk_writer_write(w, ",", 1);
+            }
+            chunk_writer_write(w, "{\"name\":", 8);
+            chunk_writer_json_string(w, name);
+            chunk_writer_printf(w, ",\"size\":%ld,\"sha256\":\"%s\"}", (long)file_stat.st_size, sha256_hex);
+        }
+        fs_walk_close(&walk);
+    }
     
-    size_t sent = 0;
-    while (sent < partition->size) {
-        size_t to_read = (partition->size - sent) > 4096 ? 4096 : (partition->size - sent);
-        esp_err_t err = esp_partition_read(partition, sent, buf, to_read);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to read partition: %s", esp_err_to_name(err));
-            free(buf);
-            return ESP_FAIL;
+    chunk_writer_printf(w, "]}");
+    esp_err_t err = chunk_writer_finish(w);
+    free(w);
+    fs_mount_release(mount);
+    
+    ESP_LOGI(TAG, "Manifest for %s: %d files", partition_name, count);
+    return err == ESP_OK ? ESP_OK : ESP_FAIL;
+}
+
+#define SPIFFS_SYNC_MAX_BODY (64 * 1024)
+
+// HTTP SPIFFS Sync Handler - compares a desired manifest with the partition and
+// reports which files must be uploaded and which should be deleted
+static esp_err_t spiffs_sync_handler(httpd_req_t *req)
+{
+    char partition_name[64] = {0};
+    http_query_t query;
+    
+    json_doc_t doc;
+    if (!read_json(req, SPIFFS_SYNC_MAX_BODY, &doc)) {
+        return ESP_FAIL;
+    }
+    
+    if (query_parse(req, &query)) {
+        query_get_param(&query, "partition", partition_name, sizeof(partition_name));
+    }
+    if (strlen(partition_name) == 0) {
+        json_get_string(doc.body, doc.toks, 0, "partition", partition_name, sizeof(partition_name));
+    }
+    if (strlen(partition_name) == 0) {
+        json_doc_free(&doc);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition name required");
+        return ESP_FAIL;
+    }
+    
+    fs_mount_t *mount = fs_open_partition(req, partition_name);
+    if (!mount) {
+        json_doc_free(&doc);
+        return ESP_FAIL;
+    }
+    
+    chunk_writer_t *w = malloc(sizeof(chunk_writer_t));
+    if (!w) {
+        fs_mount_release(mount);
+        json_doc_free(&doc);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    chunk_writer_init(w, req);
+    httpd_resp_set_type(req, "application/json");
+    
+    // Files to upload: missing locally, different size, or different hash
+    chunk_writer_printf(w, "{\"upload\":[");
+    int uploads = 0, unchanged = 0;
+    int files = json_doc_array(&doc, "files");
+    int file_count = files >= 0 ? doc.toks[files].size : 0;
+    for (int i = 0, obj = files + 1; i < file_count && w->err == ESP_OK; i++, obj = doc.toks[obj].next) {
+        char name[128];
+        char want_hex[65];
+        if (!json_get_string(doc.body, doc.toks, obj, "name", name, sizeof(name)) || name[0] == '\0') {
+            continue;
+        }
+        json_get_string(doc.body, doc.toks, obj, "sha256", want_hex, sizeof(want_hex));
+        long long want_size;
+        if (!json_get_int(doc.body, doc.toks, obj, "size", &want_size)) {
+            want_size = -1;
         }
         
-        if (httpd_resp_send_chunk(req, buf, to_read) != ESP_OK) {
+        char filepath[300];
+        struct stat file_stat;
+        uint8_t sha256[32];
+        char have_hex[65];
+        snprintf(filepath, sizeof(filepath), "%s/%s", mount->base_path, name);
+        bool same = stat(filepath, &file_stat) == 0 &&
+                    (want_size < 0 || file_stat.st_size == want_size) &&
+                    fs_file_sha256(mount, name, file_stat.st_size, sha256) == ESP_OK;
+        if (same) {
+            hex_encode(sha256, sizeof(sha256), have_hex);
+            same = strcasecmp(have_hex, want_hex) == 0;
+        }
+        if (same) {
+            unchanged++;
+            continue;
+        }
+        if (uploads++ > 0) {
+            chunk_writer_write(w, ",", 1);
+        }
+        chunk_writer_json_string(w, name);
+    }
+    
+    // Files to delete: present locally but absent from the desired manifest
+    chunk_writer_printf(w, "],\"delete\":[");
+    int deletes = 0;
+    fs_walk_t walk;
+    if (fs_walk_open(&walk, mount)) {
+        const char *local_name;
+        while ((local_name = fs_walk_next(&walk)) != NULL && w->err == ESP_OK) {
+            bool wanted = false;
+            for (int i = 0, obj = files + 1; !wanted && i < file_count; i++, obj = doc.toks[obj].next) {
+                char name[128];
+                wanted = json_get_string(doc.body, doc.toks, obj, "name", name, sizeof(name)) && strcmp(name, local_name) == 0;
+            }
+            if (wanted) {
+                continue;
+            }
+            if (deletes++ > 0) {
+                chunk_writer_write(w, ",", 1);
+            }
+            chunk_writer_json_string(w, local_name);
+        }
+        fs_walk_close(&walk);
+    }
+    
+    chunk_writer_printf(w, "],\"unchanged\":%d}", unchanged);
+    esp_err_t err = chunk_writer_finish(w);
+    free(w);
+    fs_mount_release(mount);
+    json_doc_free(&doc);
+    
+    ESP_LOGI(TAG, "Sync plan for %s: %d to upload, %d to delete, %d unchanged", partition_name, uploads, deletes, unchanged);
+    return err == ESP_OK ? ESP_OK : ESP_FAIL;
+}
+
+// HTTP SPIFFS Download Handler
+static esp_err_t spiffs_download_handler(httpd_req_t *req)
+{
+    char filename[128] = {0};
+    char partition_name[64] = {0};
+    http_query_t query;
+    
+    if (query_parse(req, &query)) {
+        query_get_param(&query, "name", filename, sizeof(filename));
+        query_get_param(&query, "partition", partition_name, sizeof(partition_name));
+    }
+    
+    if (strlen(filename) == 0 || strlen(partition_name) == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Filename and partition required");
+        return ESP_FAIL;
+    }
+    
+    fs_mount_t *mount = fs_open_partition(req, partition_name);
+    if (!mount) {
+        return ESP_FAIL;
+    }
+    const char *mount_path = mount->base_path;
+    
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "%s/%s", mount_path, filename);
+    
+    FILE *file = fopen(filepath, "rb");
+    if (!file) {
+        ESP_LOGE(TAG, "Failed to open file: %s", filepath);
+        fs_mount_release(mount);
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+        return ESP_FAIL;
+    }
+    
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    
+    ESP_LOGI(TAG, "Downloading file from SPIFFS: %s (size: %ld)", filepath, file_size);
+    
+    char disposition[256];
+    snprintf(disposition, sizeof(disposition), "attachment; filename=\"%s\"", filename);
+    httpd_resp_set_hdr(req, "Content-Disposition", disposition);
+    httpd_resp_set_type(req, "application/octet-stream");
+    
+    char *buf = malloc(4096);
+    if (!buf) {
+        fclose(file);
+        fs_mount_release(mount);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    
+    size_t read_bytes;
+    while ((read_bytes = fread(buf, 1, 4096, file)) > 0) {
+        if (httpd_resp_send_chunk(req, buf, read_bytes) != ESP_OK) {
             ESP_LOGE(TAG, "Failed to send chunk");
-            free(buf);
-            return ESP_FAIL;
+            break;
         }
-        sent += to_read;
     }
     
     httpd_resp_send_chunk(req, NULL, 0);
+    fclose(file);
     free(buf);
     
-    ESP_LOGI(TAG, "Partition download complete: %zu bytes", sent);
+    // Release the partition (stays mounted in the cache)
+    fs_mount_release(mount);
+    
+    ESP_LOGI(TAG, "File download complete: %s", filename);
+    return ESP_OK;
+}
+
+// HTTP SPIFFS Delete Handler
+static esp_err_t spiffs_delete_handler(httpd_req_t *req)
+{
+    char filename[128] = {0};
+    char partition_name[64] = {0};
+    
+    json_doc_t doc;
+    if (!read_json(req, JSON_SMALL_MAX_BODY, &doc)) {
+        return ESP_FAIL;
+    }
+    json_get_string(doc.body, doc.toks, 0, "name", filename, sizeof(filename));
+    json_get_string(doc.body, doc.toks, 0, "partition", partition_name, sizeof(partition_name));
+    json_doc_free(&doc);
+    
+    if (strlen(filename) == 0 || strlen(partition_name) == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Filename and partition required");
+        return ESP_FAIL;
+    }
+    
+    fs_mount_t *mount = fs_open_partition(req, partition_name);
+    if (!mount) {
+        return ESP_FAIL;
+    }
+    const char *mount_path = mount->base_path;
+    
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "%s/%s", mount_path, filename);
+    
+    // LittleFS directories are removed with rmdir and only when empty
+    struct stat file_stat;
+    if (mount->littlefs && stat(filepath, &file_stat) == 0 && S_ISDIR(file_stat.st_mode)) {
+        ESP_LOGI(TAG, "Deleting directory: %s", filepath);
+        if (rmdir(filepath) != 0) {
+            ESP_LOGE(TAG, "Failed to delete directory: %s", filepath);
+            fs_mount_release(mount);
+            httpd_resp_set_status(req, "409 Conflict");
+            httpd_resp_set_type(req, "application/json");
+            httpd_resp_send(req, "{\"status\":\"error\", \"message\":\"Directory not empty\"}", HTTPD_RESP_USE_STRLEN);
+            return ESP_FAIL;
+        }
+        fs_mount_release(mount);
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req, "{\"status\":\"success\", \"message\":\"Directory deleted\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+    
+    ESP_LOGI(TAG, "Deleting file: %s", filepath);
+    
+    fs_file_changed(mount, filename);
+    if (unlink(filepath) != 0) {
+        ESP_LOGE(TAG, "Failed to delete file: %s", filepath);
+        fs_mount_release(mount);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to delete file");
+        return ESP_FAIL;
+    }
+    
+    // Release the partition (stays mounted in the cache)
+    fs_mount_release(mount);
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, "{\"status\":\"success\", \"message\":\"File deleted\"}", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+#define SPIFFS_BULK_MAX_BODY (32 * 1024)
+
+// HTTP SPIFFS Bulk Delete Handler - removes a list of files or every file matching a pattern
+static esp_err_t spiffs_delete_bulk_handler(httpd_req_t *req)
+{
+    char partition_name[64] = {0};
+    char pattern[128] = {0};
+    
+    json_doc_t doc;
+    if (!read_json(req, SPIFFS_BULK_MAX_BODY, &doc)) {
+        return ESP_FAIL;
+    }
+    
+    json_get_string(doc.body, doc.toks, 0, "partition", partition_name, sizeof(partition_name));
+    bool has_pattern = json_get_string(doc.body, doc.toks, 0, "pattern", pattern, sizeof(pattern)) && pattern[0] != '\0';
+    int names = json_doc_array(&doc, "names");
+    if (strlen(partition_name) == 0 || (!has_pattern && names < 0)) {
+        json_doc_free(&doc);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition and names or pattern required");
+        return ESP_FAIL;
+    }
+    
+    fs_mount_t *mount = fs_open_partition(req, partition_name);
+    if (!mount) {
+        json_doc_free(&doc);
+        return ESP_FAIL;
+    }
+    
+    // One mount for the whole batch; each file is just an unlink
+    int deleted = 0;
+    int failed = 0;
+    char filepath[300];
+    if (has_pattern) {
+        fs_walk_t walk;
+        if (fs_walk_open(&walk, mount)) {
+            const char *name;
+            while ((name = fs_walk_next(&walk)) != NULL) {
+                if (!glob_match(pattern, name)) {
+                    continue;
+                }
+                snprintf(filepath, sizeof(filepath), "%s/%s", mount->base_path, name);
+                fs_file_changed(mount, name);
+                if (unlink(filepath) == 0) {
+                    deleted++;
+                } else {
+                    failed++;
+                }
+            }
+            fs_walk_close(&walk);
+        }
+    } else {
+        char name[128];
+        for (int i = 0, tok = names + 1; i < doc.toks[names].size; i++, tok = doc.toks[tok].next) {
+            if (!json_tok_copy(doc.body, &doc.toks[tok], name, sizeof(name)) || name[0] == '\0') {
+                continue;
+            }
+            snprintf(filepath, sizeof(filepath), "%s/%s", mount->base_path, name);
+            fs_file_changed(mount, name);
+            if (unlink(filepath) == 0) {
+                deleted++;
+            } else {
+                failed++;
+            }
+        }
+    }
+    
+    fs_mount_release(mount);
+    json_doc_free(&doc);
+    
+    ESP_LOGI(TAG, "Bulk delete on %s: %d deleted, %d failed", partition_name, deleted, failed);
+    
+    char response[128];
+    snprintf(response, sizeof(response), "{\"status\":\"success\", \"deleted\":%d, \"failed\":%d}", deleted, failed);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, response);
+    return ESP_OK;
+}
+
+// HTTP SPIFFS Format Handler - empties a SPIFFS or LittleFS partition in one operation
+static esp_err_t spiffs_format_handler(httpd_req_t *req)
+{
+    char partition_name[64] = {0};
+    
+    json_doc_t doc;
+    if (!read_json(req, JSON_SMALL_MAX_BODY, &doc)) {
+        return ESP_FAIL;
+    }
+    json_get_string(doc.body, doc.toks, 0, "partition", partition_name, sizeof(partition_name));
+    json_doc_free(&doc);
+    
+    if (strlen(partition_name) == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition name required");
+        return ESP_FAIL;
+    }
+    
+    const esp_partition_t *partition = fs_find_partition(req, partition_name);
+    if (!partition || !partition_lock_req(req, partition, true)) {
+        return ESP_FAIL;
+    }
+    bool littlefs = partition_is_littlefs(partition);
+    
+    // The cached mount is dropped first (after any running GC pass). The exclusive lock
+    // keeps requests from mounting the partition again while it is formatted, so the
+    // mount cache itself stays free for other partitions.
+    fs_mount_invalidate(partition->label);
+    
+    ESP_LOGI(TAG, "Formatting %s partition %s", littlefs ? "LittleFS" : "SPIFFS", partition->label);
+    esp_err_t ret = littlefs ? esp_littlefs_format(partition->label) : esp_spiffs_format(partition->label);
+    partition_unlock(partition, true);
+    
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to format %s: %s", partition->label, esp_err_to_name(ret));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Format failed");
+        return ESP_FAIL;
+    }
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, "{\"status\":\"success\", \"message\":\"Partition formatted\"}", HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
-// HTTP 404 Handler
-static esp_err_t http_404_handler(httpd_req_t *req, httpd_err_code_t err)
+// NVS namespace and key names are at most 15 characters
+typedef char nvs_name_t[16];
+
+// Collect the distinct namespace names of a partition, in storage order
+static nvs_name_t *nvs_collect_namespaces(const char *partition_name, int *count)
+{
+    int capacity = 8;
+    nvs_name_t *names = malloc(capacity * sizeof(nvs_name_t));
+    *count = 0;
+    if (!names) {
+        return NULL;
+    }
+
+    nvs_iterator_t it = NULL;
+    esp_err_t res = nvs_entry_find(partition_name, NULL, NVS_TYPE_ANY, &it);
+    while (res == ESP_OK) {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+        bool known = false;
+        for (int i = 0; i < *count && !known; i++) {
+            known = strcmp(names[i], info.namespace_name) == 0;
+        }
+        if (!known) {
+            if (*count == capacity) {
+                nvs_name_t *grown = realloc(names, capacity * 2 * sizeof(nvs_name_t));
+                if (!grown) {
+                    break;
+                }
+                names = grown;
+                capacity *= 2;
+            }
+            strlcpy(names[(*count)++], info.namespace_name, sizeof(nvs_name_t));
+        }
+        res = nvs_entry_next(&it);
+    }
+    nvs_release_iterator(it);
+    return names;
+}
+
+// API type codes shared by the list/get responses, /nvs/set and the UI:
+// 0: U8, 1: I8, 2: U16, 3: I16, 4: U32, 5: I32, 6: U64, 7: I64, 8: STR, 9: BLOB
+static const nvs_type_t nvs_type_codes[] = {
+    NVS_TYPE_U8, NVS_TYPE_I8, NVS_TYPE_U16, NVS_TYPE_I16, NVS_TYPE_U32,
+    NVS_TYPE_I32, NVS_TYPE_U64, NVS_TYPE_I64, NVS_TYPE_STR, NVS_TYPE_BLOB,
+};
+
+static int nvs_type_code(nvs_type_t type)
+{
+    for (int i = 0; i < sizeof(nvs_type_codes) / sizeof(nvs_type_codes[0]); i++) {
+        if (nvs_type_codes[i] == type) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Format an integer entry as decimal text; false for other types or read errors
+static bool nvs_format_int(nvs_handle_t handle, const char *key, nvs_type_t type, char *out, size_t out_len)
+{
+    switch (type) {
+        case NVS_TYPE_I8: {
+            int8_t val;
+            if (nvs_get_i8(handle, key, &val) != ESP_OK) {
+                return false;
+            }
+            snprintf(out, out_len, "%d", val);
+            return true;
+        }
+        case NVS_TYPE_U8: {
+            uint8_t val;
+            if (nvs_get_u8(handle, key, &val) != ESP_OK) {
+                return false;
+            }
+            snprintf(out, out_len, "%u", val);
+            return true;
+        }
+        case NVS_TYPE_I16: {
+            int16_t val;
+            if (nvs_get_i16(handle, key, &val) != ESP_OK) {
+                return false;
+            }
+            snprintf(out, out_len, "%d", val);
+            return true;
+        }
+        case NVS_TYPE_U16: {
+            uint16_t val;
+            if (nvs_get_u16(handle, key, &val) != ESP_OK) {
+                return false;
+            }
+            snprintf(out, out_len, "%u", val);
+            return true;
+        }
+        case NVS_TYPE_I32: {
+            int32_t val;
+            if (nvs_get_i32(handle, key, &val) != ESP_OK) {
+                return false;
+            }
+            snprintf(out, out_len, "%ld", (long)val);
+            return true;
+        }
+        case NVS_TYPE_U32: {
+            uint32_t val;
+            if (nvs_get_u32(handle, key, &val) != ESP_OK) {
+                return false;
+            }
+            snprintf(out, out_len, "%lu", (unsigned long)val);
+            return true;
+        }
+        case NVS_TYPE_I64: {
+            int64_t val;
+            if (nvs_get_i64(handle, key, &val) != ESP_OK) {
+                return false;
+            }
+            snprintf(out, out_len, "%lld", (long long)val);
+            return true;
+        }
+        case NVS_TYPE_U64: {
+            uint64_t val;
+            if (nvs_get_u64(handle, key, &val) != ESP_OK) {
+                return false;
+            }
+            snprintf(out, out_len, "%llu", (unsigned long long)val);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// Read a string entry into a heap buffer sized by a length query (strings can be up to 4000 bytes)
+static char *nvs_get_str_alloc(nvs_handle_t handle, const char *key)
 {
-    httpd_resp_set_status(req, "404 Not Found");
-    httpd_resp_set_hdr(req, "Location", "/");
-    httpd_resp_send(req, "Redirect to recovery interface", HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+    size_t len = 0;
+    if (nvs_get_str(handle, key, NULL, &len) != ESP_OK) {
+        return NULL;
+    }
+    char *str = malloc(len);
+    if (str && nvs_get_str(handle, key, str, &len) != ESP_OK) {
+        free(str);
+        return NULL;
+    }
+    return str;
 }
 
-// HTTP Reset Handler
-static esp_err_t reset_handler(httpd_req_t *req)
+// Write an entry's value as a JSON string (numbers included, which is what the UI edits)
+static void nvs_write_value_json(chunk_writer_t *w, nvs_handle_t handle, const char *key, nvs_type_t type)
 {
-    ESP_LOGI(TAG, "Reset request received - rebooting device");
-    httpd_resp_send(req, "Device is rebooting...", HTTPD_RESP_USE_STRLEN);
-    
-    vTaskDelay(pdMS_TO_TICKS(1000));
-    esp_restart();
-    
-    return ESP_OK;
+    char value[24] = "";
+    if (nvs_format_int(handle, key, type, value, sizeof(value))) {
+        chunk_writer_json_string(w, value);
+        return;
+    }
+    switch (type) {
+        case NVS_TYPE_STR: {
+            char *str = nvs_get_str_alloc(handle, key);
+            if (str) {
+                chunk_writer_json_string(w, str);
+                free(str);
+                return;
+            }
+            break;
+        }
+        case NVS_TYPE_BLOB:
+            snprintf(value, sizeof(value), "[BLOB data]");
+            break;
+        default:
+            break;
+    }
+    chunk_writer_json_string(w, value);
 }
 
-// HTTP SPIFFS List Files Handler
-static esp_err_t spiffs_list_handler(httpd_req_t *req)
+// HTTP NVS List Handler - streams keys grouped by namespace with ?namespace=&prefix=&offset=&limit=
+static esp_err_t nvs_list_handler(httpd_req_t *req)
 {
     char partition_name[64] = {0};
-    char mount_path[128] = {0};
-    char query_buf[256] = {0};
-    
-    // Get partition name from query parameter
-    if (httpd_req_get_url_query_str(req, query_buf, sizeof(query_buf)) == ESP_OK) {
-        char *partition_ptr = strstr(query_buf, "partition=");
-        if (partition_ptr) {
-            partition_ptr += strlen("partition=");
-            int i = 0;
-            while (partition_ptr[i] != '\0' && partition_ptr[i] != '&' && i < 63) {
-                partition_name[i] = partition_ptr[i];
-                i++;
-            }
-            partition_name[i] = '\0';
+    char namespace_filter[16] = {0};
+    char prefix[16] = {0};
+    char number[16];
+    long offset = 0;
+    long limit = -1;        // -1 = no limit
+    http_query_t query;
+    
+    if (query_parse(req, &query)) {
+        query_get_param(&query, "partition", partition_name, sizeof(partition_name));
+        query_get_param(&query, "namespace", namespace_filter, sizeof(namespace_filter));
+        query_get_param(&query, "prefix", prefix, sizeof(prefix));
+        if (query_get_param(&query, "offset", number, sizeof(number))) {
+            offset = strtol(number, NULL, 10);
+        }
+        if (query_get_param(&query, "limit", number, sizeof(number))) {
+            limit = strtol(number, NULL, 10);
         }
     }
     
     if (strlen(partition_name) == 0) {
+        ESP_LOGE(TAG, "No partition name provided");
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition name required");
         return ESP_FAIL;
     }
-    
-    snprintf(mount_path, sizeof(mount_path), "/%s", partition_name);
-    
-    // Find and mount the partition
-    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, partition_name);
-    if (!partition) {
-        ESP_LOGE(TAG, "SPIFFS partition not found: %s", partition_name);
-        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Partition not found");
-        return ESP_FAIL;
+    if (offset < 0) {
+        offset = 0;
     }
     
-    // Mount the partition
-    esp_vfs_spiffs_conf_t conf = {
-        .base_path = mount_path,
-        .partition_label = partition_name,
-        .max_files = 5,
-        .format_if_mount_failed = false,
-    };
+    // Nothing was written since the client's copy: skip opening and serialising every key
+    char etag[40];
+    char if_none_match[64] = {0};
+    nvs_etag(etag, sizeof(etag));
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strstr(if_none_match, etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
+    }
     
-    esp_err_t ret = esp_vfs_spiffs_register(&conf);
-    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
-        ESP_LOGE(TAG, "Failed to mount SPIFFS partition %s: %s", partition_name, esp_err_to_name(ret));
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to mount partition");
+    const esp_partition_t *partition;
+    if (!nvs_lock_shared(req, partition_name, &partition)) {
         return ESP_FAIL;
     }
     
-    char *response = malloc(4096);
-    if (!response) {
-        esp_vfs_spiffs_unregister(partition_name);
+    int ns_count = 0;
+    nvs_name_t *namespaces;
+    if (namespace_filter[0]) {
+        namespaces = malloc(sizeof(nvs_name_t));
+        if (namespaces) {
+            strlcpy(namespaces[0], namespace_filter, sizeof(nvs_name_t));
+            ns_count = 1;
+        }
+    } else {
+        namespaces = nvs_collect_namespaces(partition_name, &ns_count);
+    }
+    chunk_writer_t *w = malloc(sizeof(chunk_writer_t));
+    if (!namespaces || !w) {
+        free(namespaces);
+        free(w);
+        partition_unlock(partition, false);
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
         return ESP_FAIL;
     }
-    
-    int response_size = 4096;
-    int written = snprintf(response, response_size, "{\"files\":[");
-    
-    DIR *dir = opendir(mount_path);
-    if (!dir) {
-        // Directory doesn't exist or is empty
-        snprintf(response, response_size, "{\"files\":[]}");
-    } else {
-        struct dirent *entry;
-        bool first = true;
-        
-        while ((entry = readdir(dir)) != NULL) {
-            if (entry->d_type == DT_REG) {  // Regular file
-                struct stat file_stat;
-                char filepath[512];
-                snprintf(filepath, sizeof(filepath), "%s/%s", mount_path, entry->d_name);
-                
-                if (stat(filepath, &file_stat) == 0) {
-                    if (!first) {
-                        snprintf(response + written, response_size - written, ",");
-                        written++;
+    chunk_writer_init(w, req);
+    httpd_resp_set_type(req, "application/json");
+    chunk_writer_printf(w, "{\"keys\":[");
+    
+    // One read-only handle per namespace; values are only read for the requested page
+    size_t prefix_len = strlen(prefix);
+    long matched = 0;
+    long emitted = 0;
+    for (int n = 0; n < ns_count && w->err == ESP_OK; n++) {
+        nvs_handle_t handle;
+        if (nvs_open_from_partition(partition_name, namespaces[n], NVS_READONLY, &handle) != ESP_OK) {
+            continue;
+        }
+        nvs_iterator_t it = NULL;
+        esp_err_t res = nvs_entry_find_in_handle(handle, NVS_TYPE_ANY, &it);
+        while (res == ESP_OK && w->err == ESP_OK) {
+            nvs_entry_info_t info;
+            nvs_entry_info(it, &info);
+            if (prefix_len == 0 || strncmp(info.key, prefix, prefix_len) == 0) {
+                long index = matched++;
+                if (index >= offset && (limit < 0 || emitted < limit)) {
+                    if (emitted++ > 0) {
+                        chunk_writer_write(w, ",", 1);
                     }
-                    
-                    written += snprintf(response + written, response_size - written,
-                                       "{\"name\":\"%s\",\"size\":%ld}",
-                                       entry->d_name, file_stat.st_size);
-                    first = false;
+                    chunk_writer_write(w, "{\"namespace\":", 13);
+                    chunk_writer_json_string(w, info.namespace_name);
+                    chunk_writer_write(w, ",\"key\":", 7);
+                    chunk_writer_json_string(w, info.key);
+                    chunk_writer_printf(w, ",\"type\":%d,\"value\":", nvs_type_code(info.type));
+                    nvs_write_value_json(w, handle, info.key, info.type);
+                    size_t blob_len = 0;
+                    if (info.type == NVS_TYPE_BLOB && nvs_get_blob(handle, info.key, NULL, &blob_len) == ESP_OK) {
+                        chunk_writer_printf(w, ",\"length\":%u", (unsigned)blob_len);
+                    }
+                    chunk_writer_write(w, "}", 1);
                 }
             }
+            res = nvs_entry_next(&it);
         }
-        closedir(dir);
-        snprintf(response + written, response_size - written, "]}");
+        nvs_release_iterator(it);
+        nvs_close(handle);
     }
+    free(namespaces);
+    partition_unlock(partition, false);
     
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, response, strlen(response));
-    free(response);
-    
-    // Unmount the partition
-    esp_vfs_spiffs_unregister(partition_name);
+    chunk_writer_printf(w, "],\"offset\":%ld,\"count\":%ld,\"total\":%ld}", offset, emitted, matched);
+    esp_err_t err = chunk_writer_finish(w);
+    free(w);
     
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to send NVS key list: %s", esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Listed %ld of %ld NVS keys from %s", emitted, matched, partition_name);
     return ESP_OK;
 }
 
-// HTTP SPIFFS Upload Handler
-static esp_err_t spiffs_upload_handler(httpd_req_t *req)
+// HTTP NVS Stats Handler - entry usage of every NVS partition and the change generation
+static esp_err_t nvs_stats_handler(httpd_req_t *req)
 {
-    char filename[128] = {0};
-    char partition_name[64] = {0};
-    char mount_path[128] = {0};
-    char *buf = malloc(512);
-    
-    if (!buf) {
+    chunk_writer_t *w = malloc(sizeof(chunk_writer_t));
+    if (!w) {
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
         return ESP_FAIL;
     }
+    chunk_writer_init(w, req);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    chunk_writer_printf(w, "{\"generation\":%lu,\"partitions\":[", (unsigned long)nvs_generation);
     
-    // Get filename and partition from query parameters
-    if (httpd_req_get_url_query_str(req, buf, 512) == ESP_OK) {
-        char *filename_ptr = strstr(buf, "name=");
-        if (filename_ptr) {
-            filename_ptr += strlen("name=");
-            sscanf(filename_ptr, "%127[^&]", filename);
-        }
+    int count = 0;
+    esp_partition_iterator_t it = esp_partition_find(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, NULL);
+    while (it != NULL) {
+        const esp_partition_t *partition = esp_partition_get(it);
+        chunk_writer_printf(w, "%s{\"partition\":", count++ > 0 ? "," : "");
+        chunk_writer_json_string(w, partition->label);
+        chunk_writer_printf(w, ",\"size\":%lu", (unsigned long)partition->size);
         
-        char *partition_ptr = strstr(buf, "partition=");
-        if (partition_ptr) {
-            partition_ptr += strlen("partition=");
-            sscanf(partition_ptr, "%63[^&]", partition_name);
+        // Only partitions initialised by the NVS library have statistics
+        nvs_stats_t stats;
+        if (nvs_get_stats(partition->label, &stats) == ESP_OK) {
+            chunk_writer_printf(w, ",\"mounted\":true,\"used_entries\":%u,\"free_entries\":%u,\"total_entries\":%u,\"namespace_count\":%u}",
+                                (unsigned)stats.used_entries, (unsigned)stats.free_entries,
+                                (unsigned)stats.total_entries, (unsigned)stats.namespace_count);
+        } else {
+            chunk_writer_printf(w, ",\"mounted\":false}");
         }
+        it = esp_partition_next(it);
     }
+    esp_partition_iterator_release(it);
     
-    if (strlen(filename) == 0 || strlen(partition_name) == 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Filename and partition required");
-        free(buf);
-        return ESP_FAIL;
+    chunk_writer_write(w, "]}", 2);
+    esp_err_t err = chunk_writer_finish(w);
+    free(w);
+    return err == ESP_OK ? ESP_OK : ESP_FAIL;
+}
+
+// HTTP NVS Get Handler - Get a specific key value (?namespace= looks it up directly)
+static esp_err_t nvs_get_handler(httpd_req_t *req)
+{
+    char partition_name[64] = {0};
+    char namespace_name[16] = {0};
+    char key[16] = {0};
+    http_query_t query;
+    
+    if (query_parse(req, &query)) {
+        query_get_param(&query, "partition", partition_name, sizeof(partition_name));
+        query_get_param(&query, "namespace", namespace_name, sizeof(namespace_name));
+        query_get_param(&query, "key", key, sizeof(key));
     }
     
-    snprintf(mount_path, sizeof(mount_path), "/%s", partition_name);
-    
-    // Find and mount the partition
-    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, partition_name);
-    if (!partition) {
-        ESP_LOGE(TAG, "SPIFFS partition not found: %s", partition_name);
-        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Partition not found");
-        free(buf);
+    if (strlen(partition_name) == 0 || strlen(key) == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition and key required");
         return ESP_FAIL;
     }
-    
-    // Mount the partition
-    esp_vfs_spiffs_conf_t conf = {
-        .base_path = mount_path,
-        .partition_label = partition_name,
-        .max_files = 5,
-        .format_if_mount_failed = false,
-    };
-    
-    esp_err_t ret = esp_vfs_spiffs_register(&conf);
-    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
-        ESP_LOGE(TAG, "Failed to mount SPIFFS partition %s: %s", partition_name, esp_err_to_name(ret));
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to mount partition");
-        free(buf);
+    const esp_partition_t *partition;
+    if (!nvs_lock_shared(req, partition_name, &partition)) {
         return ESP_FAIL;
     }
     
-    char filepath[512];
-    snprintf(filepath, sizeof(filepath), "%s/%s", mount_path, filename);
+    // Without a namespace, fall back to scanning for the first namespace holding the key
+    if (namespace_name[0] == '\0') {
+        nvs_iterator_t it = NULL;
+        esp_err_t res = nvs_entry_find(partition_name, NULL, NVS_TYPE_ANY, &it);
+        while (res == ESP_OK) {
+            nvs_entry_info_t info;
+            nvs_entry_info(it, &info);
+            if (strcmp(info.key, key) == 0) {
+                strlcpy(namespace_name, info.namespace_name, sizeof(namespace_name));
+                break;
+            }
+            res = nvs_entry_next(&it);
+        }
+        nvs_release_iterator(it);
+    }
     
-    FILE *file = fopen(filepath, "wb");
-    if (!file) {
-        ESP_LOGE(TAG, "Failed to open file for writing: %s", filepath);
-        esp_vfs_spiffs_unregister(partition_name);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to create file");
-        free(buf);
+    nvs_handle_t handle;
+    nvs_type_t type = NVS_TYPE_ANY;
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    if (namespace_name[0] != '\0') {
+        err = nvs_open_from_partition(partition_name, namespace_name, NVS_READONLY, &handle);
+        if (err == ESP_OK) {
+            err = nvs_find_key(handle, key, &type);
+            if (err != ESP_OK) {
+                nvs_close(handle);
+            }
+        }
+    }
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        partition_unlock(partition, false);
+        httpd_resp_set_status(req, "404 Not Found");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, "{\"error\":\"Key not found\"}");
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        partition_unlock(partition, false);
+        ESP_LOGE(TAG, "Failed to look up NVS key '%s' in '%s': %s", key, namespace_name, esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to open NVS");
         return ESP_FAIL;
     }
     
-    int total_len = req->content_len;
-    int received = 0;
-    
-    ESP_LOGI(TAG, "Uploading file to SPIFFS: %s (size: %d bytes)", filepath, total_len);
+    chunk_writer_t *w = malloc(sizeof(chunk_writer_t));
+    if (!w) {
+        nvs_close(handle);
+        partition_unlock(partition, false);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    chunk_writer_init(w, req);
+    httpd_resp_set_type(req, "application/json");
+    chunk_writer_write(w, "{\"namespace\":", 13);
+    chunk_writer_json_string(w, namespace_name);
+    chunk_writer_write(w, ",\"key\":", 7);
+    chunk_writer_json_string(w, key);
+    chunk_writer_printf(w, ",\"type\":%d,\"value\":", nvs_type_code(type));
+    
+    // Blobs are returned whole, base64 encoded
+    if (type == NVS_TYPE_BLOB) {
+        size_t len = 0;
+        char *blob = NULL;
+        if (nvs_get_blob(handle, key, NULL, &len) == ESP_OK && (blob = malloc(len ? len : 1)) != NULL &&
+            nvs_get_blob(handle, key, blob, &len) == ESP_OK) {
+            chunk_writer_write(w, "\"", 1);
+            chunk_writer_base64(w, (const uint8_t *)blob, len);
+            chunk_writer_printf(w, "\",\"encoding\":\"base64\",\"length\":%u", (unsigned)len);
+        } else {
+            w->err = ESP_ERR_NO_MEM;
+        }
+        free(blob);
+    } else {
+        nvs_write_value_json(w, handle, key, type);
+    }
+    nvs_close(handle);
+    partition_unlock(partition, false);
     
-    while (received < total_len) {
-        int ret_recv = httpd_req_recv(req, buf, (total_len - received) > 512 ? 512 : (total_len - received));
-        if (ret_recv <= 0) {
-            if (ret_recv == HTTPD_SOCK_ERR_TIMEOUT) {
-                ESP_LOGE(TAG, "Upload socket timeout");
-            }
-            break;
+    chunk_writer_write(w, "}", 1);
+    err = chunk_writer_finish(w);
+    free(w);
+    return err == ESP_OK ? ESP_OK : ESP_FAIL;
+}
+
+#define NVS_BLOB_MAX_SIZE (64 * 1024)
+
+// Decode base64 in place, skipping whitespace; returns the decoded length or -1 if malformed
+static int base64_decode_inplace(char *data, size_t len)
+{
+    uint32_t group = 0;
+    int bits = 0;
+    size_t out = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+        int v;
+        if (c >= 'A' && c <= 'Z') {
+            v = c - 'A';
+        } else if (c >= 'a' && c <= 'z') {
+            v = c - 'a' + 26;
+        } else if (c >= '0' && c <= '9') {
+            v = c - '0' + 52;
+        } else if (c == '+' || c == '-') {
+            v = 62;
+        } else if (c == '/' || c == '_') {
+            v = 63;
+        } else if (c == '=' || c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+            continue;
+        } else {
+            return -1;
         }
-        
-        if (fwrite(buf, 1, ret_recv, file) != ret_recv) {
-            ESP_LOGE(TAG, "Failed to write file");
-            fclose(file);
-            unlink(filepath);
-            esp_vfs_spiffs_unregister(partition_name);
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Write failed");
-            free(buf);
-            return ESP_FAIL;
+        group = (group << 6) | v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            data[out++] = (char)(group >> bits);
         }
-        
-        received += ret_recv;
     }
+    return (int)out;
+}
+
+// Parse ?partition=&namespace=&key=&encoding= shared by the blob GET and PUT handlers
+static bool nvs_blob_params(httpd_req_t *req, char *partition_name, size_t partition_len,
+                            char *namespace_name, char *key, bool *base64)
+{
+    http_query_t query;
+    char encoding[16] = {0};
+    
+    if (query_parse(req, &query)) {
+        query_get_param(&query, "partition", partition_name, partition_len);
+        query_get_param(&query, "namespace", namespace_name, sizeof(nvs_name_t));
+        query_get_param(&query, "key", key, sizeof(nvs_name_t));
+        query_get_param(&query, "encoding", encoding, sizeof(encoding));
+    }
+    *base64 = strcmp(encoding, "base64") == 0;
+    if (partition_name[0] == '\0' || namespace_name[0] == '\0' || key[0] == '\0') {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition, namespace and key required");
+        return false;
+    }
+    return true;
+}
+
+// HTTP NVS Blob Read Handler - blob contents as raw octets (default) or ?encoding=base64
+static esp_err_t nvs_blob_get_handler(httpd_req_t *req)
+{
+    char partition_name[64] = {0};
+    nvs_name_t namespace_name = {0};
+    nvs_name_t key = {0};
+    bool base64;
     
-    fclose(file);
+    if (!nvs_blob_params(req, partition_name, sizeof(partition_name), namespace_name, key, &base64)) {
+        return ESP_FAIL;
+    }
     
-    if (received != total_len) {
-        ESP_LOGE(TAG, "Upload incomplete: received %d / %d bytes", received, total_len);
-        unlink(filepath);
-        esp_vfs_spiffs_unregister(partition_name);
-        free(buf);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Upload incomplete");
+    const esp_partition_t *partition;
+    if (!nvs_lock_shared(req, partition_name, &partition)) {
         return ESP_FAIL;
     }
     
-    ESP_LOGI(TAG, "File uploaded successfully: %s", filepath);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, "{\"status\":\"success\", \"message\":\"File uploaded\"}", HTTPD_RESP_USE_STRLEN);
+    // NVS has no partial blob reads, so the value is fetched whole after a size query
+    nvs_handle_t handle;
+    size_t len = 0;
+    esp_err_t err = nvs_open_from_partition(partition_name, namespace_name, NVS_READONLY, &handle);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(handle, key, NULL, &len);
+        if (err != ESP_OK) {
+            nvs_close(handle);
+        }
+    }
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        partition_unlock(partition, false);
+        httpd_resp_set_status(req, "404 Not Found");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, "{\"error\":\"Blob not found\"}");
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        partition_unlock(partition, false);
+        ESP_LOGE(TAG, "Failed to look up NVS blob '%s' in '%s': %s", key, namespace_name, esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to open NVS");
+        return ESP_FAIL;
+    }
     
-    // Unmount the partition
-    esp_vfs_spiffs_unregister(partition_name);
-    free(buf);
+    char *blob = malloc(len ? len : 1);
+    if (!blob) {
+        nvs_close(handle);
+        partition_unlock(partition, false);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    err = nvs_get_blob(handle, key, blob, &len);
+    nvs_close(handle);
+    partition_unlock(partition, false);
+    if (err != ESP_OK) {
+        free(blob);
+        ESP_LOGE(TAG, "Failed to read NVS blob '%s': %s", key, esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to read blob");
+        return ESP_FAIL;
+    }
     
-    return ESP_OK;
+    if (base64) {
+        chunk_writer_t *w = malloc(sizeof(chunk_writer_t));
+        if (!w) {
+            free(blob);
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+            return ESP_FAIL;
+        }
+        chunk_writer_init(w, req);
+        httpd_resp_set_type(req, "text/plain");
+        chunk_writer_base64(w, (const uint8_t *)blob, len);
+        err = chunk_writer_finish(w);
+        free(w);
+    } else {
+        char disposition[64];
+        snprintf(disposition, sizeof(disposition), "attachment; filename=\"%s.bin\"", key);
+        httpd_resp_set_type(req, "application/octet-stream");
+        httpd_resp_set_hdr(req, "Content-Disposition", disposition);
+        err = httpd_resp_send(req, blob, len);
+    }
+    free(blob);
+    
+    ESP_LOGI(TAG, "Sent NVS blob '%s' from namespace '%s' (%u bytes)", key, namespace_name, (unsigned)len);
+    return err == ESP_OK ? ESP_OK : ESP_FAIL;
 }
 
-// HTTP SPIFFS Download Handler
-static esp_err_t spiffs_download_handler(httpd_req_t *req)
+// HTTP NVS Blob Write Handler - replaces a blob with the raw or ?encoding=base64 request body
+static esp_err_t nvs_blob_put_handler(httpd_req_t *req)
 {
-    char filename[128] = {0};
     char partition_name[64] = {0};
-    char mount_path[128] = {0};
-    char query_buf[512] = {0};
+    nvs_name_t namespace_name = {0};
+    nvs_name_t key = {0};
+    bool base64;
     
-    if (httpd_req_get_url_query_str(req, query_buf, sizeof(query_buf)) == ESP_OK) {
-        char *filename_ptr = strstr(query_buf, "name=");
-        if (filename_ptr) {
-            filename_ptr += strlen("name=");
-            sscanf(filename_ptr, "%127[^&]", filename);
-        }
-        
-        char *partition_ptr = strstr(query_buf, "partition=");
-        if (partition_ptr) {
-            partition_ptr += strlen("partition=");
-            sscanf(partition_ptr, "%63[^&]", partition_name);
-        }
+    if (!nvs_blob_params(req, partition_name, sizeof(partition_name), namespace_name, key, &base64)) {
+        return ESP_FAIL;
     }
     
-    if (strlen(filename) == 0 || strlen(partition_name) == 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Filename and partition required");
+    // nvs_set_blob takes the whole value, so the body is staged in one buffer
+    char *body = read_body(req, base64 ? (NVS_BLOB_MAX_SIZE / 3 + 1) * 4 + 64 : NVS_BLOB_MAX_SIZE);
+    if (!body) {
         return ESP_FAIL;
     }
+    int len = (int)req->content_len;
+    if (base64) {
+        len = base64_decode_inplace(body, req->content_len);
+        if (len < 0 || len > NVS_BLOB_MAX_SIZE) {
+            free(body);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid base64 data");
+            return ESP_FAIL;
+        }
+    }
     
-    snprintf(mount_path, sizeof(mount_path), "/%s", partition_name);
-    
-    // Find and mount the partition
-    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, partition_name);
-    if (!partition) {
-        ESP_LOGE(TAG, "SPIFFS partition not found: %s", partition_name);
-        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Partition not found");
+    const esp_partition_t *partition;
+    if (!nvs_lock_shared(req, partition_name, &partition)) {
+        free(body);
         return ESP_FAIL;
     }
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open_from_partition(partition_name, namespace_name, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, key, body, len);
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    partition_unlock(partition, false);
+    free(body);
     
-    // Mount the partition
-    esp_vfs_spiffs_conf_t conf = {
-        .base_path = mount_path,
-        .partition_label = partition_name,
-        .max_files = 5,
-        .format_if_mount_failed = false,
-    };
-    
-    esp_err_t ret = esp_vfs_spiffs_register(&conf);
-    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
-        ESP_LOGE(TAG, "Failed to mount SPIFFS partition %s: %s", partition_name, esp_err_to_name(ret));
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to mount partition");
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write NVS blob '%s' in '%s': %s", key, namespace_name, esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to write blob");
         return ESP_FAIL;
     }
     
-    char filepath[512];
-    snprintf(filepath, sizeof(filepath), "%s/%s", mount_path, filename);
+    nvs_changed();
+    ESP_LOGI(TAG, "Wrote NVS blob '%s' in namespace '%s' partition '%s' (%d bytes)", key, namespace_name, partition_name, len);
+    char resp[96];
+    snprintf(resp, sizeof(resp), "{\"status\":\"success\",\"message\":\"Blob updated\",\"length\":%d}", len);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, resp);
+    return ESP_OK;
+}
+
+// HTTP NVS Delete Handler
+static esp_err_t nvs_delete_handler(httpd_req_t *req)
+{
+    char partition_name[64] = {0};
+    char key[64] = {0};
     
-    FILE *file = fopen(filepath, "rb");
-    if (!file) {
-        ESP_LOGE(TAG, "Failed to open file: %s", filepath);
-        esp_vfs_spiffs_unregister(partition_name);
-        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+    json_doc_t doc;
+    if (!read_json(req, JSON_SMALL_MAX_BODY, &doc)) {
         return ESP_FAIL;
     }
+    json_get_string(doc.body, doc.toks, 0, "partition", partition_name, sizeof(partition_name));
+    json_get_string(doc.body, doc.toks, 0, "key", key, sizeof(key));
+    json_doc_free(&doc);
     
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    
-    ESP_LOGI(TAG, "Downloading file from SPIFFS: %s (size: %ld)", filepath, file_size);
-    
-    char disposition[256];
-    snprintf(disposition, sizeof(disposition), "attachment; filename=\"%s\"", filename);
-    httpd_resp_set_hdr(req, "Content-Disposition", disposition);
-    httpd_resp_set_type(req, "application/octet-stream");
+    if (strlen(partition_name) == 0 || strlen(key) == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition and key required");
+        return ESP_FAIL;
+    }
     
-    char *buf = malloc(4096);
-    if (!buf) {
-        fclose(file);
-        esp_vfs_spiffs_unregister(partition_name);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+    const esp_partition_t *partition;
+    if (!nvs_lock_shared(req, partition_name, &partition)) {
+        return ESP_FAIL;
+    }
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open_from_partition(partition_name, "", NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        partition_unlock(partition, false);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to open NVS");
         return ESP_FAIL;
     }
     
-    size_t read_bytes;
-    while ((read_bytes = fread(buf, 1, 4096, file)) > 0) {
-        if (httpd_resp_send_chunk(req, buf, read_bytes) != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to send chunk");
-            break;
-        }
+    esp_err_t del_err = nvs_erase_key(handle, key);
+    if (del_err != ESP_OK) {
+        nvs_close(handle);
+        partition_unlock(partition, false);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to delete key");
+        return ESP_FAIL;
     }
     
-    httpd_resp_send_chunk(req, NULL, 0);
-    fclose(file);
-    free(buf);
-    
-    // Unmount the partition
-    esp_vfs_spiffs_unregister(partition_name);
+    nvs_commit(handle);
+    nvs_close(handle);
+    partition_unlock(partition, false);
+    nvs_changed();
     
-    ESP_LOGI(TAG, "File download complete: %s", filename);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, "{\"status\":\"success\", \"message\":\"Key deleted\"}", HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
-// HTTP SPIFFS Delete Handler
-static esp_err_t spiffs_delete_handler(httpd_req_t *req)
+#define NVS_STR_MAX_SIZE 4000   // Largest string NVS stores, including the terminator
+#define NVS_SET_MAX_BODY (8 * 1024)
+
+// Parse a value given as text and store it with the API type code (see nvs_type_codes)
+static esp_err_t nvs_set_from_string(nvs_handle_t handle, const char *key, int type, const char *value)
+{
+    switch (type) {
+        case 0: // U8
+            return nvs_set_u8(handle, key, (uint8_t)atoi(value));
+        case 1: // I8
+            return nvs_set_i8(handle, key, (int8_t)atoi(value));
+        case 2: // U16
+            return nvs_set_u16(handle, key, (uint16_t)atoi(value));
+        case 3: // I16
+            return nvs_set_i16(handle, key, (int16_t)atoi(value));
+        case 4: // U32
+            return nvs_set_u32(handle, key, (uint32_t)strtoul(value, NULL, 10));
+        case 5: // I32
+            return nvs_set_i32(handle, key, (int32_t)strtol(value, NULL, 10));
+        case 6: // U64
+            return nvs_set_u64(handle, key, (uint64_t)strtoull(value, NULL, 10));
+        case 7: // I64
+            return nvs_set_i64(handle, key, (int64_t)strtoll(value, NULL, 10));
+        case 8: // STR
+            return nvs_set_str(handle, key, value);
+        default:
+            return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+}
+
+// Read the "value" member of an object as text: strings are unescaped, numbers are taken as written
+static bool nvs_json_value(const json_doc_t *doc, int obj, char *out, size_t out_len)
+{
+    out[0] = '\0';
+    int value = json_object_get(doc->body, doc->toks, obj, "value");
+    if (value < 0) {
+        return false;
+    }
+    const json_tok_t *tok = &doc->toks[value];
+    if (tok->type == JSON_STRING) {
+        return json_tok_copy(doc->body, tok, out, out_len);
+    }
+    size_t len = tok->end - tok->start;
+    if (tok->type != JSON_PRIMITIVE || len >= out_len) {
+        return false;
+    }
+    memcpy(out, doc->body + tok->start, len);
+    out[len] = '\0';
+    return true;
+}
+
+// HTTP NVS Set Handler - Updates a key value in NVS partition
+static esp_err_t nvs_set_handler(httpd_req_t *req)
 {
-    char filename[128] = {0};
     char partition_name[64] = {0};
-    char mount_path[128] = {0};
-    char *buf = malloc(512);
+    char namespace_name[64] = {0};
+    char key[64] = {0};
+    long long type = -1;
     
-    if (!buf) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+    json_doc_t doc;
+    if (!read_json(req, NVS_SET_MAX_BODY, &doc)) {
         return ESP_FAIL;
     }
-    
-    int ret = httpd_req_recv(req, buf, 512);
-    if (ret <= 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
-        free(buf);
+    char *value = malloc(NVS_STR_MAX_SIZE);
+    if (!value) {
+        json_doc_free(&doc);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
         return ESP_FAIL;
     }
+    json_get_string(doc.body, doc.toks, 0, "partition", partition_name, sizeof(partition_name));
+    json_get_string(doc.body, doc.toks, 0, "namespace", namespace_name, sizeof(namespace_name));
+    json_get_string(doc.body, doc.toks, 0, "key", key, sizeof(key));
+    json_get_int(doc.body, doc.toks, 0, "type", &type);
+    bool has_value = nvs_json_value(&doc, 0, value, NVS_STR_MAX_SIZE);
+    json_doc_free(&doc);
     
-    // Parse JSON to get filename and partition
-    char *filename_ptr = strstr(buf, "\"name\":\"");
-    if (filename_ptr) {
-        filename_ptr += strlen("\"name\":\"");
-        int i = 0;
-        while (filename_ptr[i] != '"' && i < 127) {
-            filename[i] = filename_ptr[i];
-            i++;
-        }
-        filename[i] = '\0';
+    if (strlen(partition_name) == 0 || strlen(key) == 0 || type < 0) {
+        free(value);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition, key, and type required");
+        return ESP_FAIL;
     }
-    
-    char *partition_ptr = strstr(buf, "\"partition\":\"");
-    if (partition_ptr) {
-        partition_ptr += strlen("\"partition\":\"");
-        int i = 0;
-        while (partition_ptr[i] != '"' && i < 63) {
-            partition_name[i] = partition_ptr[i];
-            i++;
-        }
-        partition_name[i] = '\0';
+    if (!has_value) {
+        free(value);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Value missing or too long");
+        return ESP_FAIL;
     }
-    free(buf);
     
-    if (strlen(filename) == 0 || strlen(partition_name) == 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Filename and partition required");
+    const esp_partition_t *partition;
+    if (!nvs_lock_shared(req, partition_name, &partition)) {
+        free(value);
         return ESP_FAIL;
     }
     
-    snprintf(mount_path, sizeof(mount_path), "/%s", partition_name);
-    
-    // Find and mount the partition
-    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, partition_name);
-    if (!partition) {
-        ESP_LOGE(TAG, "SPIFFS partition not found: %s", partition_name);
-        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Partition not found");
+    // Open NVS partition with the specified namespace
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open_from_partition(partition_name, namespace_name, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        free(value);
+        partition_unlock(partition, false);
+        ESP_LOGE(TAG, "Failed to open NVS partition '%s' namespace '%s': %s", partition_name, namespace_name, esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to open NVS");
         return ESP_FAIL;
     }
     
-    // Mount the partition
-    esp_vfs_spiffs_conf_t conf = {
-        .base_path = mount_path,
-        .partition_label = partition_name,
-        .max_files = 5,
-        .format_if_mount_failed = false,
-    };
-    
-    esp_err_t ret_mount = esp_vfs_spiffs_register(&conf);
-    if (ret_mount != ESP_OK && ret_mount != ESP_ERR_INVALID_STATE) {
-        ESP_LOGE(TAG, "Failed to mount SPIFFS partition %s: %s", partition_name, esp_err_to_name(ret_mount));
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to mount partition");
+    if (type == 9) { // BLOB
+        free(value);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Cannot edit BLOB data");
+        nvs_close(handle);
+        partition_unlock(partition, false);
         return ESP_FAIL;
     }
     
-    char filepath[512];
-    snprintf(filepath, sizeof(filepath), "%s/%s", mount_path, filename);
-    
-    ESP_LOGI(TAG, "Deleting file: %s", filepath);
-    
-    if (unlink(filepath) != 0) {
-        ESP_LOGE(TAG, "Failed to delete file: %s", filepath);
-        esp_vfs_spiffs_unregister(partition_name);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to delete file");
+    esp_err_t write_err = nvs_set_from_string(handle, key, (int)type, value);
+    free(value);
+    if (write_err != ESP_OK) {
+        nvs_close(handle);
+        partition_unlock(partition, false);
+        ESP_LOGE(TAG, "Failed to write NVS key: %s", esp_err_to_name(write_err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to write key");
         return ESP_FAIL;
     }
     
-    // Unmount the partition
-    esp_vfs_spiffs_unregister(partition_name);
+    nvs_commit(handle);
+    nvs_close(handle);
+    partition_unlock(partition, false);
+    nvs_changed();
     
+    ESP_LOGI(TAG, "Successfully updated NVS key '%s' in namespace '%s' partition '%s'", key, namespace_name, partition_name);
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, "{\"status\":\"success\", \"message\":\"File deleted\"}", HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send(req, "{\"status\":\"success\", \"message\":\"Key updated\"}", HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
-// HTTP NVS List Handler - Lists all keys in all namespaces in an NVS partition
-static esp_err_t nvs_list_handler(httpd_req_t *req)
+#define NVS_BATCH_MAX_BODY (32 * 1024)
+#define NVS_BATCH_MAX_NAMESPACES 16
+
+typedef struct {
+    nvs_name_t name;
+    nvs_handle_t handle;
+    esp_err_t open_err;
+} nvs_batch_ns_t;
+
+// Look up the handle for a namespace, opening it on first use
+static esp_err_t nvs_batch_handle(const char *partition_name, nvs_batch_ns_t *open_ns, int *open_count,
+                                  const char *namespace_name, nvs_handle_t *handle)
 {
-    char partition_name[64] = {0};
-    char query_buf[256] = {0};
-    
-    // Get partition name from query parameter
-    if (httpd_req_get_url_query_str(req, query_buf, sizeof(query_buf)) == ESP_OK) {
-        ESP_LOGI(TAG, "Query string: %s", query_buf);
-        char *partition_ptr = strstr(query_buf, "partition=");
-        if (partition_ptr) {
-            partition_ptr += strlen("partition=");
-            int i = 0;
-            while (partition_ptr[i] != '\0' && partition_ptr[i] != '&' && i < 63) {
-                partition_name[i] = partition_ptr[i];
-                i++;
-            }
-            partition_name[i] = '\0';
+    for (int i = 0; i < *open_count; i++) {
+        if (strcmp(open_ns[i].name, namespace_name) == 0) {
+            *handle = open_ns[i].handle;
+            return open_ns[i].open_err;
         }
     }
+    if (*open_count == NVS_BATCH_MAX_NAMESPACES) {
+        return ESP_ERR_NO_MEM;
+    }
+    nvs_batch_ns_t *ns = &open_ns[(*open_count)++];
+    strlcpy(ns->name, namespace_name, sizeof(ns->name));
+    ns->open_err = nvs_open_from_partition(partition_name, namespace_name, NVS_READWRITE, &ns->handle);
+    *handle = ns->handle;
+    return ns->open_err;
+}
+
+// Name of an error a batch operation can hit. esp_err_to_name() only says
+// "UNKNOWN ERROR" here since the build disables its lookup table.
+static const char *nvs_batch_err_name(esp_err_t err)
+{
+    switch (err) {
+    case ESP_ERR_NO_MEM:                return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:           return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_NVS_NOT_FOUND:         return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_NVS_TYPE_MISMATCH:     return "ESP_ERR_NVS_TYPE_MISMATCH";
+    case ESP_ERR_NVS_READ_ONLY:         return "ESP_ERR_NVS_READ_ONLY";
+    case ESP_ERR_NVS_NOT_ENOUGH_SPACE:  return "ESP_ERR_NVS_NOT_ENOUGH_SPACE";
+    case ESP_ERR_NVS_INVALID_NAME:      return "ESP_ERR_NVS_INVALID_NAME";
+    case ESP_ERR_NVS_INVALID_HANDLE:    return "ESP_ERR_NVS_INVALID_HANDLE";
+    case ESP_ERR_NVS_KEY_TOO_LONG:      return "ESP_ERR_NVS_KEY_TOO_LONG";
+    case ESP_ERR_NVS_INVALID_LENGTH:    return "ESP_ERR_NVS_INVALID_LENGTH";
+    case ESP_ERR_NVS_VALUE_TOO_LONG:    return "ESP_ERR_NVS_VALUE_TOO_LONG";
+    case ESP_ERR_NVS_PART_NOT_FOUND:    return "ESP_ERR_NVS_PART_NOT_FOUND";
+    case ESP_FAIL:                      return "ESP_FAIL";
+    default:                            return "UNKNOWN";
+    }
+}
+
+// HTTP NVS Batch Handler - applies many set/delete operations with one handle per
+// namespace, reporting the result of each operation. Not atomic: every nvs_set_* or
+// nvs_erase_key writes flash as it runs, so a failed operation leaves earlier ones applied.
+static esp_err_t nvs_batch_handler(httpd_req_t *req)
+{
+    char partition_name[64] = {0};
+    http_query_t query;
     
-    ESP_LOGI(TAG, "NVS list handler - extracted partition name: '%s' (len: %d)", partition_name, strlen(partition_name));
+    json_doc_t doc;
+    if (!read_json(req, NVS_BATCH_MAX_BODY, &doc)) {
+        return ESP_FAIL;
+    }
     
+    if (query_parse(req, &query)) {
+        query_get_param(&query, "partition", partition_name, sizeof(partition_name));
+    }
     if (strlen(partition_name) == 0) {
-        ESP_LOGE(TAG, "No partition name provided");
+        json_get_string(doc.body, doc.toks, 0, "partition", partition_name, sizeof(partition_name));
+    }
+    if (strlen(partition_name) == 0) {
+        json_doc_free(&doc);
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition name required");
         return ESP_FAIL;
     }
+    const esp_partition_t *partition;
+    if (!nvs_lock_shared(req, partition_name, &partition)) {
+        json_doc_free(&doc);
+        return ESP_FAIL;
+    }
     
-    char *response = malloc(16384);
-    if (!response) {
+    nvs_batch_ns_t *open_ns = calloc(NVS_BATCH_MAX_NAMESPACES, sizeof(nvs_batch_ns_t));
+    char *value = malloc(NVS_STR_MAX_SIZE);
+    chunk_writer_t *w = malloc(sizeof(chunk_writer_t));
+    if (!open_ns || !value || !w) {
+        free(open_ns);
+        free(value);
+        free(w);
+        json_doc_free(&doc);
+        partition_unlock(partition, false);
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
         return ESP_FAIL;
     }
+    chunk_writer_init(w, req);
+    httpd_resp_set_type(req, "application/json");
     
-    int written = snprintf(response, 16384, "{\"keys\":[");
+    chunk_writer_printf(w, "{\"results\":[");
+    int open_count = 0, index = 0, applied = 0, failed = 0;
+    int ops = json_doc_array(&doc, "ops");
+    int op_count = ops >= 0 ? doc.toks[ops].size : 0;
+    for (int obj = ops + 1; index < op_count; obj = doc.toks[obj].next) {
+        char op[8], namespace_name[16], key[16];
+        json_get_string(doc.body, doc.toks, obj, "op", op, sizeof(op));
+        json_get_string(doc.body, doc.toks, obj, "namespace", namespace_name, sizeof(namespace_name));
+        json_get_string(doc.body, doc.toks, obj, "key", key, sizeof(key));
+        long long type;
+        if (!json_get_int(doc.body, doc.toks, obj, "type", &type)) {
+            type = -1;
+        }
+        
+        // Values may be sent as JSON strings or bare numbers
+        bool has_value = nvs_json_value(&doc, obj, value, NVS_STR_MAX_SIZE);
+        
+        esp_err_t err;
+        nvs_handle_t handle;
+        bool is_set = strcmp(op, "set") == 0;
+        if ((!is_set && strcmp(op, "delete") != 0) || namespace_name[0] == '\0' || key[0] == '\0' ||
+            (is_set && (type < 0 || type == 9 || !has_value))) {
+            err = ESP_ERR_INVALID_ARG;
+        } else if ((err = nvs_batch_handle(partition_name, open_ns, &open_count, namespace_name, &handle)) == ESP_OK) {
+            err = is_set ? nvs_set_from_string(handle, key, (int)type, value) : nvs_erase_key(handle, key);
+        }
+        
+        if (err == ESP_OK) {
+            applied++;
+        } else {
+            failed++;
+        }
+        chunk_writer_printf(w, "%s{\"index\":%d,\"status\":\"%s\"", index > 0 ? "," : "", index,
+                            err == ESP_OK ? "success" : "error");
+        if (err != ESP_OK) {
+            chunk_writer_printf(w, ",\"error\":\"%s\",\"code\":%d", nvs_batch_err_name(err), (int)err);
+        }
+        chunk_writer_write(w, "}", 1);
+        index++;
+    }
     
-    // Iterate through ALL namespaces and keys
-    nvs_iterator_t it = NULL;
-    esp_err_t iter_err = nvs_entry_find(partition_name, NULL, NVS_TYPE_ANY, &it);
+    // Each operation is already on flash; nvs_commit() is kept for NVS implementations that buffer
+    bool committed = true;
+    for (int i = 0; i < open_count; i++) {
+        if (open_ns[i].open_err != ESP_OK) {
+            continue;
+        }
+        esp_err_t err = nvs_commit(open_ns[i].handle);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to commit NVS namespace '%s': %s", open_ns[i].name, esp_err_to_name(err));
+            committed = false;
+        }
+        nvs_close(open_ns[i].handle);
+    }
+    partition_unlock(partition, false);
     
-    ESP_LOGI(TAG, "Starting NVS iteration for partition: %s, entry_find result: %s", partition_name, esp_err_to_name(iter_err));
+    if (applied > 0) {
+        nvs_changed();
+    }
     
-    bool first = true;
+    chunk_writer_printf(w, "],\"applied\":%d,\"failed\":%d,\"committed\":%s}", applied, failed, committed ? "true" : "false");
+    esp_err_t err = chunk_writer_finish(w);
+    free(w);
+    free(value);
+    free(open_ns);
+    json_doc_free(&doc);
     
-    while (it != NULL) {
-        nvs_entry_info_t info;
-        nvs_entry_info(it, &info);
-        
-        ESP_LOGI(TAG, "Found NVS entry - namespace: '%s', key: '%s', type: %d", info.namespace_name, info.key, info.type);
-        
-        if (!first) {
-            written += snprintf(response + written, 16384 - written, ",");
+    ESP_LOGI(TAG, "NVS batch on %s: %d applied, %d failed across %d namespaces", partition_name, applied, failed, open_count);
+    return err == ESP_OK ? ESP_OK : ESP_FAIL;
+}
+
+// nvs_partition_gen.py CSV encodings and the NVS types they map to; blobs export as base64
+static const struct {
+    const char *encoding;
+    nvs_type_t type;
+} nvs_csv_types[] = {
+    { "u8", NVS_TYPE_U8 }, { "i8", NVS_TYPE_I8 }, { "u16", NVS_TYPE_U16 }, { "i16", NVS_TYPE_I16 },
+    { "u32", NVS_TYPE_U32 }, { "i32", NVS_TYPE_I32 }, { "u64", NVS_TYPE_U64 }, { "i64", NVS_TYPE_I64 },
+    { "string", NVS_TYPE_STR }, { "base64", NVS_TYPE_BLOB }, { "hex2bin", NVS_TYPE_BLOB },
+};
+
+#define NVS_CSV_TYPE_COUNT (sizeof(nvs_csv_types) / sizeof(nvs_csv_types[0]))
+#define NVS_IMPORT_MAX_BODY (64 * 1024)
+
+// Write a CSV field, quoting it when it contains separators, quotes or line breaks
+static void chunk_writer_csv_field(chunk_writer_t *w, const char *str)
+{
+    if (strpbrk(str, ",\"\r\n") == NULL) {
+        chunk_writer_write(w, str, strlen(str));
+        return;
+    }
+    chunk_writer_write(w, "\"", 1);
+    for (const char *p = str; *p; p++) {
+        chunk_writer_write(w, p, 1);
+        if (*p == '"') {
+            chunk_writer_write(w, "\"", 1);
         }
-        
-        // Open handle for this specific namespace to read the value
-        nvs_handle_t handle = 0;
-        esp_err_t open_err = nvs_open_from_partition(partition_name, info.namespace_name, NVS_READONLY, &handle);
-        
-        char value_str[512] = {0};
-        if (open_err == ESP_OK) {
-            // Get value based on type
-            if (info.type == NVS_TYPE_I8) {
-                int8_t val;
-                if (nvs_get_i8(handle, info.key, &val) == ESP_OK) {
-                    snprintf(value_str, sizeof(value_str), "%d", val);
-                }
-            } else if (info.type == NVS_TYPE_U8) {
-                uint8_t val;
-                if (nvs_get_u8(handle, info.key, &val) == ESP_OK) {
-                    snprintf(value_str, sizeof(value_str), "%u", val);
-                }
-            } else if (info.type == NVS_TYPE_I16) {
-                int16_t val;
-                if (nvs_get_i16(handle, info.key, &val) == ESP_OK) {
-                    snprintf(value_str, sizeof(value_str), "%d", val);
-                }
-            } else if (info.type == NVS_TYPE_U16) {
-                uint16_t val;
-                if (nvs_get_u16(handle, info.key, &val) == ESP_OK) {
-                    snprintf(value_str, sizeof(value_str), "%u", val);
+    }
+    chunk_writer_write(w, "\"", 1);
+}
+
+static const esp_partition_t *nvs_find_partition(httpd_req_t *req, const char *partition_name)
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, partition_name);
+    if (!partition) {
+        ESP_LOGE(TAG, "NVS partition not found: %s", partition_name);
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "NVS partition not found");
+    }
+    return partition;
+}
+
+// Stream every namespace and entry as nvs_partition_gen CSV. A string or blob that
+// cannot be read sets w->err instead of being skipped, so a clone is never silently
+// missing keys.
+static void nvs_export_csv(chunk_writer_t *w, const char *partition_name)
+{
+    int ns_count = 0;
+    nvs_name_t *namespaces = nvs_collect_namespaces(partition_name, &ns_count);
+    if (!namespaces) {
+        w->err = ESP_ERR_NO_MEM;
+        return;
+    }
+    chunk_writer_printf(w, "key,type,encoding,value\n");
+    for (int n = 0; n < ns_count && w->err == ESP_OK; n++) {
+        nvs_handle_t handle;
+        if (nvs_open_from_partition(partition_name, namespaces[n], NVS_READONLY, &handle) != ESP_OK) {
+            continue;
+        }
+        chunk_writer_printf(w, "%s,namespace,,\n", namespaces[n]);
+        nvs_iterator_t it = NULL;
+        esp_err_t res = nvs_entry_find_in_handle(handle, NVS_TYPE_ANY, &it);
+        while (res == ESP_OK && w->err == ESP_OK) {
+            nvs_entry_info_t info;
+            nvs_entry_info(it, &info);
+            const char *encoding = NULL;
+            for (int i = 0; i < NVS_CSV_TYPE_COUNT && !encoding; i++) {
+                if (nvs_csv_types[i].type == info.type) {
+                    encoding = nvs_csv_types[i].encoding;
                 }
-            } else if (info.type == NVS_TYPE_I32) {
-                int32_t val;
-                if (nvs_get_i32(handle, info.key, &val) == ESP_OK) {
-                    snprintf(value_str, sizeof(value_str), "%ld", val);
+            }
+            char number[24];
+            if (!encoding) {
+                ESP_LOGW(TAG, "Skipping NVS key '%s' with unsupported type 0x%02x", info.key, info.type);
+            } else if (nvs_format_int(handle, info.key, info.type, number, sizeof(number))) {
+                chunk_writer_printf(w, "%s,data,%s,%s\n", info.key, encoding, number);
+            } else if (info.type == NVS_TYPE_STR) {
+                char *str = nvs_get_str_alloc(handle, info.key);
+                if (str) {
+                    chunk_writer_printf(w, "%s,data,%s,", info.key, encoding);
+                    chunk_writer_csv_field(w, str);
+                    chunk_writer_write(w, "\n", 1);
+                    free(str);
+                } else {
+                    ESP_LOGE(TAG, "Failed to read NVS string '%s', aborting export", info.key);
+                    w->err = ESP_ERR_NO_MEM;
                 }
-            } else if (info.type == NVS_TYPE_U32) {
-                uint32_t val;
-                if (nvs_get_u32(handle, info.key, &val) == ESP_OK) {
-                    snprintf(value_str, sizeof(value_str), "%lu", val);
+            } else {
+                size_t len = 0;
+                char *blob = NULL;
+                if (nvs_get_blob(handle, info.key, NULL, &len) == ESP_OK && (blob = malloc(len ? len : 1)) != NULL &&
+                    nvs_get_blob(handle, info.key, blob, &len) == ESP_OK) {
+                    chunk_writer_printf(w, "%s,data,%s,", info.key, encoding);
+                    chunk_writer_base64(w, (const uint8_t *)blob, len);
+                    chunk_writer_write(w, "\n", 1);
+                } else {
+                    ESP_LOGE(TAG, "Failed to read NVS blob '%s' (%u bytes), aborting export", info.key, (unsigned)len);
+                    w->err = ESP_ERR_NO_MEM;
                 }
-            } else if (info.type == NVS_TYPE_I64) {
-                int64_t val;
-                if (nvs_get_i64(handle, info.key, &val) == ESP_OK) {
-                    snprintf(value_str, sizeof(value_str), "%lld", val);
+                free(blob);
+            }
+            res = nvs_entry_next(&it);
+        }
+        nvs_release_iterator(it);
+        nvs_close(handle);
+    }
+    free(namespaces);
+}
+
+// HTTP NVS Export Handler - ?format=csv (nvs_partition_gen input) or ?format=bin (partition image)
+static esp_err_t nvs_export_handler(httpd_req_t *req)
+{
+    char partition_name[64] = {0};
+    char format[8] = "csv";
+    http_query_t query;
+    
+    if (query_parse(req, &query)) {
+        query_get_param(&query, "partition", partition_name, sizeof(partition_name));
+        query_get_param(&query, "format", format, sizeof(format));
+    }
+    if (strlen(partition_name) == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition name required");
+        return ESP_FAIL;
+    }
+    bool binary = strcmp(format, "bin") == 0;
+    if (!binary && strcmp(format, "csv") != 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Format must be csv or bin");
+        return ESP_FAIL;
+    }
+    const esp_partition_t *partition = nvs_find_partition(req, partition_name);
+    if (!partition || !partition_lock_req(req, partition, false)) {
+        return ESP_FAIL;
+    }
+    
+    char disposition[96];
+    snprintf(disposition, sizeof(disposition), "attachment; filename=\"%s.%s\"", partition->label, binary ? "bin" : "csv");
+    httpd_resp_set_hdr(req, "Content-Disposition", disposition);
+    
+    esp_err_t err = ESP_OK;
+    if (binary) {
+        // The partition is already in the format nvs_partition_gen produces
+        char *buf = malloc(DIFF_SECTOR_SIZE);
+        if (!buf) {
+            partition_unlock(partition, false);
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+            return ESP_FAIL;
+        }
+        httpd_resp_set_type(req, "application/octet-stream");
+        for (size_t offset = 0; offset < partition->size && err == ESP_OK; offset += DIFF_SECTOR_SIZE) {
+            err = esp_partition_read(partition, offset, buf, DIFF_SECTOR_SIZE);
+            if (err == ESP_OK) {
+                err = httpd_resp_send_chunk(req, buf, DIFF_SECTOR_SIZE);
+            }
+        }
+        if (err == ESP_OK) {
+            err = httpd_resp_send_chunk(req, NULL, 0);
+        }
+        free(buf);
+    } else {
+        chunk_writer_t *w = malloc(sizeof(chunk_writer_t));
+        if (!w) {
+            partition_unlock(partition, false);
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+            return ESP_FAIL;
+        }
+        chunk_writer_init(w, req);
+        httpd_resp_set_type(req, "text/csv");
+        nvs_export_csv(w, partition->label);
+        if (w->err == ESP_OK) {
+            err = chunk_writer_finish(w);
+        } else {
+            // Once data has gone out the status is sent; leaving the chunked body
+            // unterminated makes the client see a failed transfer, not a short CSV
+            err = w->err;
+            if (!w->started) {
+                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to read NVS entry");
+            }
+        }
+        free(w);
+    }
+    partition_unlock(partition, false);
+    
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "NVS export of %s as %s failed: %s", partition->label, format, esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Exported NVS partition %s as %s", partition->label, format);
+    return ESP_OK;
+}
+
+// One parsed CSV row; blob values are decoded in place
+typedef struct {
+    char *key;
+    char *type;
+    char *encoding;
+    char *value;
+    size_t value_len;
+    int line;
+} nvs_csv_row_t;
+
+// Split the next CSV row of [*pos, end) in place (RFC 4180 quoting); returns the field count, 0 at the end
+static int csv_next_row(char **pos, char *end, char **fields, int max_fields, int *line)
+{
+    char *p = *pos;
+    if (p >= end) {
+        return 0;
+    }
+    int count = 0;
+    for (;;) {
+        char *field = p;
+        char *out = p;
+        if (*p == '"') {
+            for (p++; p < end; p++) {
+                if (*p == '"' && (p + 1 >= end || p[1] != '"')) {
+                    p++;
+                    break;
                 }
-            } else if (info.type == NVS_TYPE_U64) {
-                uint64_t val;
-                if (nvs_get_u64(handle, info.key, &val) == ESP_OK) {
-                    snprintf(value_str, sizeof(value_str), "%llu", val);
+                if (*p == '"') {
+                    p++;
                 }
-            } else if (info.type == NVS_TYPE_STR) {
-                size_t len = 512;
-                char str_val[512] = {0};
-                if (nvs_get_str(handle, info.key, str_val, &len) == ESP_OK) {
-                    // Escape quotes and backslashes in string values
-                    int idx = 0, out_idx = 0;
-                    while (str_val[idx] && out_idx < 500) {
-                        if (str_val[idx] == '"' || str_val[idx] == '\\') {
-                            value_str[out_idx++] = '\\';
-                        }
-                        value_str[out_idx++] = str_val[idx++];
-                    }
-                    value_str[out_idx] = '\0';
+                if (*p == '\n') {
+                    (*line)++;
                 }
-            } else if (info.type == NVS_TYPE_BLOB) {
-                snprintf(value_str, sizeof(value_str), "[BLOB data]");
+                *out++ = *p;
             }
-            
-            nvs_close(handle);
+        }
+        while (p < end && *p != ',' && *p != '\n' && *p != '\r') {
+            *out++ = *p++;
+        }
+        char delim = p < end ? *p : '\n';
+        *out = '\0';
+        if (count < max_fields) {
+            fields[count++] = field;
+        }
+        if (p < end) {
+            p++;
+        }
+        if (delim == ',') {
+            continue;
+        }
+        if (delim == '\r' && p < end && *p == '\n') {
+            p++;
+        }
+        break;
+    }
+    (*line)++;
+    *pos = p;
+    return count;
+}
+
+static char *str_trim(char *s)
+{
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+    char *e = s + strlen(s);
+    while (e > s && isspace((unsigned char)e[-1])) {
+        *--e = '\0';
+    }
+    return s;
+}
+
+static int hex_decode_inplace(char *data, size_t len)
+{
+    if (len % 2 != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < len; i += 2) {
+        if (!isxdigit((unsigned char)data[i]) || !isxdigit((unsigned char)data[i + 1])) {
+            return -1;
+        }
+        char byte[3] = { data[i], data[i + 1], '\0' };
+        data[i / 2] = (char)strtoul(byte, NULL, 16);
+    }
+    return (int)(len / 2);
+}
+
+// Parse an nvs_partition_gen CSV body into rows; returns NULL with *error set on a bad row
+static nvs_csv_row_t *nvs_csv_parse(char *body, char *end, int *count, const char **error, int *error_line)
+{
+    int capacity = 32;
+    nvs_csv_row_t *rows = malloc(capacity * sizeof(nvs_csv_row_t));
+    *count = 0;
+    *error = rows ? NULL : "Memory allocation failed";
+    
+    char *pos = body;
+    int line = 0;
+    char *f[4];
+    int n;
+    while (rows && (n = csv_next_row(&pos, end, f, 4, &line)) > 0) {
+        *error_line = line;
+        char *key = str_trim(f[0]);
+        if ((n == 1 && key[0] == '\0') || key[0] == '#' || (line == 1 && strcmp(key, "key") == 0)) {
+            continue;
+        }
+        if (n < 3) {
+            *error = "Expected key,type,encoding,value";
+            break;
+        }
+        nvs_csv_row_t row = { .key = key, .type = str_trim(f[1]), .encoding = str_trim(f[2]),
+                              .value = n > 3 ? f[3] : "", .line = line };
+        row.value_len = strlen(row.value);
+        if (strcmp(row.type, "file") == 0) {
+            *error = "File entries are not supported; inline the data with base64 or hex2bin";
+            break;
+        }
+        if (strcmp(row.type, "namespace") != 0 && strcmp(row.type, "data") != 0) {
+            *error = "Unknown type";
+            break;
+        }
+        if (strcmp(row.encoding, "base64") == 0 || strcmp(row.encoding, "hex2bin") == 0) {
+            int len = row.encoding[0] == 'b' ? base64_decode_inplace(row.value, row.value_len)
+                                             : hex_decode_inplace(row.value, row.value_len);
+            if (len < 0) {
+                *error = "Invalid encoded value";
+                break;
+            }
+            row.value_len = len;
+        }
+        if (*count == capacity) {
+            nvs_csv_row_t *grown = realloc(rows, capacity * 2 * sizeof(nvs_csv_row_t));
+            if (!grown) {
+                *error = "Memory allocation failed";
+                break;
+            }
+            rows = grown;
+            capacity *= 2;
+        }
+        rows[(*count)++] = row;
+    }
+    if (*error) {
+        free(rows);
+        return NULL;
+    }
+    return rows;
+}
+
+// Add a parsed row to the image; returns an error message or NULL
+static const char *nvs_csv_apply_row(nvs_image_writer_t *img, const nvs_csv_row_t *row, uint8_t *ns_index)
+{
+    if (strcmp(row->type, "namespace") == 0) {
+        return nvs_image_add_namespace(img, row->key, ns_index) == NVS_IMAGE_OK ? NULL : "Invalid namespace";
+    }
+    if (*ns_index == 0) {
+        return "Data entry before the first namespace";
+    }
+    nvs_type_t type = NVS_TYPE_ANY;
+    for (int i = 0; i < NVS_CSV_TYPE_COUNT && type == NVS_TYPE_ANY; i++) {
+        if (strcmp(nvs_csv_types[i].encoding, row->encoding) == 0) {
+            type = nvs_csv_types[i].type;
+        }
+    }
+    if (type == NVS_TYPE_ANY) {
+        return "Unknown encoding";
+    }
+    
+    int err;
+    if (type == NVS_TYPE_STR) {
+        err = nvs_image_add_string(img, *ns_index, row->key, row->value);
+    } else if (type == NVS_TYPE_BLOB) {
+        err = nvs_image_add_blob(img, *ns_index, row->key, row->value, row->value_len);
+    } else {
+        // Integers accept decimal or 0x-prefixed hex; the range is checked against the width
+        int bits = (type & 0x0F) * 8;
+        bool is_signed = (type & 0x10) != 0;
+        char *endp;
+        errno = 0;
+        uint64_t value;
+        bool in_range;
+        if (is_signed) {
+            long long v = strtoll(row->value, &endp, 0);
+            in_range = bits == 64 || (v >= -(1LL << (bits - 1)) && v < (1LL << (bits - 1)));
+            value = (uint64_t)v;
         } else {
-            snprintf(value_str, sizeof(value_str), "[Error opening namespace]");
+            value = strtoull(row->value, &endp, 0);
+            in_range = strchr(row->value, '-') == NULL && (bits == 64 || value < (1ULL << bits));
         }
-        
-        written += snprintf(response + written, 16384 - written,
-                           "{\"namespace\":\"%s\",\"key\":\"%s\",\"type\":%d,\"value\":\"%s\"}",
-                           info.namespace_name, info.key, info.type, value_str);
-        
-        if (nvs_entry_next(&it) != ESP_OK) {
-            break;
+        if (endp == row->value || *str_trim(endp) != '\0' || errno == ERANGE || !in_range) {
+            return "Invalid or out of range number";
         }
-        first = false;
+        err = nvs_image_add_int(img, *ns_index, row->key, (uint8_t)type, value);
     }
-    
-    snprintf(response + written, 16384 - written, "]}");
-    
-    ESP_LOGI(TAG, "NVS list response size: %d bytes", strlen(response));
-    
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, response, strlen(response));
-    free(response);
-    return ESP_OK;
+    if (err == NVS_IMAGE_ERR_NO_SPACE) {
+        return "Data does not fit the partition";
+    }
+    return err == NVS_IMAGE_OK ? NULL : "Invalid key or value";
 }
 
-// HTTP NVS Get Handler - Get a specific key value
-static esp_err_t nvs_get_handler(httpd_req_t *req)
+static int nvs_import_emit(void *ctx, const uint8_t *page)
+{
+    return diff_writer_sector(ctx, page) == ESP_OK ? 0 : -1;
+}
+
+// HTTP NVS Import Handler - replaces a partition with an nvs_partition_gen CSV (built into
+// pages here) or binary image; only the sectors that change are erased and written
+static esp_err_t nvs_import_handler(httpd_req_t *req)
 {
     char partition_name[64] = {0};
-    char key[64] = {0};
-    char query_buf[512] = {0};
+    char format[8] = "csv";
+    http_query_t query;
     
-    // Get partition name and key from query parameters
-    if (httpd_req_get_url_query_str(req, query_buf, sizeof(query_buf)) == ESP_OK) {
-        char *partition_ptr = strstr(query_buf, "partition=");
-        if (partition_ptr) {
-            partition_ptr += strlen("partition=");
-            int i = 0;
-            while (partition_ptr[i] != '\0' && partition_ptr[i] != '&' && i < 63) {
-                partition_name[i] = partition_ptr[i];
-                i++;
-            }
-            partition_name[i] = '\0';
+    if (query_parse(req, &query)) {
+        query_get_param(&query, "partition", partition_name, sizeof(partition_name));
+        query_get_param(&query, "format", format, sizeof(format));
+    }
+    if (strlen(partition_name) == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition name required");
+        return ESP_FAIL;
+    }
+    bool binary = strcmp(format, "bin") == 0;
+    if (!binary && strcmp(format, "csv") != 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Format must be csv or bin");
+        return ESP_FAIL;
+    }
+    const esp_partition_t *partition = nvs_find_partition(req, partition_name);
+    if (!partition) {
+        return ESP_FAIL;
+    }
+    
+    char *body = NULL;
+    nvs_csv_row_t *rows = NULL;
+    int row_count = 0;
+    nvs_image_writer_t *img = malloc(sizeof(nvs_image_writer_t));
+    if (!img) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+    
+    if (binary) {
+        if (req->content_len == 0 || req->content_len > partition->size || req->content_len % DIFF_SECTOR_SIZE != 0) {
+            free(img);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Image must be whole 4KB pages no larger than the partition");
+            return ESP_FAIL;
+        }
+        // The first page is checked before anything is written
+        if (recv_full(req, (char *)img->page, DIFF_SECTOR_SIZE) != DIFF_SECTOR_SIZE || !nvs_image_page_header(img->page, NULL, NULL)) {
+            free(img);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Not an NVS partition image");
+            return ESP_FAIL;
         }
+    } else {
+        body = read_body(req, NVS_IMPORT_MAX_BODY);
+        if (!body) {
+            free(img);
+            return ESP_FAIL;
+        }
+        const char *error = NULL;
+        int error_line = 0;
+        rows = nvs_csv_parse(body, body + req->content_len, &row_count, &error, &error_line);
         
-        char *key_ptr = strstr(query_buf, "key=");
-        if (key_ptr) {
-            key_ptr += strlen("key=");
-            int i = 0;
-            while (key_ptr[i] != '\0' && key_ptr[i] != '&' && i < 63) {
-                key[i] = key_ptr[i];
-                i++;
-            }
-            key[i] = '\0';
+        // Dry run without writing so a bad row or oversized input leaves the partition untouched
+        nvs_image_writer_init(img, partition->size, NULL, NULL);
+        uint8_t ns_index = 0;
+        for (int i = 0; !error && i < row_count; i++) {
+            error = nvs_csv_apply_row(img, &rows[i], &ns_index);
+            error_line = rows[i].line;
+        }
+        if (error) {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "CSV line %d: %s", error_line, error);
+            free(rows);
+            free(body);
+            free(img);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, msg);
+            return ESP_FAIL;
         }
     }
     
-    if (strlen(partition_name) == 0 || strlen(key) == 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition and key required");
+    if (!partition_lock_req(req, partition, true)) {
+        free(rows);
+        free(body);
+        free(img);
         return ESP_FAIL;
     }
-    
-    nvs_handle_t handle;
-    esp_err_t err = nvs_open_from_partition(partition_name, "", NVS_READONLY, &handle);
-    if (err != ESP_OK) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to open NVS");
+    diff_writer_t dw;
+    esp_err_t init_err = diff_writer_init(&dw, partition);
+    if (init_err != ESP_OK) {
+        partition_unlock(partition, true);
+        free(rows);
+        free(body);
+        free(img);
+        diff_writer_init_error(req, init_err);
         return ESP_FAIL;
     }
     
-    // Try to get the value - attempt all types
-    char response[1024] = {0};
-    nvs_iterator_t it = NULL;
-    esp_err_t iter_err = nvs_entry_find(partition_name, "", NVS_TYPE_ANY, &it);
-    bool found = false;
-    
-    while (it != NULL && !found) {
-        nvs_entry_info_t info;
-        nvs_entry_info(it, &info);
-        
-        if (strcmp(info.key, key) == 0) {
-            char value_str[512] = {0};
-            
-            if (info.type == NVS_TYPE_STR) {
-                size_t len = 512;
-                char str_val[512] = {0};
-                nvs_get_str(handle, info.key, str_val, &len);
-                snprintf(value_str, sizeof(value_str), "%s", str_val);
-            } else if (info.type == NVS_TYPE_BLOB) {
-                snprintf(value_str, sizeof(value_str), "[Binary data]");
-            } else if (info.type == NVS_TYPE_I32) {
-                int32_t val;
-                nvs_get_i32(handle, info.key, &val);
-                snprintf(value_str, sizeof(value_str), "%ld", val);
-            } else if (info.type == NVS_TYPE_U32) {
-                uint32_t val;
-                nvs_get_u32(handle, info.key, &val);
-                snprintf(value_str, sizeof(value_str), "%lu", val);
+    // The NVS library caches the partition layout, so it must not be mounted while it changes
+    bool was_initialized = nvs_flash_deinit_partition(partition->label) == ESP_OK;
+    esp_err_t err = ESP_OK;
+    size_t entries = 0;
+    if (binary) {
+        size_t received = DIFF_SECTOR_SIZE;
+        err = diff_writer_sector(&dw, img->page);
+        while (err == ESP_OK && received < req->content_len) {
+            if (recv_full(req, (char *)img->page, DIFF_SECTOR_SIZE) != DIFF_SECTOR_SIZE) {
+                err = ESP_FAIL;
+                break;
             }
-            
-            snprintf(response, sizeof(response), "{\"key\":\"%s\",\"type\":%d,\"value\":\"%s\"}", key, info.type, value_str);
-            found = true;
+            received += DIFF_SECTOR_SIZE;
+            err = diff_writer_sector(&dw, img->page);
         }
-        
-        nvs_entry_next(&it);
+        // Pages past the end of a smaller image are erased so no stale entries survive
+        memset(img->page, 0xFF, DIFF_SECTOR_SIZE);
+        while (err == ESP_OK && dw.offset < partition->size) {
+            err = diff_writer_sector(&dw, img->page);
+        }
+    } else {
+        nvs_image_writer_init(img, partition->size, nvs_import_emit, &dw);
+        uint8_t ns_index = 0;
+        for (int i = 0; i < row_count; i++) {
+            nvs_csv_apply_row(img, &rows[i], &ns_index);
+        }
+        err = nvs_image_writer_finish(img) == NVS_IMAGE_OK ? ESP_OK : ESP_FAIL;
+        entries = img->entry_count;
     }
-    nvs_close(handle);
+    if (err == ESP_OK) {
+        err = diff_writer_flush(&dw);
+    }
+    nvs_changed();
+    if (was_initialized) {
+        esp_err_t init_err = nvs_flash_init_partition(partition->label);
+        if (init_err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to re-initialize NVS partition %s: %s", partition->label, esp_err_to_name(init_err));
+        }
+    }
+    partition_unlock(partition, true);
+    diff_writer_free(&dw);
+    free(rows);
+    free(body);
+    free(img);
     
-    if (!found) {
-        snprintf(response, sizeof(response), "{\"error\":\"Key not found\"}");
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "NVS import into %s failed: %s", partition->label, esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Import failed");
+        return ESP_FAIL;
     }
     
+    ESP_LOGI(TAG, "Imported NVS %s into %s (%d pages compared, %d pages written)", format, partition->label, dw.pages_compared, dw.pages_written);
+    char response[192];
+    snprintf(response, sizeof(response),
+             "{\"status\":\"success\",\"message\":\"NVS imported\",\"entries\":%u,\"pages_compared\":%d,\"pages_written\":%d}",
+             (unsigned)entries, dw.pages_compared, dw.pages_written);
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, response, strlen(response));
+    httpd_resp_sendstr(req, response);
     return ESP_OK;
 }
 
-// HTTP NVS Delete Handler
-static esp_err_t nvs_delete_handler(httpd_req_t *req)
+// HTTP Set Boot Partition Handler
+static esp_err_t set_boot_partition_handler(httpd_req_t *req)
 {
-    char partition_name[64] = {0};
-    char key[64] = {0};
-    char *buf = malloc(512);
+    char partition_label[64] = {0};
     
-    if (!buf) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+    json_doc_t doc;
+    if (!read_json(req, JSON_SMALL_MAX_BODY, &doc)) {
         return ESP_FAIL;
     }
+    json_get_string(doc.body, doc.toks, 0, "label", partition_label, sizeof(partition_label));
+    json_doc_free(&doc);
     
-    int ret = httpd_req_recv(req, buf, 512);
-    if (ret <= 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
-        free(buf);
+    if (strlen(partition_label) == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition label required");
         return ESP_FAIL;
     }
     
-    // Parse JSON
-    char *partition_ptr = strstr(buf, "\"partition\":\"");
-    if (partition_ptr) {
-        partition_ptr += strlen("\"partition\":\"");
-        int i = 0;
-        while (partition_ptr[i] != '"' && i < 63) {
-            partition_name[i] = partition_ptr[i];
-            i++;
-        }
-        partition_name[i] = '\0';
-    }
-    
-    char *key_ptr = strstr(buf, "\"key\":\"");
-    if (key_ptr) {
-        key_ptr += strlen("\"key\":\"");
-        int i = 0;
-        while (key_ptr[i] != '"' && i < 63) {
-            key[i] = key_ptr[i];
-            i++;
-        }
-        key[i] = '\0';
-    }
-    free(buf);
-    
-    if (strlen(partition_name) == 0 || strlen(key) == 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition and key required");
+    // Find the partition
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, partition_label);
+    if (!partition) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Partition not found");
         return ESP_FAIL;
     }
     
-    nvs_handle_t handle;
-    esp_err_t err = nvs_open_from_partition(partition_name, "", NVS_READWRITE, &handle);
-    if (err != ESP_OK) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to open NVS");
+    // Not while an upload is rewriting it - the image is validated here
+    if (!partition_lock_req(req, partition, false)) {
         return ESP_FAIL;
     }
-    
-    esp_err_t del_err = nvs_erase_key(handle, key);
-    if (del_err != ESP_OK) {
-        nvs_close(handle);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to delete key");
+    esp_err_t err = esp_ota_set_boot_partition(partition);
+    partition_unlock(partition, false);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set boot partition: %s", esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to set boot partition");
         return ESP_FAIL;
     }
     
-    nvs_commit(handle);
-    nvs_close(handle);
-    
+    ESP_LOGI(TAG, "Boot partition set to: %s", partition_label);
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, "{\"status\":\"success\", \"message\":\"Key deleted\"}", HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send(req, "{\"status\":\"success\", \"message\":\"Boot partition updated\"}", HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
-// HTTP NVS Set Handler - Updates a key value in NVS partition
-static esp_err_t nvs_set_handler(httpd_req_t *req)
+// WebSocket upload - the browser streams an image in binary frames of one 4KB sector,
+// each prefixed with its big-endian sequence number (the sector index). Every
+// WS_UPLOAD_WINDOW sectors the differential writer is flushed and the device acknowledges
+// what is now on flash, with its page counters, so the UI shows real write progress and
+// the client keeps at most two windows in flight. The acknowledged offset outlives the
+// connection: a new start for the same label, size and id resumes from it. The partition
+// stays locked until then, so nothing else can rewrite it under a paused upload; the hold
+// lapses, and the resume point with it, after WS_UPLOAD_STALL_MS without a client.
+// Control messages are JSON text frames:
+//   client: {"op":"start","label":"ota_0","size":N,"id":"<client chosen image id>"}
+//   device: {"op":"ready"|"ack"|"done","offset":N,"size":N,"window":W,"pages_compared":C,"pages_written":P}
+//           {"op":"error","message":"..."}, after which the connection is closed
+// The server task only copies each frame into one of WS_UPLOAD_SLOTS buffers and queues
+// it; erasing, writing and the acks run on the ws_upload writer task, which owns the
+// session. Two windows of slots cover everything a client may have in flight, so the
+// server task never waits for flash and keeps serving other requests meanwhile.
+#define WS_UPLOAD_WINDOW 4              // Sectors per acknowledgement
+#define WS_UPLOAD_SLOTS (2 * WS_UPLOAD_WINDOW)
+#define WS_UPLOAD_STALL_MS 10000        // A silent session may be taken over, a paused one expires
+#define WS_UPLOAD_FRAME_SIZE (4 + DIFF_SECTOR_SIZE)
+#define WS_CONTROL_MAX 256
+#define WS_WRITER_STACK_SIZE 4096
+#define WS_WRITER_PRIORITY 5            // Same as the server task
+
+typedef enum {
+    WS_JOB_START,                       // buf holds the NUL terminated control message
+    WS_JOB_DATA,                        // buf is a frame slot holding len bytes
+    WS_JOB_CLOSE,                       // The connection went away
+} ws_job_type_t;
+
+typedef struct {
+    ws_job_type_t type;
+    httpd_handle_t server;
+    int fd;
+    uint8_t *buf;
+    size_t len;
+} ws_job_t;
+
+typedef struct {
+    int fd;                             // Streaming client, -1 when none
+    httpd_handle_t server;
+    const esp_partition_t *partition;   // Locked exclusively from start until the session is forgotten
+    char id[64];
+    uint32_t size;
+    uint32_t offset;                    // Bytes passed to the writer
+    uint32_t acked;                     // Bytes flushed and acknowledged - the resume point
+    int pages_compared;                 // Totals up to the acknowledged offset
+    int pages_written;
+    diff_writer_t dw;
+    TickType_t last_activity;           // Last frame, or the disconnect of a paused session
+} ws_upload_t;
+
+// Only touched by the writer task
+static ws_upload_t ws_upload = { .fd = -1 };
+
+static QueueHandle_t ws_job_queue;
+static QueueHandle_t ws_free_slots;     // Frame buffers the server task may receive into
+static uint8_t *ws_slot_pool;           // Allocated on first use and then reused
+
+// Stop streaming on the current connection; the acknowledged part stays resumable and
+// the partition stays locked
+static void ws_upload_detach(void)
 {
-    char partition_name[64] = {0};
-    char namespace_name[64] = {0};
-    char key[64] = {0};
-    char value[512] = {0};
-    int type = -1;
-    char *buf = malloc(1024);
-    
-    if (!buf) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
-        return ESP_FAIL;
+    if (ws_upload.fd < 0) {
+        return;
+    }
+    diff_writer_free(&ws_upload.dw);
+    ws_upload.fd = -1;
+    ws_upload.offset = ws_upload.acked;
+    ws_upload.last_activity = xTaskGetTickCount();
+}
+
+static void ws_upload_forget(void)
+{
+    ws_upload_detach();
+    if (ws_upload.partition) {
+        partition_unlock(ws_upload.partition, true);
+    }
+    memset(&ws_upload, 0, sizeof(ws_upload));
+    ws_upload.fd = -1;
+}
+
+static esp_err_t ws_send_text(httpd_handle_t server, int fd, const char *text)
+{
+    httpd_ws_frame_t frame = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t *)text,
+        .len = strlen(text),
+    };
+    // Queued to the server task, so this is safe from the writer task
+    return httpd_ws_send_data(server, fd, &frame);
+}
+
+// Report an error and close the connection
+static void ws_upload_error(httpd_handle_t server, int fd, const char *message)
+{
+    char msg[128];
+    ESP_LOGW(TAG, "WebSocket upload: %s", message);
+    snprintf(msg, sizeof(msg), "{\"op\":\"error\",\"message\":\"%s\"}", message);
+    ws_send_text(server, fd, msg);
+    httpd_sess_trigger_close(server, fd);
+    if (fd == ws_upload.fd) {
+        ws_upload_detach();
+    }
+}
+
+static void ws_upload_progress(const char *op)
+{
+    char msg[192];
+    snprintf(msg, sizeof(msg), "{\"op\":\"%s\",\"offset\":%lu,\"size\":%lu,\"window\":%d,\"pages_compared\":%d,\"pages_written\":%d}",
+             op, (unsigned long)ws_upload.acked, (unsigned long)ws_upload.size, WS_UPLOAD_WINDOW,
+             ws_upload.pages_compared, ws_upload.pages_written);
+    ws_send_text(ws_upload.server, ws_upload.fd, msg);
+}
+
+static void ws_upload_start(const ws_job_t *job)
+{
+    const char *msg = (const char *)job->buf;
+    json_tok_t toks[16];
+    char op[8] = {0};
+    char label[17] = {0};
+    char id[sizeof(ws_upload.id)] = {0};
+    long long size = 0;
+    
+    int count = json_parse(msg, job->len, toks, sizeof(toks) / sizeof(toks[0]));
+    if (count < 1 || toks[0].type != JSON_OBJECT) {
+        ws_upload_error(job->server, job->fd, "Invalid control message");
+        return;
+    }
+    json_get_string(msg, toks, 0, "op", op, sizeof(op));
+    json_get_string(msg, toks, 0, "label", label, sizeof(label));
+    json_get_string(msg, toks, 0, "id", id, sizeof(id));
+    if (strcmp(op, "start") != 0) {
+        ws_upload_error(job->server, job->fd, "Unknown operation");
+        return;
+    }
+    if (label[0] == '\0' || !json_get_int(msg, toks, 0, "size", &size) || size <= 0) {
+        ws_upload_error(job->server, job->fd, "Partition label and size required");
+        return;
     }
     
-    int ret = httpd_req_recv(req, buf, 1024);
-    if (ret <= 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
-        free(buf);
-        return ESP_FAIL;
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (!partition) {
+        ws_upload_error(job->server, job->fd, "Partition not found");
+        return;
+    }
+    if (size > partition->size) {
+        ws_upload_error(job->server, job->fd, "Binary larger than partition");
+        return;
     }
     
-    // Parse JSON
-    char *partition_ptr = strstr(buf, "\"partition\":\"");
-    if (partition_ptr) {
-        partition_ptr += strlen("\"partition\":\"");
-        int i = 0;
-        while (partition_ptr[i] != '"' && i < 63) {
-            partition_name[i] = partition_ptr[i];
-            i++;
+    bool resume = ws_upload.partition == partition && ws_upload.size == size && ws_upload.acked < size &&
+                  id[0] != '\0' && strcmp(ws_upload.id, id) == 0;
+    
+    // One upload at a time; a silent client loses its session to the next one, and a
+    // paused session can only be resumed until it has been idle as long
+    if (ws_upload.partition && ws_upload.fd != job->fd) {
+        bool stalled = xTaskGetTickCount() - ws_upload.last_activity >= pdMS_TO_TICKS(WS_UPLOAD_STALL_MS);
+        if (!stalled && (ws_upload.fd >= 0 || !resume)) {
+            ws_upload_error(job->server, job->fd, "Another upload is in progress");
+            return;
+        }
+        if (ws_upload.fd >= 0) {
+            ESP_LOGW(TAG, "WebSocket upload stalled at %lu bytes, taking over", (unsigned long)ws_upload.acked);
+            httpd_sess_trigger_close(ws_upload.server, ws_upload.fd);
         }
-        partition_name[i] = '\0';
     }
-    
-    char *namespace_ptr = strstr(buf, "\"namespace\":\"");
-    if (namespace_ptr) {
-        namespace_ptr += strlen("\"namespace\":\"");
-        int i = 0;
-        while (namespace_ptr[i] != '"' && i < 63) {
-            namespace_name[i] = namespace_ptr[i];
-            i++;
+    ws_upload_detach();
+    
+    // A resumed session still holds its lock, so the partition is as it was left
+    if (!resume) {
+        ws_upload_forget();
+        if (!partition_lock_try(partition, true)) {
+            ws_upload_error(job->server, job->fd, "Partition is in use by another request");
+            return;
         }
-        namespace_name[i] = '\0';
+        ws_upload.partition = partition;
+        ws_upload.size = size;
+        strlcpy(ws_upload.id, id, sizeof(ws_upload.id));
     }
     
-    char *key_ptr = strstr(buf, "\"key\":\"");
-    if (key_ptr) {
-        key_ptr += strlen("\"key\":\"");
-        int i = 0;
-        while (key_ptr[i] != '"' && i < 63) {
-            key[i] = key_ptr[i];
-            i++;
+    esp_err_t init_err = diff_writer_init(&ws_upload.dw, partition);
+    if (init_err != ESP_OK) {
+        ws_upload_error(job->server, job->fd, init_err == ESP_ERR_INVALID_STATE ? "Another flash write is in progress, retry shortly"
+                                                                                 : "Memory allocation failed");
+        if (!resume) {
+            ws_upload_forget();
         }
-        key[i] = '\0';
+        return;
     }
-    
-    char *value_ptr = strstr(buf, "\"value\":\"");
-    if (value_ptr) {
-        value_ptr += strlen("\"value\":\"");
-        int i = 0;
-        while (value_ptr[i] != '"' && i < 510) {
-            if (value_ptr[i] == '\\' && value_ptr[i+1] == '"') {
-                value[i] = '"';
-                value_ptr++;
-            } else {
-                value[i] = value_ptr[i];
-            }
-            i++;
+    ws_upload.dw.offset = ws_upload.acked;
+    ws_upload.offset = ws_upload.acked;
+    ws_upload.fd = job->fd;
+    ws_upload.server = job->server;
+    ws_upload.last_activity = xTaskGetTickCount();
+    
+    // Same as /upload: cached mounts and NVS listings would serve the old contents
+    if (partition->type == ESP_PARTITION_TYPE_DATA) {
+        fs_mount_invalidate(partition->label);
+        if (partition->subtype == ESP_PARTITION_SUBTYPE_DATA_NVS) {
+            nvs_changed();
         }
-        value[i] = '\0';
     }
     
-    char *type_ptr = strstr(buf, "\"type\":");
-    if (type_ptr) {
-        type_ptr += strlen("\"type\":");
-        sscanf(type_ptr, "%d", &type);
+    ESP_LOGI(TAG, "WebSocket upload of %lu bytes to %s %s at %lu", (unsigned long)ws_upload.size, partition->label,
+             resume ? "resumed" : "started", (unsigned long)ws_upload.acked);
+    ws_upload_progress("ready");
+}
+
+static void ws_upload_data(const ws_job_t *job)
+{
+    if (job->fd != ws_upload.fd) {
+        ws_upload_error(job->server, job->fd, "No upload started on this connection");
+        return;
     }
     
-    free(buf);
-    
-    if (strlen(partition_name) == 0 || strlen(key) == 0 || type < 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition, key, and type required");
-        return ESP_FAIL;
+    uint8_t *frame = job->buf;
+    uint32_t seq = ((uint32_t)frame[0] << 24) | ((uint32_t)frame[1] << 16) | ((uint32_t)frame[2] << 8) | frame[3];
+    size_t data_len = job->len - 4;
+    size_t expected_len = ws_upload.size - ws_upload.offset > DIFF_SECTOR_SIZE ? DIFF_SECTOR_SIZE : ws_upload.size - ws_upload.offset;
+    if (seq != ws_upload.offset / DIFF_SECTOR_SIZE || data_len != expected_len) {
+        ws_upload_error(job->server, job->fd, "Unexpected sequence number or frame length");
+        return;
     }
     
-    // Open NVS partition with the specified namespace
-    nvs_handle_t handle;
-    esp_err_t err = nvs_open_from_partition(partition_name, namespace_name, NVS_READWRITE, &handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS partition '%s' namespace '%s': %s", partition_name, namespace_name, esp_err_to_name(err));
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to open NVS");
-        return ESP_FAIL;
+    // The sector is written in place after the sequence number; pad a partial last one
+    uint8_t *sector = frame + 4;
+    if (data_len < DIFF_SECTOR_SIZE) {
+        memset(sector + data_len, 0xFF, DIFF_SECTOR_SIZE - data_len);
+    }
+    if (diff_writer_sector(&ws_upload.dw, sector) != ESP_OK) {
+        ws_upload_error(job->server, job->fd, "Write failed");
+        return;
     }
+    ws_upload.offset += data_len;
+    ws_upload.last_activity = xTaskGetTickCount();
     
-    // Write value based on type
-    esp_err_t write_err = ESP_OK;
-    switch (type) {
-        case 0: { // U8
-            uint8_t val = (uint8_t)atoi(value);
-            write_err = nvs_set_u8(handle, key, val);
-            break;
+    bool complete = ws_upload.offset == ws_upload.size;
+    if (!complete && (ws_upload.offset / DIFF_SECTOR_SIZE) % WS_UPLOAD_WINDOW != 0) {
+        return;
+    }
+    if (diff_writer_flush(&ws_upload.dw) != ESP_OK) {
+        ws_upload_error(job->server, job->fd, "Write failed");
+        return;
+    }
+    ws_upload.pages_compared += ws_upload.dw.pages_compared;
+    ws_upload.pages_written += ws_upload.dw.pages_written;
+    ws_upload.dw.pages_compared = ws_upload.dw.pages_written = 0;
+    ws_upload.acked = ws_upload.offset;
+    
+    // Acknowledge only now that the window is on flash
+    if (!complete) {
+        ws_upload_progress("ack");
+        return;
+    }
+    ESP_LOGI(TAG, "WebSocket upload to %s complete: %lu bytes (%d pages compared, %d pages written)", ws_upload.partition->label,
+             (unsigned long)ws_upload.size, ws_upload.pages_compared, ws_upload.pages_written);
+    ws_upload_progress("done");
+    ws_upload_forget();
+}
+
+// Jobs arrive in the order the server task saw them, so a close is always handled
+// after the frames that preceded it and before anything on a reused descriptor
+static void ws_upload_writer_task(void *arg)
+{
+    ws_job_t job;
+    while (1) {
+        // Wake up to release the partition of a paused session nobody came back for
+        TickType_t wait = portMAX_DELAY;
+        if (ws_upload.partition && ws_upload.fd < 0) {
+            TickType_t idle = xTaskGetTickCount() - ws_upload.last_activity;
+            wait = idle < pdMS_TO_TICKS(WS_UPLOAD_STALL_MS) ? pdMS_TO_TICKS(WS_UPLOAD_STALL_MS) - idle : 0;
         }
-        case 1: { // I8
-            int8_t val = (int8_t)atoi(value);
-            write_err = nvs_set_i8(handle, key, val);
-            break;
+        if (xQueueReceive(ws_job_queue, &job, wait) != pdTRUE) {
+            if (ws_upload.partition && ws_upload.fd < 0 &&
+                xTaskGetTickCount() - ws_upload.last_activity >= pdMS_TO_TICKS(WS_UPLOAD_STALL_MS)) {
+                ESP_LOGW(TAG, "Paused WebSocket upload to %s expired at %lu of %lu bytes", ws_upload.partition->label,
+                         (unsigned long)ws_upload.acked, (unsigned long)ws_upload.size);
+                ws_upload_forget();
+            }
+            continue;
         }
-        case 2: { // U16
-            uint16_t val = (uint16_t)atoi(value);
-            write_err = nvs_set_u16(handle, key, val);
+        switch (job.type) {
+        case WS_JOB_START:
+            ws_upload_start(&job);
+            free(job.buf);
             break;
-        }
-        case 3: { // I16
-            int16_t val = (int16_t)atoi(value);
-            write_err = nvs_set_i16(handle, key, val);
+        case WS_JOB_DATA:
+            ws_upload_data(&job);
+            xQueueSend(ws_free_slots, &job.buf, 0);
             break;
-        }
-        case 4: { // U32
-            uint32_t val = (uint32_t)strtoul(value, NULL, 10);
-            write_err = nvs_set_u32(handle, key, val);
+        case WS_JOB_CLOSE:
+            if (job.fd == ws_upload.fd) {
+                ESP_LOGW(TAG, "WebSocket upload connection closed at %lu of %lu bytes",
+                         (unsigned long)ws_upload.acked, (unsigned long)ws_upload.size);
+                ws_upload_detach();
+            }
             break;
         }
-        case 5: { // I32
-            int32_t val = (int32_t)strtol(value, NULL, 10);
-            write_err = nvs_set_i32(handle, key, val);
-            break;
+    }
+}
+
+static bool ws_upload_writer_start(void)
+{
+    // Room for every slot plus a few start and close messages
+    ws_job_queue = xQueueCreate(WS_UPLOAD_SLOTS + 4, sizeof(ws_job_t));
+    ws_free_slots = xQueueCreate(WS_UPLOAD_SLOTS, sizeof(uint8_t *));
+    if (!ws_job_queue || !ws_free_slots) {
+        return false;
+    }
+    return xTaskCreate(ws_upload_writer_task, "ws_upload", WS_WRITER_STACK_SIZE, NULL, WS_WRITER_PRIORITY, NULL) == pdPASS;
+}
+
+// Session context of a connection that has sent a start; freeing it when the server
+// deletes the session tells the writer the connection is gone
+static void ws_upload_conn_free(void *ctx)
+{
+    ws_job_t job = { .type = WS_JOB_CLOSE, .fd = *(int *)ctx };
+    if (xQueueSend(ws_job_queue, &job, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ESP_LOGE(TAG, "WebSocket upload queue full, close of socket %d lost", job.fd);
+    }
+    free(ctx);
+}
+
+// Errors found before a frame reaches the writer; the server closes the connection
+// when the handler fails
+static esp_err_t ws_upload_reject(httpd_req_t *req, const char *message)
+{
+    char msg[128];
+    ESP_LOGW(TAG, "WebSocket upload: %s", message);
+    snprintf(msg, sizeof(msg), "{\"op\":\"error\",\"message\":\"%s\"}", message);
+    httpd_ws_frame_t frame = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t *)msg,
+        .len = strlen(msg),
+    };
+    httpd_ws_send_frame(req, &frame);
+    return ESP_FAIL;
+}
+
+// HTTP WebSocket Upload Handler - called for the handshake and then once per frame
+static esp_err_t ws_upload_handler(httpd_req_t *req)
+{
+    if (req->method == HTTP_GET) {
+        ESP_LOGI(TAG, "WebSocket upload connection opened");
+        return ESP_OK;
+    }
+    
+    httpd_ws_frame_t frame = {0};
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (frame.type != HTTPD_WS_TYPE_TEXT && frame.type != HTTPD_WS_TYPE_BINARY) {
+        return ESP_OK;
+    }
+    if (!ws_job_queue) {
+        return ws_upload_reject(req, "WebSocket uploads are unavailable");
+    }
+    
+    ws_job_t job = { .server = req->handle, .fd = httpd_req_to_sockfd(req) };
+    if (frame.type == HTTPD_WS_TYPE_TEXT) {
+        if (frame.len >= WS_CONTROL_MAX) {
+            return ws_upload_reject(req, "Control message too long");
         }
-        case 6: { // U64
-            uint64_t val = (uint64_t)strtoull(value, NULL, 10);
-            write_err = nvs_set_u64(handle, key, val);
-            break;
+        if (!ws_slot_pool) {
+            ws_slot_pool = malloc(WS_UPLOAD_SLOTS * WS_UPLOAD_FRAME_SIZE);
+            if (!ws_slot_pool) {
+                return ws_upload_reject(req, "Memory allocation failed");
+            }
+            for (int i = 0; i < WS_UPLOAD_SLOTS; i++) {
+                uint8_t *slot = ws_slot_pool + i * WS_UPLOAD_FRAME_SIZE;
+                xQueueSend(ws_free_slots, &slot, 0);
+            }
         }
-        case 7: { // I64
-            int64_t val = (int64_t)strtoll(value, NULL, 10);
-            write_err = nvs_set_i64(handle, key, val);
-            break;
+        if (!req->sess_ctx) {
+            int *ctx = malloc(sizeof(int));
+            if (!ctx) {
+                return ws_upload_reject(req, "Memory allocation failed");
+            }
+            *ctx = job.fd;
+            req->sess_ctx = ctx;
+            req->free_ctx = ws_upload_conn_free;
         }
-        case 8: { // STR
-            write_err = nvs_set_str(handle, key, value);
-            break;
+        
+        job.type = WS_JOB_START;
+        job.buf = malloc(frame.len + 1);
+        if (!job.buf) {
+            return ws_upload_reject(req, "Memory allocation failed");
         }
-        case 9: { // BLOB
-            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Cannot edit BLOB data");
-            nvs_close(handle);
-            return ESP_FAIL;
+        frame.payload = job.buf;
+        err = httpd_ws_recv_frame(req, &frame, frame.len);
+        if (err != ESP_OK) {
+            free(job.buf);
+            return err;
         }
-        default:
-            write_err = ESP_ERR_NVS_TYPE_MISMATCH;
+        job.buf[frame.len] = '\0';
+        job.len = frame.len;
+        if (xQueueSend(ws_job_queue, &job, 0) != pdTRUE) {
+            free(job.buf);
+            return ws_upload_reject(req, "Upload queue is full, retry shortly");
+        }
+        return ESP_OK;
     }
     
-    if (write_err != ESP_OK) {
-        nvs_close(handle);
-        ESP_LOGE(TAG, "Failed to write NVS key: %s", esp_err_to_name(write_err));
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to write key");
-        return ESP_FAIL;
+    if (frame.len <= 4 || frame.len > WS_UPLOAD_FRAME_SIZE) {
+        return ws_upload_reject(req, "Invalid data frame");
+    }
+    // A client within its window always finds a free slot
+    if (!req->sess_ctx) {
+        return ws_upload_reject(req, "No upload started on this connection");
+    }
+    job.type = WS_JOB_DATA;
+    if (xQueueReceive(ws_free_slots, &job.buf, 0) != pdTRUE) {
+        return ws_upload_reject(req, "Too many frames in flight");
+    }
+    frame.payload = job.buf;
+    err = httpd_ws_recv_frame(req, &frame, WS_UPLOAD_FRAME_SIZE);
+    job.len = frame.len;
+    if (err != ESP_OK || xQueueSend(ws_job_queue, &job, 0) != pdTRUE) {
+        xQueueSend(ws_free_slots, &job.buf, 0);
+        return err != ESP_OK ? err : ws_upload_reject(req, "Upload queue is full, retry shortly");
     }
-    
-    nvs_commit(handle);
-    nvs_close(handle);
-    
-    ESP_LOGI(TAG, "Successfully updated NVS key '%s' in namespace '%s' partition '%s'", key, namespace_name, partition_name);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, "{\"status\":\"success\", \"message\":\"Key updated\"}", HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
-// HTTP Set Boot Partition Handler
-static esp_err_t set_boot_partition_handler(httpd_req_t *req)
+// Async request handling - esp_http_server runs every handler on its own single task, so
+// long transfers are handed to a small worker pool instead. The server task then keeps
+// answering /status polls, captive-portal probes and UI loads while a flash is running.
+// Routes using this register async_dispatch_handler with the real handler as user_ctx.
+#define ASYNC_WORKER_COUNT 2            // One per transfer buffer in the xfer pool
+#define ASYNC_WORKER_STACK_SIZE 8192    // Same as the server task
+#define ASYNC_WORKER_PRIORITY 5         // Same as the server task
+
+typedef esp_err_t (*async_handler_t)(httpd_req_t *req);
+
+typedef struct {
+    httpd_req_t *req;
+    async_handler_t handler;
+} async_job_t;
+
+static QueueHandle_t async_job_queue;
+static SemaphoreHandle_t async_workers_idle;
+
+static void async_worker_task(void *arg)
 {
-    char partition_label[64] = {0};
-    char *buf = malloc(512);
-    
-    if (!buf) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
-        return ESP_FAIL;
+    async_job_t job;
+    while (1) {
+        if (xQueueReceive(async_job_queue, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        ESP_LOGI(TAG, "Async worker running %s", job.req->uri);
+        if (job.handler(job.req) != ESP_OK) {
+            // As on the server task, a failed handler's connection is closed since its
+            // body may be only partly read
+            httpd_sess_trigger_close(job.req->handle, httpd_req_to_sockfd(job.req));
+        }
+        httpd_req_async_handler_complete(job.req);
+        xSemaphoreGive(async_workers_idle);
+    }
+}
+
+static bool async_workers_start(void)
+{
+    async_job_queue = xQueueCreate(ASYNC_WORKER_COUNT, sizeof(async_job_t));
+    async_workers_idle = xSemaphoreCreateCounting(ASYNC_WORKER_COUNT, ASYNC_WORKER_COUNT);
+    if (!async_job_queue || !async_workers_idle) {
+        return false;
     }
-    
-    int ret = httpd_req_recv(req, buf, 512);
-    if (ret <= 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
-        free(buf);
-        return ESP_FAIL;
+    for (int i = 0; i < ASYNC_WORKER_COUNT; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "http_async_%d", i);
+        if (xTaskCreate(async_worker_task, name, ASYNC_WORKER_STACK_SIZE, NULL, ASYNC_WORKER_PRIORITY, NULL) != pdPASS) {
+            return false;
+        }
     }
+    return true;
+}
+
+// Hand the request to an idle worker; with every worker busy answer 503 right away
+// rather than stalling the server task behind another transfer. The unread body would be
+// drained on the server task, so the connection is closed instead.
+static esp_err_t async_dispatch_handler(httpd_req_t *req)
+{
+    async_handler_t handler = (async_handler_t)req->user_ctx;
     
-    // Parse JSON to get partition label
-    char *label_ptr = strstr(buf, "\"label\":\"");
-    if (label_ptr) {
-        label_ptr += strlen("\"label\":\"");
-        int i = 0;
-        while (label_ptr[i] != '"' && i < 63) {
-            partition_label[i] = label_ptr[i];
-            i++;
-        }
-        partition_label[i] = '\0';
+    if (!async_job_queue) {
+        return handler(req);
     }
-    free(buf);
     
-    if (strlen(partition_label) == 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Partition label required");
+    if (xSemaphoreTake(async_workers_idle, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "All async workers busy, rejecting %s", req->uri);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "5");
+        httpd_resp_sendstr(req, "Another transfer is in progress, retry shortly");
         return ESP_FAIL;
     }
     
-    // Find the partition
-    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, partition_label);
-    if (!partition) {
-        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Partition not found");
+    async_job_t job = { .handler = handler };
+    if (httpd_req_async_handler_begin(req, &job.req) != ESP_OK) {
+        xSemaphoreGive(async_workers_idle);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to start async request");
         return ESP_FAIL;
     }
     
-    // Set the boot partition
-    esp_err_t err = esp_ota_set_boot_partition(partition);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to set boot partition: %s", esp_err_to_name(err));
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to set boot partition");
+    // Cannot block: the idle count guarantees a free queue slot
+    if (xQueueSend(async_job_queue, &job, 0) != pdTRUE) {
+        httpd_req_async_handler_complete(job.req);
+        xSemaphoreGive(async_workers_idle);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to queue request");
         return ESP_FAIL;
     }
-    
-    ESP_LOGI(TAG, "Boot partition set to: %s", partition_label);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, "{\"status\":\"success\", \"message\":\"Boot partition updated\"}", HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
@@ -1441,27 +4989,42 @@ static httpd_handle_t start_webserver(void)
 {
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.max_uri_handlers = 21;  // Increase to accommodate all URI handlers
+    config.max_uri_handlers = 34 + ui_assets_count;  // API handlers plus one per embedded UI asset
     config.max_open_sockets = 13;
     config.lru_purge_enable = true;
     config.stack_size = 8192;  // Increase stack size to prevent overflow
 
+    if (!ws_upload_writer_start()) {
+        ESP_LOGW(TAG, "WebSocket upload writer unavailable");
+        ws_job_queue = NULL;
+    }
+    if (!async_workers_start()) {
+        ESP_LOGW(TAG, "Async workers unavailable, long transfers will run on the server task");
+        async_job_queue = NULL;
+    }
+
     ESP_LOGI(TAG, "Starting web server on port: %d", config.server_port);
     if (httpd_start(&server, &config) == ESP_OK) {
-        httpd_uri_t root = { .uri = "/", .method = HTTP_GET, .handler = root_get_handler };
-        httpd_register_uri_handler(server, &root);
+        // Register the UI: "/" plus its fingerprinted CSS/JS
+        for (size_t i = 0; i < ui_assets_count; i++) {
+            httpd_uri_t asset = { .uri = ui_assets[i].uri, .method = HTTP_GET, .handler = ui_asset_handler, .user_ctx = (void *)&ui_assets[i] };
+            httpd_register_uri_handler(server, &asset);
+        }
         
-        httpd_uri_t upload = { .uri = "/upload", .method = HTTP_POST, .handler = upload_post_handler };
+        httpd_uri_t upload = { .uri = "/upload", .method = HTTP_POST, .handler = async_dispatch_handler, .user_ctx = (void *)upload_post_handler };
         httpd_register_uri_handler(server, &upload);
         
+        httpd_uri_t ws_upload_uri = { .uri = "/ws/upload", .method = HTTP_GET, .handler = ws_upload_handler, .is_websocket = true };
+        httpd_register_uri_handler(server, &ws_upload_uri);
+        
         // Register general download handler
-        httpd_uri_t download = { .uri = "/download", .method = HTTP_GET, .handler = download_partition_handler };
+        httpd_uri_t download = { .uri = "/download", .method = HTTP_GET, .handler = async_dispatch_handler, .user_ctx = (void *)download_partition_handler };
         httpd_register_uri_handler(server, &download);
 
         httpd_uri_t status = { .uri = "/status", .method = HTTP_GET, .handler = status_get_handler };
         httpd_register_uri_handler(server, &status);
         
-        httpd_uri_t clear = { .uri = "/clear", .method = HTTP_POST, .handler = clear_partition_handler };
+        httpd_uri_t clear = { .uri = "/clear", .method = HTTP_POST, .handler = async_dispatch_handler, .user_ctx = (void *)clear_partition_handler };
         httpd_register_uri_handler(server, &clear);
         
         // Register boot partition handler
@@ -1475,19 +5038,43 @@ static httpd_handle_t start_webserver(void)
         httpd_uri_t spiffs_list = { .uri = "/spiffs/list", .method = HTTP_GET, .handler = spiffs_list_handler };
         httpd_register_uri_handler(server, &spiffs_list);
         
-        httpd_uri_t spiffs_upload = { .uri = "/spiffs/upload", .method = HTTP_POST, .handler = spiffs_upload_handler };
+        httpd_uri_t spiffs_upload = { .uri = "/spiffs/upload", .method = HTTP_POST, .handler = async_dispatch_handler, .user_ctx = (void *)spiffs_upload_handler };
         httpd_register_uri_handler(server, &spiffs_upload);
         
-        httpd_uri_t spiffs_download = { .uri = "/spiffs/download", .method = HTTP_GET, .handler = spiffs_download_handler };
+        httpd_uri_t spiffs_upload_archive = { .uri = "/spiffs/upload_archive", .method = HTTP_POST, .handler = async_dispatch_handler, .user_ctx = (void *)spiffs_upload_archive_handler };
+        httpd_register_uri_handler(server, &spiffs_upload_archive);
+        
+        httpd_uri_t spiffs_info = { .uri = "/spiffs/info", .method = HTTP_GET, .handler = spiffs_info_handler };
+        httpd_register_uri_handler(server, &spiffs_info);
+        
+        httpd_uri_t spiffs_export = { .uri = "/spiffs/export", .method = HTTP_GET, .handler = async_dispatch_handler, .user_ctx = (void *)spiffs_export_handler };
+        httpd_register_uri_handler(server, &spiffs_export);
+        
+        httpd_uri_t spiffs_manifest = { .uri = "/spiffs/manifest", .method = HTTP_GET, .handler = async_dispatch_handler, .user_ctx = (void *)spiffs_manifest_handler };
+        httpd_register_uri_handler(server, &spiffs_manifest);
+        
+        httpd_uri_t spiffs_sync = { .uri = "/spiffs/sync", .method = HTTP_POST, .handler = async_dispatch_handler, .user_ctx = (void *)spiffs_sync_handler };
+        httpd_register_uri_handler(server, &spiffs_sync);
+        
+        httpd_uri_t spiffs_download = { .uri = "/spiffs/download", .method = HTTP_GET, .handler = async_dispatch_handler, .user_ctx = (void *)spiffs_download_handler };
         httpd_register_uri_handler(server, &spiffs_download);
         
         httpd_uri_t spiffs_delete = { .uri = "/spiffs/delete", .method = HTTP_POST, .handler = spiffs_delete_handler };
         httpd_register_uri_handler(server, &spiffs_delete);
         
+        httpd_uri_t spiffs_delete_bulk = { .uri = "/spiffs/delete_bulk", .method = HTTP_POST, .handler = async_dispatch_handler, .user_ctx = (void *)spiffs_delete_bulk_handler };
+        httpd_register_uri_handler(server, &spiffs_delete_bulk);
+        
+        httpd_uri_t spiffs_format = { .uri = "/spiffs/format", .method = HTTP_POST, .handler = async_dispatch_handler, .user_ctx = (void *)spiffs_format_handler };
+        httpd_register_uri_handler(server, &spiffs_format);
+        
         // Register NVS handlers
         httpd_uri_t nvs_list = { .uri = "/nvs/list", .method = HTTP_GET, .handler = nvs_list_handler };
         httpd_register_uri_handler(server, &nvs_list);
         
+        httpd_uri_t nvs_stats = { .uri = "/nvs/stats", .method = HTTP_GET, .handler = nvs_stats_handler };
+        httpd_register_uri_handler(server, &nvs_stats);
+        
         httpd_uri_t nvs_get = { .uri = "/nvs/get", .method = HTTP_GET, .handler = nvs_get_handler };
         httpd_register_uri_handler(server, &nvs_get);
         
@@ -1497,11 +5084,784 @@ static httpd_handle_t start_webserver(void)
         httpd_uri_t nvs_set = { .uri = "/nvs/set", .method = HTTP_POST, .handler = nvs_set_handler };
         httpd_register_uri_handler(server, &nvs_set);
         
+        httpd_uri_t nvs_batch = { .uri = "/nvs/batch", .method = HTTP_POST, .handler = nvs_batch_handler };
+        httpd_register_uri_handler(server, &nvs_batch);
+        
+        httpd_uri_t nvs_blob_get = { .uri = "/nvs/blob", .method = HTTP_GET, .handler = nvs_blob_get_handler };
+        httpd_register_uri_handler(server, &nvs_blob_get);
+        
+        httpd_uri_t nvs_blob_put = { .uri = "/nvs/blob", .method = HTTP_PUT, .handler = nvs_blob_put_handler };
+        httpd_register_uri_handler(server, &nvs_blob_put);
+        
+        httpd_uri_t nvs_export = { .uri = "/nvs/export", .method = HTTP_GET, .handler = async_dispatch_handler, .user_ctx = (void *)nvs_export_handler };
+        httpd_register_uri_handler(server, &nvs_export);
+        
+        httpd_uri_t nvs_import = { .uri = "/nvs/import", .method = HTTP_POST, .handler = async_dispatch_handler, .user_ctx = (void *)nvs_import_handler };
+        httpd_register_uri_handler(server, &nvs_import);
+        
         httpd_register_err_handler(server, HTTPD_404_NOT_FOUND, http_404_handler);
     }
     return server;
 }
 
+// Raw TCP bulk transfer service - a minimal framed protocol for scripted flashing that
+// skips HTTP request parsing and chunked encoding. One client is served at a time and a
+// connection may carry several commands (e.g. upload then hash). All integers are big-endian.
+//
+// Request (32 bytes):  "ERB1" | cmd u8 | 3 reserved | label char[16], NUL padded | offset u32 | length u32
+//   'U' upload:   length bytes follow and are written from offset (a multiple of 4KB) through
+//                 the differential writer; a partial last sector is padded with 0xFF
+//   'D' download: length bytes from offset, 0 = to the end of the partition
+//   'H' hash:     SHA-256 of length bytes from offset, 0 = to the end of the partition
+// Response (12 bytes): "ERB1" | status u8 | 3 reserved | payload length u32, then the payload
+//   upload: pages_compared u32 | pages_written u32; download: the data; hash: 32 bytes
+// After an error response the connection is closed, since request data may be left unread.
+#define BULK_MAGIC "ERB1"
+#define BULK_REQ_SIZE 32
+#define BULK_RESP_SIZE 12
+#define BULK_SOCKET_TIMEOUT_S 10
+
+typedef enum {
+    BULK_OK = 0,
+    BULK_ERR_BAD_REQUEST = 1,
+    BULK_ERR_NOT_FOUND = 2,
+    BULK_ERR_BUSY = 3,          // Partition locked by another request
+    BULK_ERR_TOO_LARGE = 4,     // Range outside the partition
+    BULK_ERR_IO = 5,
+} bulk_status_t;
+
+static void bulk_put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t bulk_get_u32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static bool bulk_recv_all(int sock, void *buf, size_t len)
+{
+    size_t filled = 0;
+    while (filled < len) {
+        int n = recv(sock, (char *)buf + filled, len - filled, 0);
+        if (n <= 0) {
+            return false;
+        }
+        filled += n;
+    }
+    return true;
+}
+
+static bool bulk_send_all(int sock, const void *buf, size_t len)
+{
+    size_t sent = 0;
+    while (sent < len) {
+        int n = send(sock, (const char *)buf + sent, len - sent, 0);
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+static bool bulk_send_resp(int sock, bulk_status_t status, uint32_t payload_len)
+{
+    uint8_t resp[BULK_RESP_SIZE] = {0};
+    memcpy(resp, BULK_MAGIC, 4);
+    resp[4] = status;
+    bulk_put_u32(resp + 8, payload_len);
+    return bulk_send_all(sock, resp, sizeof(resp));
+}
+
+// Report an error; the connection is then closed since request data may be left unread
+static bool bulk_fail(int sock, bulk_status_t status)
+{
+    bulk_send_resp(sock, status, 0);
+    return false;
+}
+
+// Each command returns false when the connection should be closed
+static bool bulk_upload(int sock, const esp_partition_t *partition, uint32_t offset, uint32_t length)
+{
+    if (offset % DIFF_SECTOR_SIZE != 0) {
+        return bulk_fail(sock, BULK_ERR_BAD_REQUEST);
+    }
+    if (offset > partition->size || length > partition->size - offset) {
+        return bulk_fail(sock, BULK_ERR_TOO_LARGE);
+    }
+    if (!partition_lock_try(partition, true)) {
+        return bulk_fail(sock, BULK_ERR_BUSY);
+    }
+    
+    // Same as /upload: cached mounts and NVS listings would serve the old contents
+    if (partition->type == ESP_PARTITION_TYPE_DATA) {
+        fs_mount_invalidate(partition->label);
+        if (partition->subtype == ESP_PARTITION_SUBTYPE_DATA_NVS) {
+            nvs_changed();
+        }
+    }
+    
+    diff_writer_t dw;
+    char *page_buf = malloc(DIFF_SECTOR_SIZE);
+    esp_err_t init_err = page_buf ? diff_writer_init(&dw, partition) : ESP_ERR_NO_MEM;
+    if (init_err != ESP_OK) {
+        free(page_buf);
+        partition_unlock(partition, true);
+        return bulk_fail(sock, init_err == ESP_ERR_INVALID_STATE ? BULK_ERR_BUSY : BULK_ERR_IO);
+    }
+    dw.offset = offset;
+    
+    ESP_LOGI(TAG, "Bulk upload of %lu bytes to %s at 0x%lx", (unsigned long)length, partition->label, (unsigned long)offset);
+    bulk_status_t status = BULK_OK;
+    uint32_t received = 0;
+    while (received < length) {
+        size_t to_recv = length - received > DIFF_SECTOR_SIZE ? DIFF_SECTOR_SIZE : length - received;
+        if (!bulk_recv_all(sock, page_buf, to_recv)) {
+            ESP_LOGE(TAG, "Bulk upload connection lost after %lu bytes", (unsigned long)received);
+            status = BULK_ERR_IO;
+            break;
+        }
+        if (to_recv < DIFF_SECTOR_SIZE) {
+            memset(page_buf + to_recv, 0xFF, DIFF_SECTOR_SIZE - to_recv);
+        }
+        if (diff_writer_sector(&dw, page_buf) != ESP_OK) {
+            status = BULK_ERR_IO;
+            break;
+        }
+        received += to_recv;
+    }
+    if (status == BULK_OK && diff_writer_flush(&dw) != ESP_OK) {
+        status = BULK_ERR_IO;
+    }
+    free(page_buf);
+    diff_writer_free(&dw);
+    partition_unlock(partition, true);
+    
+    if (status != BULK_OK) {
+        return bulk_fail(sock, status);
+    }
+    ESP_LOGI(TAG, "Bulk upload to %s done (%d pages compared, %d pages written)", partition->label, dw.pages_compared, dw.pages_written);
+    uint8_t payload[8];
+    bulk_put_u32(payload, dw.pages_compared);
+    bulk_put_u32(payload + 4, dw.pages_written);
+    return bulk_send_resp(sock, BULK_OK, sizeof(payload)) && bulk_send_all(sock, payload, sizeof(payload));
+}
+
+// Download or hash a range; both stream it through one transfer buffer
+static bool bulk_read(int sock, const esp_partition_t *partition, uint32_t offset, uint32_t length, bool hash)
+{
+    if (offset > partition->size) {
+        return bulk_fail(sock, BULK_ERR_TOO_LARGE);
+    }
+    if (length == 0) {
+        length = partition->size - offset;
+    }
+    if (length > partition->size - offset) {
+        return bulk_fail(sock, BULK_ERR_TOO_LARGE);
+    }
+    if (!partition_lock_try(partition, false)) {
+        return bulk_fail(sock, BULK_ERR_BUSY);
+    }
+    char *buf = xfer_buf_acquire();
+    if (!buf) {
+        partition_unlock(partition, false);
+        return bulk_fail(sock, BULK_ERR_IO);
+    }
+    
+    // A download sends its header first, so a later read error can only drop the connection
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    bulk_status_t status = BULK_OK;
+    if (!hash && !bulk_send_resp(sock, BULK_OK, length)) {
+        status = BULK_ERR_IO;
+    }
+    for (uint32_t done = 0; status == BULK_OK && done < length; ) {
+        size_t n = length - done > XFER_BUF_SIZE ? XFER_BUF_SIZE : length - done;
+        if (esp_partition_read(partition, offset + done, buf, n) != ESP_OK) {
+            status = BULK_ERR_IO;
+        } else if (hash) {
+            mbedtls_sha256_update(&ctx, (const unsigned char *)buf, n);
+        } else if (!bulk_send_all(sock, buf, n)) {
+            status = BULK_ERR_IO;
+        }
+        done += n;
+    }
+    uint8_t digest[32];
+    if (hash && status == BULK_OK) {
+        mbedtls_sha256_finish(&ctx, digest);
+    }
+    mbedtls_sha256_free(&ctx);
+    xfer_buf_release(buf);
+    partition_unlock(partition, false);
+    
+    ESP_LOGI(TAG, "Bulk %s of %s (%lu bytes at 0x%lx): %s", hash ? "hash" : "download", partition->label,
+             (unsigned long)length, (unsigned long)offset, status == BULK_OK ? "done" : "failed");
+    if (!hash) {
+        return status == BULK_OK;
+    }
+    if (status != BULK_OK) {
+        return bulk_fail(sock, status);
+    }
+    return bulk_send_resp(sock, BULK_OK, sizeof(digest)) && bulk_send_all(sock, digest, sizeof(digest));
+}
+
+static bool bulk_handle_command(int sock)
+{
+    uint8_t req[BULK_REQ_SIZE];
+    if (!bulk_recv_all(sock, req, sizeof(req))) {
+        return false;       // Client closed the connection
+    }
+    
+    char label[17] = {0};
+    memcpy(label, req + 8, 16);
+    uint32_t offset = bulk_get_u32(req + 24);
+    uint32_t length = bulk_get_u32(req + 28);
+    if (memcmp(req, BULK_MAGIC, 4) != 0) {
+        ESP_LOGW(TAG, "Bulk request without magic, closing connection");
+        return bulk_fail(sock, BULK_ERR_BAD_REQUEST);
+    }
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (!partition) {
+        ESP_LOGW(TAG, "Bulk command '%c': partition %s not found", req[4], label);
+        return bulk_fail(sock, BULK_ERR_NOT_FOUND);
+    }
+    
+    switch (req[4]) {
+    case 'U':
+        return bulk_upload(sock, partition, offset, length);
+    case 'D':
+        return bulk_read(sock, partition, offset, length, false);
+    case 'H':
+        return bulk_read(sock, partition, offset, length, true);
+    default:
+        return bulk_fail(sock, BULK_ERR_BAD_REQUEST);
+    }
+}
+
+static void bulk_server_task(void *arg)
+{
+    int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (listen_sock < 0) {
+        ESP_LOGE(TAG, "Bulk transfer service: failed to create socket (errno %d)", errno);
+        vTaskDelete(NULL);
+        return;
+    }
+    int opt = 1;
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_BULK_TRANSFER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_sock, 1) != 0) {
+        ESP_LOGE(TAG, "Bulk transfer service: failed to listen on port %d (errno %d)", CONFIG_BULK_TRANSFER_PORT, errno);
+        close(listen_sock);
+        vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(TAG, "Bulk transfer service listening on port %d", CONFIG_BULK_TRANSFER_PORT);
+    
+    while (1) {
+        int sock = accept(listen_sock, NULL, NULL);
+        if (sock < 0) {
+            ESP_LOGW(TAG, "Bulk transfer accept failed (errno %d)", errno);
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+        // A stalled client must not hold the partition lock forever
+        struct timeval timeout = { .tv_sec = BULK_SOCKET_TIMEOUT_S };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        
+        ESP_LOGI(TAG, "Bulk transfer client connected");
+        while (bulk_handle_command(sock)) {
+        }
+        shutdown(sock, SHUT_RDWR);
+        close(sock);
+        ESP_LOGI(TAG, "Bulk transfer client disconnected");
+    }
+}
+
+
+// TFTP service (RFC 1350) with the blksize, timeout and tsize options (RFC 2348, RFC 2349)
+// and windowsize (RFC 7440), for bench and PXE-style tools. The filename is a partition
+// label ("ota_0", "/ota_0" or "ota_0.bin"); only octet mode is supported.
+//   WRQ: the image is written from offset 0 through the differential writer, like /upload
+//   RRQ: the whole partition is sent
+// One transfer is served at a time from its own socket (its transfer ID); requests that
+// arrive meanwhile wait in the listening socket's queue.
+#define TFTP_OP_RRQ 1
+#define TFTP_OP_WRQ 2
+#define TFTP_OP_DATA 3
+#define TFTP_OP_ACK 4
+#define TFTP_OP_ERROR 5
+#define TFTP_OP_OACK 6
+
+#define TFTP_ERR_UNDEFINED 0
+#define TFTP_ERR_NOT_FOUND 1
+#define TFTP_ERR_ACCESS 2
+#define TFTP_ERR_DISK_FULL 3
+#define TFTP_ERR_ILLEGAL_OP 4
+
+#define TFTP_REQ_MAX 512
+#define TFTP_DEFAULT_BLKSIZE 512
+#define TFTP_MAX_BLKSIZE 1468       // Largest block that fits a 1500 byte MTU without IP fragmentation
+#define TFTP_MAX_WINDOW 16          // Keep a write window within CONFIG_LWIP_UDP_RECVMBOX_SIZE
+#define TFTP_DEFAULT_TIMEOUT_S 2
+#define TFTP_MAX_RETRIES 5
+
+typedef struct {
+    int sock;                       // Connected to the client's transfer ID
+    const esp_partition_t *partition;
+    uint16_t blksize;
+    uint16_t windowsize;
+    uint8_t timeout_s;
+    uint8_t *pkt;                   // 4 + TFTP_MAX_BLKSIZE bytes
+    uint8_t oack[TFTP_REQ_MAX];     // Option acknowledgment, oack_len 0 when no option was accepted
+    size_t oack_len;
+} tftp_xfer_t;
+
+static void tftp_put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static uint16_t tftp_get_u16(const uint8_t *p)
+{
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static void tftp_send_error(int sock, uint16_t code, const char *msg)
+{
+    uint8_t pkt[4 + 64];
+    size_t len = strnlen(msg, sizeof(pkt) - 5);
+    tftp_put_u16(pkt, TFTP_OP_ERROR);
+    tftp_put_u16(pkt + 2, code);
+    memcpy(pkt + 4, msg, len);
+    pkt[4 + len] = '\0';
+    send(sock, pkt, 5 + len, 0);
+}
+
+static void tftp_send_ack(int sock, uint16_t block)
+{
+    uint8_t pkt[4];
+    tftp_put_u16(pkt, TFTP_OP_ACK);
+    tftp_put_u16(pkt + 2, block);
+    send(sock, pkt, sizeof(pkt), 0);
+}
+
+static void tftp_oack_add(tftp_xfer_t *x, const char *name, unsigned long value)
+{
+    if (x->oack_len == 0) {
+        tftp_put_u16(x->oack, TFTP_OP_OACK);
+        x->oack_len = 2;
+    }
+    int n = snprintf((char *)x->oack + x->oack_len, sizeof(x->oack) - x->oack_len, "%s%c%lu", name, '\0', value);
+    if (n > 0 && x->oack_len + n + 1 <= sizeof(x->oack)) {
+        x->oack_len += n + 1;
+    }
+}
+
+// Receive a write: DATA blocks are gathered into 4KB sectors for the differential writer
+// and every windowsize blocks are acknowledged together
+static void tftp_write(tftp_xfer_t *x)
+{
+    const esp_partition_t *partition = x->partition;
+    if (!partition_lock_try(partition, true)) {
+        tftp_send_error(x->sock, TFTP_ERR_ACCESS, "Partition is in use by another request");
+        return;
+    }
+    
+    // Same as /upload: cached mounts and NVS listings would serve the old contents
+    if (partition->type == ESP_PARTITION_TYPE_DATA) {
+        fs_mount_invalidate(partition->label);
+        if (partition->subtype == ESP_PARTITION_SUBTYPE_DATA_NVS) {
+            nvs_changed();
+        }
+    }
+    
+    diff_writer_t dw;
+    uint8_t *sector = malloc(DIFF_SECTOR_SIZE);
+    esp_err_t init_err = sector ? diff_writer_init(&dw, partition) : ESP_ERR_NO_MEM;
+    if (init_err != ESP_OK) {
+        free(sector);
+        partition_unlock(partition, true);
+        tftp_send_error(x->sock, TFTP_ERR_UNDEFINED, init_err == ESP_ERR_INVALID_STATE ? "Another flash write is in progress"
+                                                                                      : "Memory allocation failed");
+        return;
+    }
+    
+    ESP_LOGI(TAG, "TFTP write to %s (blksize %u, windowsize %u)", partition->label, x->blksize, x->windowsize);
+    uint16_t block = 0;             // Last block received in order
+    uint32_t received = 0;
+    size_t fill = 0;
+    unsigned in_window = 0;
+    int retries = 0;
+    bool resync_sent = false;
+    bool done = false;
+    const char *error = NULL;
+    uint16_t error_code = TFTP_ERR_UNDEFINED;
+    
+    // The OACK stands in for ACK 0
+    if (x->oack_len > 0) {
+        send(x->sock, x->oack, x->oack_len, 0);
+    } else {
+        tftp_send_ack(x->sock, 0);
+    }
+    while (!done && !error) {
+        int n = recv(x->sock, x->pkt, 4 + x->blksize, 0);
+        if (n < 0) {
+            if (++retries > TFTP_MAX_RETRIES) {
+                error = "Timeout";
+                break;
+            }
+            if (block == 0 && x->oack_len > 0) {
+                send(x->sock, x->oack, x->oack_len, 0);
+            } else {
+                tftp_send_ack(x->sock, block);
+            }
+            in_window = 0;
+            continue;
+        }
+        if (n < 4) {
+            continue;
+        }
+        uint16_t op = tftp_get_u16(x->pkt);
+        if (op == TFTP_OP_ERROR) {
+            ESP_LOGW(TAG, "TFTP write to %s aborted by client", partition->label);
+            break;
+        }
+        if (op != TFTP_OP_DATA) {
+            error = "Expected DATA";
+            error_code = TFTP_ERR_ILLEGAL_OP;
+            break;
+        }
+        if (tftp_get_u16(x->pkt + 2) != (uint16_t)(block + 1)) {
+            // Lost or repeated block: acknowledge the last one received in order so the
+            // client restarts the window after it (RFC 7440), once per gap
+            if (!resync_sent) {
+                tftp_send_ack(x->sock, block);
+                resync_sent = true;
+            }
+            in_window = 0;
+            continue;
+        }
+        retries = 0;
+        resync_sent = false;
+        
+        size_t len = n - 4;
+        if (len > partition->size - received) {
+            error = "Image larger than partition";
+            error_code = TFTP_ERR_DISK_FULL;
+            break;
+        }
+        received += len;
+        block++;
+        
+        // A full window is acknowledged as soon as it is buffered, so the client sends the
+        // next one while this one is compared and flashed (it waits in the UDP mailbox).
+        // Only the final ACK is held back until the image is on flash.
+        bool last = len < x->blksize;
+        if (!last && ++in_window >= x->windowsize) {
+            tftp_send_ack(x->sock, block);
+            in_window = 0;
+        }
+        
+        const uint8_t *data = x->pkt + 4;
+        for (size_t left = len; left > 0 && !error; ) {
+            size_t chunk = left > DIFF_SECTOR_SIZE - fill ? DIFF_SECTOR_SIZE - fill : left;
+            memcpy(sector + fill, data, chunk);
+            fill += chunk;
+            data += chunk;
+            left -= chunk;
+            if (fill == DIFF_SECTOR_SIZE) {
+                if (diff_writer_sector(&dw, (const char *)sector) != ESP_OK) {
+                    error = "Flash write failed";
+                }
+                fill = 0;
+            }
+        }
+        
+        // A short block ends the transfer
+        if (!error && last) {
+            if (fill > 0) {
+                memset(sector + fill, 0xFF, DIFF_SECTOR_SIZE - fill);
+                if (diff_writer_sector(&dw, (const char *)sector) != ESP_OK) {
+                    error = "Flash write failed";
+                }
+            }
+            if (!error && diff_writer_flush(&dw) != ESP_OK) {
+                error = "Flash write failed";
+            }
+            done = !error;
+            if (done) {
+                tftp_send_ack(x->sock, block);
+            }
+        }
+    }
+    free(sector);
+    diff_writer_free(&dw);
+    partition_unlock(partition, true);
+    
+    if (error) {
+        ESP_LOGE(TAG, "TFTP write to %s failed after %lu bytes: %s", partition->label, (unsigned long)received, error);
+        tftp_send_error(x->sock, error_code, error);
+        return;
+    }
+    if (!done) {
+        return;
+    }
+    ESP_LOGI(TAG, "TFTP write of %lu bytes to %s done (%d pages compared, %d pages written)",
+             (unsigned long)received, partition->label, dw.pages_compared, dw.pages_written);
+    
+    // If the final ACK is lost the client resends its last block; answer until it goes quiet
+    while (recv(x->sock, x->pkt, 4 + x->blksize, 0) >= 4 && tftp_get_u16(x->pkt) == TFTP_OP_DATA) {
+        tftp_send_ack(x->sock, block);
+    }
+}
+
+// Send the whole partition, windowsize blocks at a time. An ACK for any block in the window
+// moves it forward to the next block; a timeout resends the window.
+static void tftp_read(tftp_xfer_t *x)
+{
+    const esp_partition_t *partition = x->partition;
+    if (!partition_lock_try(partition, false)) {
+        tftp_send_error(x->sock, TFTP_ERR_ACCESS, "Partition is in use by another request");
+        return;
+    }
+    
+    // The last block is shorter than blksize, possibly empty
+    uint32_t total_blocks = partition->size / x->blksize + 1;
+    uint32_t acked = 0;
+    int retries = 0;
+    const char *error = NULL;
+    bool aborted = false;
+    ESP_LOGI(TAG, "TFTP read of %s (blksize %u, windowsize %u)", partition->label, x->blksize, x->windowsize);
+    
+    // With options the transfer starts once the client acknowledges the OACK with ACK 0
+    if (x->oack_len > 0) {
+        while (1) {
+            send(x->sock, x->oack, x->oack_len, 0);
+            int n = recv(x->sock, x->pkt, 4 + x->blksize, 0);
+            if (n >= 4 && tftp_get_u16(x->pkt) == TFTP_OP_ACK && tftp_get_u16(x->pkt + 2) == 0) {
+                break;
+            }
+            if (n >= 4 && tftp_get_u16(x->pkt) == TFTP_OP_ERROR) {
+                aborted = true;     // E.g. the client rejected an option
+                break;
+            }
+            if (++retries > TFTP_MAX_RETRIES) {
+                error = "Timeout";
+                break;
+            }
+        }
+        retries = 0;
+    }
+    
+    while (!error && !aborted && acked < total_blocks) {
+        uint32_t count = total_blocks - acked > x->windowsize ? x->windowsize : total_blocks - acked;
+        for (uint32_t i = 0; i < count && !error; i++) {
+            uint32_t block = acked + 1 + i;
+            uint32_t offset = (block - 1) * x->blksize;
+            size_t len = partition->size - offset > x->blksize ? x->blksize : partition->size - offset;
+            tftp_put_u16(x->pkt, TFTP_OP_DATA);
+            tftp_put_u16(x->pkt + 2, (uint16_t)block);
+            if (len > 0 && esp_partition_read(partition, offset, x->pkt + 4, len) != ESP_OK) {
+                error = "Flash read failed";
+                break;
+            }
+            send(x->sock, x->pkt, 4 + len, 0);
+        }
+        
+        // Wait for an ACK inside this window; stale ones from an earlier window are ignored
+        while (!error) {
+            int n = recv(x->sock, x->pkt, 4 + x->blksize, 0);
+            if (n < 0) {
+                if (++retries > TFTP_MAX_RETRIES) {
+                    error = "Timeout";
+                }
+                break;
+            }
+            if (n < 4) {
+                continue;
+            }
+            uint16_t op = tftp_get_u16(x->pkt);
+            if (op == TFTP_OP_ERROR) {
+                aborted = true;
+                break;
+            }
+            uint16_t ahead = tftp_get_u16(x->pkt + 2) - (uint16_t)acked;
+            if (op == TFTP_OP_ACK && ahead >= 1 && ahead <= count) {
+                acked += ahead;
+                retries = 0;
+                break;
+            }
+        }
+    }
+    partition_unlock(partition, false);
+    
+    if (error) {
+        ESP_LOGE(TAG, "TFTP read of %s failed after %lu blocks: %s", partition->label, (unsigned long)acked, error);
+        tftp_send_error(x->sock, TFTP_ERR_UNDEFINED, error);
+    } else if (aborted) {
+        ESP_LOGW(TAG, "TFTP read of %s aborted by client", partition->label);
+    } else {
+        ESP_LOGI(TAG, "TFTP read of %s done (%lu bytes)", partition->label, (unsigned long)partition->size);
+    }
+}
+
+// Parse RRQ/WRQ and its options, then run the transfer from a new socket
+static void tftp_handle_request(uint8_t *req, int len, const struct sockaddr_in *client, uint8_t *pkt)
+{
+    tftp_xfer_t x = {
+        .blksize = TFTP_DEFAULT_BLKSIZE,
+        .windowsize = 1,
+        .timeout_s = TFTP_DEFAULT_TIMEOUT_S,
+        .pkt = pkt,
+    };
+    x.sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (x.sock < 0) {
+        ESP_LOGE(TAG, "TFTP: failed to create transfer socket (errno %d)", errno);
+        return;
+    }
+    struct sockaddr_in local = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_ANY) };
+    if (bind(x.sock, (struct sockaddr *)&local, sizeof(local)) != 0 ||
+        connect(x.sock, (const struct sockaddr *)client, sizeof(*client)) != 0) {
+        ESP_LOGE(TAG, "TFTP: failed to set up transfer socket (errno %d)", errno);
+        close(x.sock);
+        return;
+    }
+    
+    // Filename, mode and option/value pairs, each NUL terminated
+    const char *fields[2 + 2 * 8];
+    int field_count = 0;
+    uint16_t op = len >= 2 ? tftp_get_u16(req) : 0;
+    if ((op == TFTP_OP_RRQ || op == TFTP_OP_WRQ) && req[len - 1] == '\0') {
+        for (int pos = 2; pos < len && field_count < (int)(sizeof(fields) / sizeof(fields[0])); ) {
+            fields[field_count++] = (const char *)req + pos;
+            pos += strlen((const char *)req + pos) + 1;
+        }
+    }
+    if (field_count < 2) {
+        tftp_send_error(x.sock, TFTP_ERR_ILLEGAL_OP, "Malformed request");
+        close(x.sock);
+        return;
+    }
+    if (strcasecmp(fields[1], "octet") != 0) {
+        tftp_send_error(x.sock, TFTP_ERR_ILLEGAL_OP, "Only octet mode is supported");
+        close(x.sock);
+        return;
+    }
+    
+    char label[17] = {0};
+    const char *name = fields[0][0] == '/' ? fields[0] + 1 : fields[0];
+    size_t name_len = strlen(name);
+    if (name_len > 4 && strcasecmp(name + name_len - 4, ".bin") == 0) {
+        name_len -= 4;
+    }
+    if (name_len > 0 && name_len < sizeof(label)) {
+        memcpy(label, name, name_len);
+        x.partition = esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, label);
+    }
+    if (!x.partition) {
+        ESP_LOGW(TAG, "TFTP %s: partition %s not found", op == TFTP_OP_WRQ ? "write" : "read", fields[0]);
+        tftp_send_error(x.sock, TFTP_ERR_NOT_FOUND, "Partition not found");
+        close(x.sock);
+        return;
+    }
+    
+    // Accepted options are echoed in the OACK, blksize and windowsize lowered to what we support
+    for (int i = 2; i + 1 < field_count; i += 2) {
+        char *end;
+        unsigned long value = strtoul(fields[i + 1], &end, 10);
+        if (end == fields[i + 1] || *end != '\0') {
+            continue;
+        }
+        if (strcasecmp(fields[i], "blksize") == 0 && value >= 8) {
+            x.blksize = value > TFTP_MAX_BLKSIZE ? TFTP_MAX_BLKSIZE : value;
+            tftp_oack_add(&x, "blksize", x.blksize);
+        } else if (strcasecmp(fields[i], "windowsize") == 0 && value >= 1) {
+            x.windowsize = value > TFTP_MAX_WINDOW ? TFTP_MAX_WINDOW : value;
+            tftp_oack_add(&x, "windowsize", x.windowsize);
+        } else if (strcasecmp(fields[i], "timeout") == 0 && value >= 1 && value <= 255) {
+            x.timeout_s = value;
+            tftp_oack_add(&x, "timeout", value);
+        } else if (strcasecmp(fields[i], "tsize") == 0) {
+            // A write announces the image size, a read asks for it with 0
+            if (op == TFTP_OP_WRQ && value > x.partition->size) {
+                tftp_send_error(x.sock, TFTP_ERR_DISK_FULL, "Image larger than partition");
+                close(x.sock);
+                return;
+            }
+            tftp_oack_add(&x, "tsize", op == TFTP_OP_WRQ ? value : x.partition->size);
+        }
+    }
+    
+    struct timeval timeout = { .tv_sec = x.timeout_s };
+    setsockopt(x.sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (op == TFTP_OP_WRQ) {
+        tftp_write(&x);
+    } else {
+        tftp_read(&x);
+    }
+    close(x.sock);
+}
+
+static void tftp_server_task(void *arg)
+{
+    uint8_t *pkt = malloc(4 + TFTP_MAX_BLKSIZE);
+    uint8_t *req = malloc(TFTP_REQ_MAX);
+    int listen_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (!pkt || !req || listen_sock < 0) {
+        ESP_LOGE(TAG, "TFTP service: failed to start (errno %d)", errno);
+        free(pkt);
+        free(req);
+        if (listen_sock >= 0) {
+            close(listen_sock);
+        }
+        vTaskDelete(NULL);
+        return;
+    }
+    
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_TFTP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        ESP_LOGE(TAG, "TFTP service: failed to bind port %d (errno %d)", CONFIG_TFTP_PORT, errno);
+        close(listen_sock);
+        free(pkt);
+        free(req);
+        vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(TAG, "TFTP service listening on port %d", CONFIG_TFTP_PORT);
+    
+    while (1) {
+        struct sockaddr_in client;
+        socklen_t client_len = sizeof(client);
+        int n = recvfrom(listen_sock, req, TFTP_REQ_MAX, 0, (struct sockaddr *)&client, &client_len);
+        if (n < 0) {
+            ESP_LOGW(TAG, "TFTP receive failed (errno %d)", errno);
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+        if (n > 0) {
+            tftp_handle_request(req, n, &client, pkt);
+        }
+    }
+}
+
+
 // WiFi event handler
 static void wifi_event_handler(void *arg, esp_event_base_t event_base,
                               int32_t event_id, void *event_data)
@@ -1527,6 +5887,7 @@ void app_main(void)
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    nvs_boot_id = esp_random();
 
     // Initialize networking
     ESP_ERROR_CHECK(esp_netif_init());
@@ -1582,11 +5943,22 @@ void app_main(void)
     };
     start_dns_server(&dns_config);
 
+    fs_mount_lock = xSemaphoreCreateMutex();
+    xfer_pool_lock = xSemaphoreCreateMutex();
+    partition_lock_table_lock = xSemaphoreCreateMutex();
+    xTaskCreate(spiffs_gc_task, "spiffs_gc", 3072, NULL, tskIDLE_PRIORITY + 1, NULL);
+
     // Start web server
     httpd_handle_t server = start_webserver();
     if (server == NULL) {
         ESP_LOGE(TAG, "Failed to start web server");
     }
+    if (CONFIG_BULK_TRANSFER_PORT > 0) {
+        xTaskCreate(bulk_server_task, "bulk_xfer", 4096, NULL, 5, NULL);
+    }
+    if (CONFIG_TFTP_PORT > 0) {
+        xTaskCreate(tftp_server_task, "tftp", 4096, NULL, 5, NULL);
+    }
 
     // Keep running - feed watchdog regularly
     while(1) {
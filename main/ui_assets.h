@@ -0,0 +1,24 @@
+/* Embedded web UI route table
+
+   The table itself (ui_assets.c) is generated at build time by
+   build_ui_assets.py from root.html; each entry describes one URI.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    const char *uri;            // Request path, fingerprinted for CSS/JS
+    const char *content_type;
+    const char *hash;           // Content hash used to build the ETag
+    const char *cache_control;
+    const uint8_t *gzip_start;
+    const uint8_t *gzip_end;
+    const uint8_t *br_start;    // NULL when the build host had no Brotli encoder
+    const uint8_t *br_end;
+} ui_asset_t;
+
+extern const ui_asset_t ui_assets[];
+extern const size_t ui_assets_count;
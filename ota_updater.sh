@@ -4,7 +4,8 @@
 # This script manages the OTA update process:
 # 1. Connects to WiFi access point
 # 2. Resets device to OTA updater mode
-# 3. Uploads firmware image to specified partition
+# 3. Uploads firmware image to specified partition (over HTTP, or with --tcp over the
+#    raw TCP bulk transfer service, verified by SHA-256)
 # 4. Sets the boot partition
 
 # Set strict mode
@@ -85,10 +86,108 @@ wifi_connect() {
     return 1
 }
 
+# Bulk transfer service (--tcp): 32-byte request "ERB1" | cmd | 3 reserved | label[16] |
+# offset u32 | length u32, answered by a 12-byte header "ERB1" | status | 3 reserved |
+# payload length u32 and the payload. Integers are big-endian.
+bulk_u32() {
+    printf "$(printf '\\x%02x\\x%02x\\x%02x\\x%02x' $(( ($1 >> 24) & 255 )) $(( ($1 >> 16) & 255 )) $(( ($1 >> 8) & 255 )) $(( $1 & 255 )))"
+}
+
+bulk_request() {
+    local cmd="$1"
+    local label="$2"
+    local offset="$3"
+    local length="$4"
+    
+    printf 'ERB1%s\0\0\0%s' "$cmd" "$label"
+    for ((i = ${#label}; i < 16; i++)); do
+        printf '\0'
+    done
+    bulk_u32 "$offset"
+    bulk_u32 "$length"
+}
+
+# Read n bytes from the bulk connection as space separated decimal values
+bulk_read_bytes() {
+    dd bs=1 count="$1" status=none <&3 | od -An -v -tu1
+}
+
+# Read a response header; prints "<status> <payload length>", fails on a malformed header
+bulk_read_header() {
+    local header
+    header=($(bulk_read_bytes 12))
+    if [[ ${#header[@]} -ne 12 || "${header[*]:0:4}" != "69 82 66 49" ]]; then
+        return 1
+    fi
+    echo "${header[4]} $(( (header[8] << 24) | (header[9] << 16) | (header[10] << 8) | header[11] ))"
+}
+
+bulk_status_name() {
+    case $1 in
+        1) echo "bad request" ;;
+        2) echo "partition not found" ;;
+        3) echo "partition in use by another request" ;;
+        4) echo "image larger than partition" ;;
+        5) echo "flash or connection error" ;;
+        *) echo "status $1" ;;
+    esac
+}
+
+# Upload a file over the bulk transfer service, then have the device hash what it wrote
+bulk_upload() {
+    local file="$1"
+    local label="$2"
+    local size
+    size=$(stat -c %s "$file")
+    
+    if [[ ${#label} -gt 16 ]]; then
+        log_error "Partition label '$label' is longer than 16 characters"
+        return 1
+    fi
+    if ! exec 3<>"/dev/tcp/${IP_ADDRESS}/${TCP_PORT}"; then
+        log_error "Cannot connect to bulk transfer service at ${IP_ADDRESS}:${TCP_PORT}"
+        return 1
+    fi
+    
+    local start=$(date +%s%N)
+    { bulk_request U "$label" 0 "$size"; cat "$file"; } >&3 2>/dev/null
+    local resp
+    resp=($(bulk_read_header))
+    if [[ ${#resp[@]} -ne 2 || ${resp[0]} -ne 0 ]]; then
+        log_error "Bulk upload failed: $(bulk_status_name "${resp[0]:-5}")"
+        exec 3<&-
+        return 1
+    fi
+    local pages=($(bulk_read_bytes 8))
+    local elapsed_ms=$(( ($(date +%s%N) - start) / 1000000 ))
+    log_success "Uploaded $size bytes in ${elapsed_ms} ms ($(( (pages[0] << 24) | (pages[1] << 16) | (pages[2] << 8) | pages[3] )) pages compared, $(( (pages[4] << 24) | (pages[5] << 16) | (pages[6] << 8) | pages[7] )) pages written)"
+    
+    log_info "Verifying SHA-256 of the written image..."
+    bulk_request H "$label" 0 "$size" >&3
+    resp=($(bulk_read_header))
+    if [[ ${#resp[@]} -ne 2 || ${resp[0]} -ne 0 || ${resp[1]} -ne 32 ]]; then
+        log_error "Hash request failed: $(bulk_status_name "${resp[0]:-5}")"
+        exec 3<&-
+        return 1
+    fi
+    local device_hash
+    device_hash=$(dd bs=1 count=32 status=none <&3 | od -An -v -tx1 | tr -d ' \n')
+    exec 3<&-
+    
+    local local_hash
+    local_hash=$(sha256sum "$file" | cut -d' ' -f1)
+    if [[ "$device_hash" != "$local_hash" ]]; then
+        log_error "SHA-256 mismatch: device $device_hash, file $local_hash"
+        return 1
+    fi
+    log_success "SHA-256 verified: $device_hash"
+    return 0
+}
+
 # Function to print usage
 print_usage() {
     cat << EOF
-Usage: $0 -i <interface> -f <firmware_file> [-s <ssid>] [-p <password>] [-a <ip_address>] [-o <ota_partition>] [--skip-wifi]
+Usage: $0 -i <interface> -f <firmware_file> [-s <ssid>] [-p <password>] [-a <ip_address>] [-o <ota_partition>] [--tcp [--tcp-port <port>]] [--skip-wifi]
 
 Required Arguments:
   -i, --interface      WiFi interface name (e.g., wlan0)
@@ -99,12 +198,16 @@ Optional Arguments (with defaults):
   -p, --password       WiFi password (default: none)
   -a, --address        IP address of ESP device (default: 192.168.4.1)
   -o, --ota-partition  OTA partition name (default: ota_0)
+  --tcp                Upload over the raw TCP bulk transfer service instead of HTTP
+                       and verify the written image by SHA-256
+  --tcp-port           Bulk transfer service port (default: 3300)
   --skip-wifi          Skip WiFi connection (for debugging/testing)
   -h, --help           Show this help message
 
 Example:
   $0 -i wlan0 -f firmware.bin
   $0 -i wlan0 -s "MyNetwork" -p "password123" -a 192.168.4.100 -o ota_1 -f firmware.bin
+  $0 -i wlan0 --tcp -f firmware.bin
 EOF
 }
 
@@ -114,6 +217,8 @@ WIFI_PASSWORD=""
 IP_ADDRESS="192.168.4.1"
 OTA_PARTITION="ota_0"
 SKIP_WIFI=0
+TCP_MODE=0
+TCP_PORT=3300
 CONNECTED_TO_ESP=0
 ORIGINAL_SSID=""
 
@@ -144,6 +249,14 @@ while [[ $# -gt 0 ]]; do
             FIRMWARE_FILE="$2"
             shift 2
             ;;
+        --tcp)
+            TCP_MODE=1
+            shift
+            ;;
+        --tcp-port)
+            TCP_PORT="$2"
+            shift 2
+            ;;
         --skip-wifi)
             SKIP_WIFI=1
             shift
@@ -174,7 +287,11 @@ if [[ ! -f "$FIRMWARE_FILE" ]]; then
 fi
 
 # Check for required commands
-for cmd in curl nmcli; do
+REQUIRED_COMMANDS="curl nmcli"
+if [[ $TCP_MODE -eq 1 ]]; then
+    REQUIRED_COMMANDS="$REQUIRED_COMMANDS dd od sha256sum"
+fi
+for cmd in $REQUIRED_COMMANDS; do
     if ! command_exists "$cmd"; then
         log_error "Required command not found: $cmd"
         exit 1
@@ -203,6 +320,9 @@ log_info "SSID: $WIFI_SSID"
 log_info "IP Address: $IP_ADDRESS"
 log_info "OTA Partition: $OTA_PARTITION"
 log_info "Firmware File: $FIRMWARE_FILE"
+if [[ $TCP_MODE -eq 1 ]]; then
+    log_info "Transfer: raw TCP bulk service on port $TCP_PORT"
+fi
 if [[ $SKIP_WIFI -eq 1 ]]; then
     log_info "WiFi: SKIPPED (--skip-wifi flag)"
 fi
@@ -334,32 +454,39 @@ sleep 1
 
 # Step 7: Upload firmware to partition
 log_info "Uploading firmware to partition '$OTA_PARTITION'..."
-UPLOAD_URL="http://${IP_ADDRESS}/upload?label=${OTA_PARTITION}"
+if [[ $TCP_MODE -eq 1 ]]; then
+    if ! bulk_upload "$FIRMWARE_FILE" "$OTA_PARTITION"; then
+        cleanup_on_error
+        exit 1
+    fi
+else
+    UPLOAD_URL="http://${IP_ADDRESS}/upload?label=${OTA_PARTITION}"
 
-# Use curl to upload the file - explicitly specify POST method
-HTTP_RESPONSE=$(curl -s -X POST -w "%{http_code}" -o /tmp/upload_response.json --data-binary @"$FIRMWARE_FILE" "$UPLOAD_URL")
+    # Use curl to upload the file - explicitly specify POST method
+    HTTP_RESPONSE=$(curl -s -X POST -w "%{http_code}" -o /tmp/upload_response.json --data-binary @"$FIRMWARE_FILE" "$UPLOAD_URL")
 
-if [[ "$HTTP_RESPONSE" != "200" ]]; then
-    log_error "Upload failed with HTTP status code: $HTTP_RESPONSE"
-    if [[ -f /tmp/upload_response.json ]]; then
-        log_error "Response: $(cat /tmp/upload_response.json)"
-        rm /tmp/upload_response.json
+    if [[ "$HTTP_RESPONSE" != "200" ]]; then
+        log_error "Upload failed with HTTP status code: $HTTP_RESPONSE"
+        if [[ -f /tmp/upload_response.json ]]; then
+            log_error "Response: $(cat /tmp/upload_response.json)"
+            rm /tmp/upload_response.json
+        fi
+        cleanup_on_error
+        exit 1
     fi
-    cleanup_on_error
-    exit 1
-fi
 
-RESPONSE_BODY=$(cat /tmp/upload_response.json)
-rm /tmp/upload_response.json
+    RESPONSE_BODY=$(cat /tmp/upload_response.json)
+    rm /tmp/upload_response.json
 
-if echo "$RESPONSE_BODY" | grep -q '"status":"success"'; then
-    log_success "Firmware uploaded successfully"
-    log_info "Response: $RESPONSE_BODY"
-else
-    log_error "Upload response indicates failure"
-    log_error "Response: $RESPONSE_BODY"
-    cleanup_on_error
-    exit 1
+    if echo "$RESPONSE_BODY" | grep -q '"status":"success"'; then
+        log_success "Firmware uploaded successfully"
+        log_info "Response: $RESPONSE_BODY"
+    else
+        log_error "Upload response indicates failure"
+        log_error "Response: $RESPONSE_BODY"
+        cleanup_on_error
+        exit 1
+    fi
 fi
 
 log_info ""
@@ -0,0 +1,285 @@
+#!/bin/bash
+
+# SPIFFS Image Tool for ESP Recovery
+# Builds a SPIFFS image from a directory with the same geometry as a data
+# partition in partitions.csv and, in deploy mode, pushes it through the
+# recovery app's /upload endpoint. /upload compares every 4KB sector with
+# the flash contents and only erases/writes the ones that changed, so
+# redeploying a mostly unchanged asset tree is fast.
+
+# Set strict mode
+set -o pipefail
+
+# Color output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+# Function to print colored output
+log_info() {
+    echo -e "${BLUE}[INFO]${NC} $1"
+}
+
+log_success() {
+    echo -e "${GREEN}[SUCCESS]${NC} $1"
+}
+
+log_warning() {
+    echo -e "${YELLOW}[WARNING]${NC} $1"
+}
+
+log_error() {
+    echo -e "${RED}[ERROR]${NC} $1"
+}
+
+# Function to check if command exists
+command_exists() {
+    command -v "$1" >/dev/null 2>&1
+}
+
+# Function to print usage
+print_usage() {
+    cat << EOF
+Usage: $0 build  -d <directory> -o <image_file> [options]
+       $0 deploy -d <directory> [-a <ip_address>] [options]
+       $0 deploy -f <image_file> [-a <ip_address>] [options]
+
+Modes:
+  build                Build a SPIFFS image from a directory
+  deploy               Build (or take) an image and flash it through /upload
+
+Arguments:
+  -d, --dir            Directory whose contents become the filesystem
+  -f, --file           Existing image to deploy instead of building one
+  -o, --output         Output image path (build mode; default: spiffs.bin)
+
+Optional Arguments (with defaults):
+  -l, --label          Partition label in the partition table (default: storage)
+  -t, --table          Partition table CSV (default: partitions.csv next to this script)
+  -c, --sdkconfig      sdkconfig providing CONFIG_SPIFFS_* geometry (default: sdkconfig next to this script)
+  -a, --address        IP address of ESP device (default: 192.168.4.1)
+  -h, --help           Show this help message
+
+The image geometry (page size, block size, name and metadata length, magic)
+must match the firmware that mounts the partition. It is read from sdkconfig
+when present and otherwise uses ESP-IDF's defaults.
+
+Example:
+  $0 build -d ./assets -o storage.bin
+  $0 deploy -d ./assets -a 192.168.4.1
+EOF
+}
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+
+# Set default values
+MODE=""
+SOURCE_DIR=""
+IMAGE_FILE=""
+OUTPUT_FILE="spiffs.bin"
+PARTITION_LABEL="storage"
+PARTITION_TABLE="$SCRIPT_DIR/partitions.csv"
+SDKCONFIG="$SCRIPT_DIR/sdkconfig"
+IP_ADDRESS="192.168.4.1"
+
+if [[ $# -gt 0 && "$1" != -* ]]; then
+    MODE="$1"
+    shift
+fi
+
+# Parse command line arguments
+while [[ $# -gt 0 ]]; do
+    case $1 in
+        -d|--dir)
+            SOURCE_DIR="$2"
+            shift 2
+            ;;
+        -f|--file)
+            IMAGE_FILE="$2"
+            shift 2
+            ;;
+        -o|--output)
+            OUTPUT_FILE="$2"
+            shift 2
+            ;;
+        -l|--label)
+            PARTITION_LABEL="$2"
+            shift 2
+            ;;
+        -t|--table)
+            PARTITION_TABLE="$2"
+            shift 2
+            ;;
+        -c|--sdkconfig)
+            SDKCONFIG="$2"
+            shift 2
+            ;;
+        -a|--address)
+            IP_ADDRESS="$2"
+            shift 2
+            ;;
+        -h|--help)
+            print_usage
+            exit 0
+            ;;
+        *)
+            log_error "Unknown option: $1"
+            print_usage
+            exit 1
+            ;;
+    esac
+done
+
+if [[ "$MODE" != "build" && "$MODE" != "deploy" ]]; then
+    log_error "Mode must be 'build' or 'deploy'"
+    print_usage
+    exit 1
+fi
+
+if [[ -z "$SOURCE_DIR" && -z "$IMAGE_FILE" ]]; then
+    log_error "Missing required argument: directory (-d) or image file (-f)"
+    print_usage
+    exit 1
+fi
+
+if [[ "$MODE" == "build" && -n "$IMAGE_FILE" ]]; then
+    log_error "Build mode takes a directory (-d), not an image (-f)"
+    exit 1
+fi
+
+# Read a CONFIG_ value from sdkconfig, falling back to a default
+sdkconfig_value() {
+    local key="$1"
+    local default="$2"
+    local value=""
+    if [[ -f "$SDKCONFIG" ]]; then
+        value=$(grep -E "^${key}=" "$SDKCONFIG" | head -n 1 | cut -d= -f2-)
+    fi
+    echo "${value:-$default}"
+}
+
+# Read the size of a partition from the partition table CSV
+partition_size() {
+    local label="$1"
+    local size
+    size=$(grep -v '^[[:space:]]*#' "$PARTITION_TABLE" | tr -d ' \t' | awk -F, -v l="$label" '$1 == l { print $5; exit }')
+    if [[ -z "$size" ]]; then
+        return 1
+    fi
+    case "$size" in
+        *K|*k) echo $(( ${size%[Kk]} * 1024 )) ;;
+        *M|*m) echo $(( ${size%[Mm]} * 1024 * 1024 )) ;;
+        *) echo $(( size )) ;;
+    esac
+}
+
+build_image() {
+    local output="$1"
+
+    if [[ ! -d "$SOURCE_DIR" ]]; then
+        log_error "Directory not found: $SOURCE_DIR"
+        exit 1
+    fi
+    if [[ ! -f "$PARTITION_TABLE" ]]; then
+        log_error "Partition table not found: $PARTITION_TABLE"
+        exit 1
+    fi
+
+    local image_size
+    image_size=$(partition_size "$PARTITION_LABEL")
+    if [[ $? -ne 0 || -z "$image_size" ]]; then
+        log_error "Partition '$PARTITION_LABEL' not found in $PARTITION_TABLE"
+        exit 1
+    fi
+
+    local spiffsgen="${IDF_PATH}/components/spiffs/spiffsgen.py"
+    if [[ -z "$IDF_PATH" || ! -f "$spiffsgen" ]]; then
+        log_error "spiffsgen.py not found - source ESP-IDF's export.sh so IDF_PATH is set"
+        exit 1
+    fi
+
+    local page_size block_size obj_name_len meta_len magic magic_len
+    page_size=$(sdkconfig_value CONFIG_SPIFFS_PAGE_SIZE 256)
+    block_size=4096
+    obj_name_len=$(sdkconfig_value CONFIG_SPIFFS_OBJ_NAME_LEN 32)
+    meta_len=$(sdkconfig_value CONFIG_SPIFFS_META_LENGTH 4)
+    magic="--use-magic"
+    magic_len="--use-magic-len"
+    [[ $(sdkconfig_value CONFIG_SPIFFS_USE_MAGIC y) != "y" ]] && magic="--no-magic"
+    [[ $(sdkconfig_value CONFIG_SPIFFS_USE_MAGIC_LENGTH y) != "y" ]] && magic_len="--no-magic-len"
+
+    log_info "Building SPIFFS image for '$PARTITION_LABEL' ($image_size bytes)"
+    log_info "Geometry: page $page_size, block $block_size, name length $obj_name_len, meta length $meta_len, $magic $magic_len"
+
+    python3 "$spiffsgen" "$image_size" "$SOURCE_DIR" "$output" \
+        --page-size "$page_size" --block-size "$block_size" \
+        --obj-name-len "$obj_name_len" --meta-len "$meta_len" \
+        $magic $magic_len
+    if [[ $? -ne 0 ]]; then
+        log_error "spiffsgen.py failed (do the files fit and are names shorter than $obj_name_len bytes?)"
+        exit 1
+    fi
+
+    log_success "Image written: $output"
+}
+
+if [[ "$MODE" == "build" ]]; then
+    build_image "$OUTPUT_FILE"
+    exit 0
+fi
+
+# Deploy mode
+if ! command_exists curl; then
+    log_error "Required command not found: curl"
+    exit 1
+fi
+
+# Temporary files go on every exit path; a user supplied image (-f) is never removed
+TEMP_IMAGE=""
+RESPONSE_FILE=""
+trap 'rm -f "$TEMP_IMAGE" "$RESPONSE_FILE"' EXIT
+
+if [[ -z "$IMAGE_FILE" ]]; then
+    TEMP_IMAGE=$(mktemp /tmp/spiffs_image.XXXXXX)
+    IMAGE_FILE="$TEMP_IMAGE"
+    build_image "$IMAGE_FILE"
+elif [[ ! -f "$IMAGE_FILE" ]]; then
+    log_error "Image file not found: $IMAGE_FILE"
+    exit 1
+fi
+
+# The device rejects an image larger than the partition only after receiving it all
+if [[ -f "$PARTITION_TABLE" ]]; then
+    PARTITION_SIZE=$(partition_size "$PARTITION_LABEL")
+    if [[ $? -ne 0 || -z "$PARTITION_SIZE" ]]; then
+        log_error "Partition '$PARTITION_LABEL' not found in $PARTITION_TABLE"
+        exit 1
+    fi
+    IMAGE_SIZE=$(wc -c < "$IMAGE_FILE" | tr -d ' ')
+    if [[ $IMAGE_SIZE -gt $PARTITION_SIZE ]]; then
+        log_error "Image is $IMAGE_SIZE bytes but partition '$PARTITION_LABEL' holds $PARTITION_SIZE bytes"
+        exit 1
+    fi
+else
+    log_info "Partition table not found: $PARTITION_TABLE - skipping the image size check"
+fi
+
+log_info "Deploying image to partition '$PARTITION_LABEL' on $IP_ADDRESS..."
+UPLOAD_URL="http://${IP_ADDRESS}/upload?label=${PARTITION_LABEL}"
+RESPONSE_FILE=$(mktemp /tmp/spiffs_deploy_response.XXXXXX)
+
+HTTP_RESPONSE=$(curl -s -X POST -w "%{http_code}" -o "$RESPONSE_FILE" --data-binary @"$IMAGE_FILE" "$UPLOAD_URL")
+RESPONSE_BODY=$(cat "$RESPONSE_FILE")
+
+if [[ "$HTTP_RESPONSE" != "200" ]] || ! echo "$RESPONSE_BODY" | grep -q '"status":"success"'; then
+    log_error "Deploy failed with HTTP status code: $HTTP_RESPONSE"
+    log_error "Response: $RESPONSE_BODY"
+    exit 1
+fi
+
+log_success "Image deployed to '$PARTITION_LABEL' (only changed sectors were written)"
+log_info "Response: $RESPONSE_BODY"
+
+exit 0
@@ -0,0 +1,386 @@
+/*
+ * parse_bench - host benchmark of the request parsers in components/http_parse
+ *
+ * Each case parses a realistic request the way its handler does, once with
+ * http_parse and once with the scanning helpers the handlers used before
+ * (kept here as the baseline), and prints the time per request.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "http_parse.h"
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Keeps the compiler from dropping the benchmarked work
+static volatile size_t sink;
+
+/* ---- Baseline: the previous per-key scanners ---- */
+
+// httpd_query_key_value() followed by URL decoding, once per parameter
+static int legacy_query_value(const char *query, const char *key, char *out, size_t out_len)
+{
+    size_t key_len = strlen(key);
+    const char *p = query;
+    while (p && *p) {
+        const char *eq = strchr(p, '=');
+        const char *amp = strchr(p, '&');
+        if (eq && (!amp || eq < amp) && (size_t)(eq - p) == key_len && strncmp(p, key, key_len) == 0) {
+            const char *v = eq + 1;
+            size_t len = amp ? (size_t)(amp - v) : strlen(v);
+            if (len >= out_len) {
+                return -1;
+            }
+            memcpy(out, v, len);
+            out[len] = '\0';
+            char *o = out;
+            for (char *in = out; *in; in++) {
+                if (*in == '%' && isxdigit((unsigned char)in[1]) && isxdigit((unsigned char)in[2])) {
+                    char hex[3] = { in[1], in[2], '\0' };
+                    *o++ = (char)strtol(hex, NULL, 16);
+                    in += 2;
+                } else {
+                    *o++ = *in == '+' ? ' ' : *in;
+                }
+            }
+            *o = '\0';
+            return 0;
+        }
+        p = amp ? amp + 1 : NULL;
+    }
+    return -1;
+}
+
+static const char *legacy_skip_string(const char *p, const char *end)
+{
+    for (p++; p < end && *p != '"'; p++) {
+        if (*p == '\\') {
+            p++;
+        }
+    }
+    return p < end ? p + 1 : end;
+}
+
+static const char *legacy_skip_value(const char *p, const char *end)
+{
+    int depth = 0;
+    while (p < end) {
+        if (*p == '"') {
+            p = legacy_skip_string(p, end);
+            if (depth == 0) {
+                return p;
+            }
+            continue;
+        }
+        if (*p == '{' || *p == '[') {
+            depth++;
+        } else if (*p == '}' || *p == ']') {
+            if (depth == 0) {
+                return p;
+            }
+            if (--depth == 0) {
+                return p + 1;
+            }
+        } else if (depth == 0 && (*p == ',' || *p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+            return p;
+        }
+        p++;
+    }
+    return end;
+}
+
+static const char *legacy_find_key(const char *obj, const char *end, const char *key)
+{
+    size_t key_len = strlen(key);
+    const char *p = memchr(obj, '{', end - obj);
+    if (!p) {
+        return NULL;
+    }
+    p++;
+    while (p < end) {
+        while (p < end && *p != '"' && *p != '}') {
+            p++;
+        }
+        if (p >= end || *p == '}') {
+            return NULL;
+        }
+        const char *name = p + 1;
+        p = legacy_skip_string(p, end);
+        bool match = (size_t)(p - 1 - name) == key_len && strncmp(name, key, key_len) == 0;
+        while (p < end && *p != ':') {
+            p++;
+        }
+        p++;
+        while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+            p++;
+        }
+        if (match) {
+            return p;
+        }
+        p = legacy_skip_value(p, end);
+        while (p < end && *p != ',' && *p != '}') {
+            p++;
+        }
+        if (p < end && *p == ',') {
+            p++;
+        }
+    }
+    return NULL;
+}
+
+static bool legacy_get_string(const char *obj, const char *end, const char *key, char *out, size_t out_len)
+{
+    out[0] = '\0';
+    const char *p = legacy_find_key(obj, end, key);
+    if (!p || *p != '"') {
+        return false;
+    }
+    size_t n = 0;
+    for (p++; p < end && *p != '"'; p++) {
+        char c = *p;
+        if (c == '\\' && p + 1 < end) {
+            c = *++p;
+        }
+        if (n + 1 < out_len) {
+            out[n++] = c;
+        }
+    }
+    out[n] = '\0';
+    return true;
+}
+
+static const char *legacy_next_array_object(const char *obj, const char *end, const char *key,
+                                            const char **cursor, const char **obj_end)
+{
+    const char *p = *cursor;
+    if (!p) {
+        p = legacy_find_key(obj, end, key);
+        if (!p || *p != '[') {
+            return NULL;
+        }
+        p++;
+    }
+    while (p < end && *p != '{' && *p != ']') {
+        p++;
+    }
+    if (p >= end || *p == ']') {
+        return NULL;
+    }
+    const char *start = p;
+    *obj_end = legacy_skip_value(p, end);
+    *cursor = *obj_end;
+    return start;
+}
+
+/* ---- Workloads ---- */
+
+static const char *query_str = "partition=storage&name=www%2Fimg%2Flogo%20dark.png&offset=40&limit=20&prefix=www%2F";
+static const char *query_keys[] = { "partition", "name", "offset", "limit", "prefix", "dir" };
+#define QUERY_KEY_COUNT (sizeof(query_keys) / sizeof(query_keys[0]))
+
+static void query_legacy(void)
+{
+    char out[128];
+    for (size_t k = 0; k < QUERY_KEY_COUNT; k++) {
+        if (legacy_query_value(query_str, query_keys[k], out, sizeof(out)) == 0) {
+            sink += out[0];
+        }
+    }
+}
+
+static void query_new(void)
+{
+    http_query_t query;
+    http_query_parse(&query, query_str, strlen(query_str));
+    for (size_t k = 0; k < QUERY_KEY_COUNT; k++) {
+        const char *value = http_query_get(&query, query_keys[k]);
+        if (value) {
+            sink += value[0];
+        }
+    }
+}
+
+static char *set_body;
+static char *batch_body;
+static char *sync_body;
+static json_tok_t *toks;
+static int max_toks;
+
+static const char *set_keys[] = { "partition", "namespace", "key", "value" };
+
+static void set_legacy(void)
+{
+    char out[512];
+    const char *end = set_body + strlen(set_body);
+    for (size_t k = 0; k < 4; k++) {
+        legacy_get_string(set_body, end, set_keys[k], out, sizeof(out));
+        sink += out[0];
+    }
+    const char *type = legacy_find_key(set_body, end, "type");
+    sink += type ? strtol(type, NULL, 10) : 0;
+}
+
+static void set_new(void)
+{
+    json_tok_t fixed[16];
+    char out[512];
+    json_parse(set_body, strlen(set_body), fixed, 16);
+    for (size_t k = 0; k < 4; k++) {
+        json_get_string(set_body, fixed, 0, set_keys[k], out, sizeof(out));
+        sink += out[0];
+    }
+    long long type = 0;
+    json_get_int(set_body, fixed, 0, "type", &type);
+    sink += type;
+}
+
+static void batch_legacy(void)
+{
+    const char *end = batch_body + strlen(batch_body);
+    const char *cursor = NULL, *obj_end, *obj;
+    char op[8], ns[16], key[16], value[64];
+    while ((obj = legacy_next_array_object(batch_body, end, "ops", &cursor, &obj_end)) != NULL) {
+        legacy_get_string(obj, obj_end, "op", op, sizeof(op));
+        legacy_get_string(obj, obj_end, "namespace", ns, sizeof(ns));
+        legacy_get_string(obj, obj_end, "key", key, sizeof(key));
+        legacy_get_string(obj, obj_end, "value", value, sizeof(value));
+        const char *type = legacy_find_key(obj, obj_end, "type");
+        sink += op[0] + ns[0] + key[0] + value[0] + (type ? strtol(type, NULL, 10) : 0);
+    }
+}
+
+// Count first, then parse into a buffer of exactly that size, as read_json() does for large bodies
+static int parse_counted(const char *body)
+{
+    size_t len = strlen(body);
+    int count = json_parse(body, len, NULL, 0);
+    if (count > max_toks) {
+        fprintf(stderr, "token buffer too small\n");
+        exit(1);
+    }
+    return json_parse(body, len, toks, count);
+}
+
+static void batch_new(void)
+{
+    parse_counted(batch_body);
+    char op[8], ns[16], key[16], value[64];
+    int ops = json_object_get(batch_body, toks, 0, "ops");
+    for (int i = 0, obj = ops + 1; i < toks[ops].size; i++, obj = toks[obj].next) {
+        json_get_string(batch_body, toks, obj, "op", op, sizeof(op));
+        json_get_string(batch_body, toks, obj, "namespace", ns, sizeof(ns));
+        json_get_string(batch_body, toks, obj, "key", key, sizeof(key));
+        json_get_string(batch_body, toks, obj, "value", value, sizeof(value));
+        long long type = 0;
+        json_get_int(batch_body, toks, obj, "type", &type);
+        sink += op[0] + ns[0] + key[0] + value[0] + type;
+    }
+}
+
+// /spiffs/sync's delete pass: look every local file up in the manifest
+#define SYNC_FILES 300
+
+static void sync_legacy(void)
+{
+    const char *end = sync_body + strlen(sync_body);
+    char local[32], name[128];
+    for (int f = 0; f < SYNC_FILES; f += 10) {
+        snprintf(local, sizeof(local), "www/file%03d.bin", f);
+        bool wanted = false;
+        const char *cursor = NULL, *obj_end, *obj;
+        while (!wanted && (obj = legacy_next_array_object(sync_body, end, "files", &cursor, &obj_end)) != NULL) {
+            wanted = legacy_get_string(obj, obj_end, "name", name, sizeof(name)) && strcmp(name, local) == 0;
+        }
+        sink += wanted;
+    }
+}
+
+static void sync_new(void)
+{
+    parse_counted(sync_body);
+    char local[32], name[128];
+    int files = json_object_get(sync_body, toks, 0, "files");
+    for (int f = 0; f < SYNC_FILES; f += 10) {
+        snprintf(local, sizeof(local), "www/file%03d.bin", f);
+        bool wanted = false;
+        for (int i = 0, obj = files + 1; !wanted && i < toks[files].size; i++, obj = toks[obj].next) {
+            wanted = json_get_string(sync_body, toks, obj, "name", name, sizeof(name)) && strcmp(name, local) == 0;
+        }
+        sink += wanted;
+    }
+}
+
+static char *build_batch(int ops)
+{
+    size_t cap = 64 + ops * 128;
+    char *body = malloc(cap);
+    size_t n = snprintf(body, cap, "{\"partition\":\"nvs\",\"ops\":[");
+    for (int i = 0; i < ops; i++) {
+        n += snprintf(body + n, cap - n, "%s{\"op\":\"set\",\"namespace\":\"app\",\"key\":\"k%03d\",\"type\":4,\"value\":\"%d\"}",
+                      i ? "," : "", i, i * 7);
+    }
+    snprintf(body + n, cap - n, "]}");
+    return body;
+}
+
+static char *build_sync(int files)
+{
+    size_t cap = 64 + files * 160;
+    char *body = malloc(cap);
+    size_t n = snprintf(body, cap, "{\"partition\":\"storage\",\"files\":[");
+    for (int i = 0; i < files; i++) {
+        n += snprintf(body + n, cap - n, "%s{\"name\":\"www/file%03d.bin\",\"size\":%d,\"sha256\":\"%064x\"}",
+                      i ? "," : "", i, i * 100, i);
+    }
+    snprintf(body + n, cap - n, "]}");
+    return body;
+}
+
+static void run(const char *name, void (*legacy)(void), void (*parsed)(void), int iterations)
+{
+    double t0 = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        legacy();
+    }
+    double t1 = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        parsed();
+    }
+    double t2 = now_ns();
+    double before = (t1 - t0) / iterations, after = (t2 - t1) / iterations;
+    printf("%-28s %12.0f %12.0f %8.2fx\n", name, before, after, before / after);
+}
+
+int main(int argc, char **argv)
+{
+    int scale = argc > 1 ? atoi(argv[1]) : 1;
+    scale = scale > 0 ? scale : 1;
+
+    set_body = strdup("{\"partition\":\"nvs\",\"namespace\":\"wifi_config\",\"key\":\"password\","
+                      "\"value\":\"correct horse \\\"battery\\\" staple\",\"type\":8}");
+    batch_body = build_batch(200);
+    sync_body = build_sync(SYNC_FILES);
+    max_toks = json_parse(sync_body, strlen(sync_body), NULL, 0) + json_parse(batch_body, strlen(batch_body), NULL, 0);
+    toks = malloc(max_toks * sizeof(json_tok_t));
+
+    printf("%-28s %12s %12s %9s\n", "request", "before ns", "after ns", "speedup");
+    run("query (6 lookups)", query_legacy, query_new, 200000 * scale);
+    run("/nvs/set body", set_legacy, set_new, 200000 * scale);
+    run("/nvs/batch 200 ops", batch_legacy, batch_new, 500 * scale);
+    run("/spiffs/sync 300 files", sync_legacy, sync_new, 200 * scale);
+
+    free(toks);
+    free(set_body);
+    free(batch_body);
+    free(sync_body);
+    return 0;
+}
@@ -0,0 +1,576 @@
+/*
+ * partition_dump - print and diff NVS and SPIFFS partition dumps on the host
+ *
+ * NVS images are decoded with the same nvs_image code the firmware uses, and
+ * printed in the CSV format of /nvs/export (nvs_partition_gen.py input), so a
+ * dump and a live export of the same device compare equal.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "nvs_image.h"
+#include "spiffs_image.h"
+
+// Exit codes follow diff(1): 0 same, 1 different, 2 trouble
+#define EXIT_SAME       0
+#define EXIT_DIFFERENT  1
+#define EXIT_TROUBLE    2
+
+static uint8_t *load_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size > 0 ? size : 1);
+    if (!data || fread(data, 1, size, f) != (size_t)size) {
+        fprintf(stderr, "%s: read failed\n", path);
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    *len = size;
+    return data;
+}
+
+/* ---- NVS ---- */
+
+typedef struct {
+    uint8_t ns_index;
+    char key[NVS_IMAGE_KEY_SIZE];
+    uint8_t type;           // NVS_IMAGE_TYPE_*; multi-page blobs are recorded as BLOB_DATA
+    int64_t number;
+    uint8_t *value;         // String (without terminator) or blob contents
+    size_t len;
+    uint8_t chunk_start;    // First chunk of a multi-page blob
+    bool live;              // Cleared when a later entry replaces this one
+} nvs_record_t;
+
+typedef struct {
+    uint8_t ns_index;
+    char key[NVS_IMAGE_KEY_SIZE];
+    uint8_t chunk_index;
+    uint8_t *data;
+    size_t len;
+} nvs_chunk_t;
+
+typedef struct {
+    char names[256][NVS_IMAGE_KEY_SIZE];
+    nvs_record_t *records;
+    size_t record_count;
+    nvs_chunk_t *chunks;
+    size_t chunk_count;
+    int bad_entries;
+} nvs_dump_t;
+
+static void *grow(void *array, size_t count, size_t size)
+{
+    // Arrays grow in powers of two; count is the number of elements already stored
+    if (count == 0 || (count & (count - 1)) == 0) {
+        void *grown = realloc(array, (count ? count * 2 : 8) * size);
+        if (!grown) {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_TROUBLE);
+        }
+        return grown;
+    }
+    return array;
+}
+
+static uint8_t *copy_bytes(const uint8_t *data, size_t len)
+{
+    uint8_t *copy = malloc(len ? len : 1);
+    if (!copy) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_TROUBLE);
+    }
+    memcpy(copy, data, len);
+    return copy;
+}
+
+static void nvs_add_record(nvs_dump_t *dump, const nvs_record_t *record)
+{
+    for (size_t i = 0; i < dump->record_count; i++) {
+        nvs_record_t *old = &dump->records[i];
+        if (old->live && old->ns_index == record->ns_index && strcmp(old->key, record->key) == 0) {
+            old->live = false;
+        }
+    }
+    dump->records = grow(dump->records, dump->record_count, sizeof(nvs_record_t));
+    dump->records[dump->record_count++] = *record;
+}
+
+static int nvs_visit_item(void *ctx, const nvs_image_item_t *item)
+{
+    nvs_dump_t *dump = ctx;
+    if (!item->crc_ok) {
+        dump->bad_entries++;
+        return 0;
+    }
+    if (item->ns_index == 0) {
+        memcpy(dump->names[item->data[0]], item->key, NVS_IMAGE_KEY_SIZE);
+        return 0;
+    }
+    nvs_record_t record = { .ns_index = item->ns_index, .type = item->type, .live = true };
+    memcpy(record.key, item->key, NVS_IMAGE_KEY_SIZE);
+    switch (item->type) {
+        case NVS_IMAGE_TYPE_STR:
+            record.len = item->payload_len ? item->payload_len - 1 : 0;
+            record.value = copy_bytes(item->payload, record.len);
+            break;
+        case NVS_IMAGE_TYPE_BLOB:
+            record.len = item->payload_len;
+            record.value = copy_bytes(item->payload, record.len);
+            break;
+        case NVS_IMAGE_TYPE_BLOB_DATA: {
+            dump->chunks = grow(dump->chunks, dump->chunk_count, sizeof(nvs_chunk_t));
+            nvs_chunk_t *chunk = &dump->chunks[dump->chunk_count++];
+            chunk->ns_index = item->ns_index;
+            memcpy(chunk->key, item->key, NVS_IMAGE_KEY_SIZE);
+            chunk->chunk_index = item->chunk_index;
+            chunk->data = copy_bytes(item->payload, item->payload_len);
+            chunk->len = item->payload_len;
+            // Like the NVS iterator, a blob is listed where its first chunk is
+            if (item->chunk_index != 0 && item->chunk_index != 128) {
+                return 0;
+            }
+            record.chunk_start = item->chunk_index;
+            break;
+        }
+        case NVS_IMAGE_TYPE_BLOB_IDX:
+            return 0;
+        default:
+            record.number = nvs_image_item_int(item);
+            break;
+    }
+    nvs_add_record(dump, &record);
+    return 0;
+}
+
+// Join the chunks of every multi-page blob as described by its BLOB_IDX entry
+static int nvs_visit_blob_index(void *ctx, const nvs_image_item_t *item)
+{
+    nvs_dump_t *dump = ctx;
+    if (!item->crc_ok || item->type != NVS_IMAGE_TYPE_BLOB_IDX) {
+        return 0;
+    }
+    uint32_t size = item->data[0] | item->data[1] << 8 | item->data[2] << 16 | (uint32_t)item->data[3] << 24;
+    uint8_t chunk_count = item->data[4];
+    uint8_t chunk_start = item->data[5];
+    for (size_t i = 0; i < dump->record_count; i++) {
+        nvs_record_t *record = &dump->records[i];
+        if (!record->live || record->type != NVS_IMAGE_TYPE_BLOB_DATA || record->ns_index != item->ns_index ||
+            record->chunk_start != chunk_start || strcmp(record->key, item->key) != 0) {
+            continue;
+        }
+        free(record->value);
+        record->value = malloc(size ? size : 1);
+        record->len = 0;
+        for (int c = 0; c < chunk_count; c++) {
+            for (size_t j = 0; j < dump->chunk_count; j++) {
+                nvs_chunk_t *chunk = &dump->chunks[j];
+                if (chunk->ns_index == item->ns_index && chunk->chunk_index == chunk_start + c &&
+                    strcmp(chunk->key, item->key) == 0 && record->len + chunk->len <= size) {
+                    memcpy(record->value + record->len, chunk->data, chunk->len);
+                    record->len += chunk->len;
+                    break;
+                }
+            }
+        }
+        if (record->len != size) {
+            fprintf(stderr, "warning: blob %s/%s is missing chunks\n", dump->names[item->ns_index], item->key);
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    uint32_t seq;
+    size_t index;
+} nvs_page_ref_t;
+
+static int compare_seq(const void *a, const void *b)
+{
+    uint32_t x = ((const nvs_page_ref_t *)a)->seq, y = ((const nvs_page_ref_t *)b)->seq;
+    return x < y ? -1 : x > y;
+}
+
+static int nvs_load(const char *path, nvs_dump_t *dump)
+{
+    memset(dump, 0, sizeof(*dump));
+    size_t len;
+    uint8_t *image = load_file(path, &len);
+    if (!image) {
+        return -1;
+    }
+    if (len == 0 || len % NVS_IMAGE_PAGE_SIZE != 0) {
+        fprintf(stderr, "%s: not a whole number of 4KB NVS pages\n", path);
+        free(image);
+        return -1;
+    }
+
+    // Pages are read in sequence order so newer copies of a key replace older ones
+    size_t page_count = len / NVS_IMAGE_PAGE_SIZE;
+    nvs_page_ref_t *pages = calloc(page_count, sizeof(nvs_page_ref_t));
+    size_t used = 0;
+    for (size_t i = 0; i < page_count; i++) {
+        uint32_t state, seq;
+        const uint8_t *page = image + i * NVS_IMAGE_PAGE_SIZE;
+        if (!nvs_image_page_header(page, &state, &seq)) {
+            fprintf(stderr, "%s: page %zu has an invalid header, skipped\n", path, i);
+        } else if (state != NVS_IMAGE_PAGE_EMPTY) {
+            pages[used++] = (nvs_page_ref_t) { .seq = seq, .index = i };
+        }
+    }
+    qsort(pages, used, sizeof(nvs_page_ref_t), compare_seq);
+    for (size_t i = 0; i < used; i++) {
+        nvs_image_read_page(image + pages[i].index * NVS_IMAGE_PAGE_SIZE, nvs_visit_item, dump);
+    }
+    for (size_t i = 0; i < used; i++) {
+        nvs_image_read_page(image + pages[i].index * NVS_IMAGE_PAGE_SIZE, nvs_visit_blob_index, dump);
+    }
+    if (dump->bad_entries) {
+        fprintf(stderr, "%s: %d entries with bad CRC skipped\n", path, dump->bad_entries);
+    }
+    free(pages);
+    free(image);
+    return 0;
+}
+
+static void nvs_free(nvs_dump_t *dump)
+{
+    for (size_t i = 0; i < dump->record_count; i++) {
+        free(dump->records[i].value);
+    }
+    for (size_t i = 0; i < dump->chunk_count; i++) {
+        free(dump->chunks[i].data);
+    }
+    free(dump->records);
+    free(dump->chunks);
+}
+
+static const char *nvs_encoding(uint8_t type)
+{
+    switch (type) {
+        case NVS_IMAGE_TYPE_U8: return "u8";
+        case NVS_IMAGE_TYPE_I8: return "i8";
+        case NVS_IMAGE_TYPE_U16: return "u16";
+        case NVS_IMAGE_TYPE_I16: return "i16";
+        case NVS_IMAGE_TYPE_U32: return "u32";
+        case NVS_IMAGE_TYPE_I32: return "i32";
+        case NVS_IMAGE_TYPE_U64: return "u64";
+        case NVS_IMAGE_TYPE_I64: return "i64";
+        case NVS_IMAGE_TYPE_STR: return "string";
+        default: return "base64";
+    }
+}
+
+static void print_base64(FILE *out, const uint8_t *data, size_t len)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t group = (uint32_t)data[i] << 16;
+        if (i + 1 < len) {
+            group |= (uint32_t)data[i + 1] << 8;
+        }
+        if (i + 2 < len) {
+            group |= data[i + 2];
+        }
+        fputc(alphabet[(group >> 18) & 0x3F], out);
+        fputc(alphabet[(group >> 12) & 0x3F], out);
+        fputc(i + 1 < len ? alphabet[(group >> 6) & 0x3F] : '=', out);
+        fputc(i + 2 < len ? alphabet[group & 0x3F] : '=', out);
+    }
+}
+
+// key,data,encoding,value - quoting and number formatting match /nvs/export
+static void nvs_print_record(FILE *out, const nvs_record_t *record)
+{
+    fprintf(out, "%s,data,%s,", record->key, nvs_encoding(record->type));
+    if (record->type == NVS_IMAGE_TYPE_STR) {
+        bool quote = memchr(record->value, ',', record->len) || memchr(record->value, '"', record->len) ||
+                     memchr(record->value, '\r', record->len) || memchr(record->value, '\n', record->len);
+        if (quote) {
+            fputc('"', out);
+        }
+        for (size_t i = 0; i < record->len; i++) {
+            fputc(record->value[i], out);
+            if (quote && record->value[i] == '"') {
+                fputc('"', out);
+            }
+        }
+        if (quote) {
+            fputc('"', out);
+        }
+    } else if (record->type == NVS_IMAGE_TYPE_BLOB || record->type == NVS_IMAGE_TYPE_BLOB_DATA) {
+        print_base64(out, record->value, record->len);
+    } else if (record->type & 0x10) {
+        fprintf(out, "%" PRId64, record->number);
+    } else {
+        fprintf(out, "%" PRIu64, (uint64_t)record->number);
+    }
+    fputc('\n', out);
+}
+
+static int cmd_nvs(int argc, char **argv)
+{
+    int status = EXIT_SAME;
+    for (int i = 0; i < argc; i++) {
+        nvs_dump_t dump;
+        if (nvs_load(argv[i], &dump) != 0) {
+            status = EXIT_TROUBLE;
+            continue;
+        }
+        if (argc > 1) {
+            printf("# %s\n", argv[i]);
+        }
+        printf("key,type,encoding,value\n");
+
+        // Grouped by namespace, namespaces in the order their first key appears
+        bool printed[256] = { false };
+        for (size_t r = 0; r < dump.record_count; r++) {
+            uint8_t ns = dump.records[r].ns_index;
+            if (!dump.records[r].live || printed[ns]) {
+                continue;
+            }
+            printed[ns] = true;
+            printf("%s,namespace,,\n", dump.names[ns]);
+            for (size_t k = r; k < dump.record_count; k++) {
+                if (dump.records[k].live && dump.records[k].ns_index == ns) {
+                    nvs_print_record(stdout, &dump.records[k]);
+                }
+            }
+        }
+        nvs_free(&dump);
+    }
+    return status;
+}
+
+static const nvs_record_t *nvs_find(const nvs_dump_t *dump, const char *ns, const char *key)
+{
+    for (size_t i = 0; i < dump->record_count; i++) {
+        const nvs_record_t *record = &dump->records[i];
+        if (record->live && strcmp(record->key, key) == 0 && strcmp(dump->names[record->ns_index], ns) == 0) {
+            return record;
+        }
+    }
+    return NULL;
+}
+
+static bool nvs_same(const nvs_record_t *a, const nvs_record_t *b)
+{
+    bool a_blob = a->type == NVS_IMAGE_TYPE_BLOB || a->type == NVS_IMAGE_TYPE_BLOB_DATA;
+    bool b_blob = b->type == NVS_IMAGE_TYPE_BLOB || b->type == NVS_IMAGE_TYPE_BLOB_DATA;
+    if (a_blob != b_blob || (!a_blob && a->type != b->type) || a->number != b->number || a->len != b->len) {
+        return false;
+    }
+    return a->len == 0 || memcmp(a->value, b->value, a->len) == 0;
+}
+
+// Lines of "<mark> namespace,key,data,encoding,value": '-' only in old, '+' only in new
+static int cmd_nvs_diff(const char *old_path, const char *new_path)
+{
+    nvs_dump_t dumps[2];
+    if (nvs_load(old_path, &dumps[0]) != 0) {
+        return EXIT_TROUBLE;
+    }
+    if (nvs_load(new_path, &dumps[1]) != 0) {
+        nvs_free(&dumps[0]);
+        return EXIT_TROUBLE;
+    }
+    int differences = 0;
+    for (int side = 0; side < 2; side++) {
+        const nvs_dump_t *this = &dumps[side], *other = &dumps[!side];
+        for (size_t i = 0; i < this->record_count; i++) {
+            const nvs_record_t *record = &this->records[i];
+            if (!record->live) {
+                continue;
+            }
+            const char *ns = this->names[record->ns_index];
+            const nvs_record_t *match = nvs_find(other, ns, record->key);
+            if (match && (side == 1 || nvs_same(record, match))) {
+                continue;
+            }
+            differences++;
+            if (match) {
+                printf("- %s,", ns);
+                nvs_print_record(stdout, record);
+                printf("+ %s,", ns);
+                nvs_print_record(stdout, match);
+            } else {
+                printf("%c %s,", side == 0 ? '-' : '+', ns);
+                nvs_print_record(stdout, record);
+            }
+        }
+    }
+    nvs_free(&dumps[0]);
+    nvs_free(&dumps[1]);
+    return differences ? EXIT_DIFFERENT : EXIT_SAME;
+}
+
+/* ---- SPIFFS ---- */
+
+static int spiffs_load(const char *path, const spiffs_image_geometry_t *geometry,
+                       spiffs_image_file_t **files, size_t *count)
+{
+    size_t len;
+    uint8_t *image = load_file(path, &len);
+    if (!image) {
+        return -1;
+    }
+    int err = spiffs_image_read(image, len, geometry, files, count);
+    free(image);
+    if (err != 0) {
+        fprintf(stderr, "%s: cannot decode with this geometry\n", path);
+        return -1;
+    }
+    for (size_t i = 0; i < *count; i++) {
+        if (!(*files)[i].complete) {
+            fprintf(stderr, "%s: %s is missing data pages\n", path, (*files)[i].name);
+        }
+    }
+    return 0;
+}
+
+static uint32_t file_crc(const spiffs_image_file_t *file)
+{
+    return nvs_image_crc32(0, file->data, file->size);
+}
+
+static int cmd_spiffs(int argc, char **argv, const spiffs_image_geometry_t *geometry)
+{
+    int status = EXIT_SAME;
+    for (int i = 0; i < argc; i++) {
+        spiffs_image_file_t *files;
+        size_t count;
+        if (spiffs_load(argv[i], geometry, &files, &count) != 0) {
+            status = EXIT_TROUBLE;
+            continue;
+        }
+        if (argc > 1) {
+            printf("# %s\n", argv[i]);
+        }
+        for (size_t f = 0; f < count; f++) {
+            printf("%10" PRIu32 "  %08" PRIx32 "  %s\n", files[f].size, file_crc(&files[f]), files[f].name);
+        }
+        spiffs_image_free(files, count);
+    }
+    return status;
+}
+
+// Lines of "<mark> size crc name": '-' only in old, '+' only in new, '~' changed
+static int cmd_spiffs_diff(const char *old_path, const char *new_path, const spiffs_image_geometry_t *geometry)
+{
+    spiffs_image_file_t *a, *b;
+    size_t a_count, b_count;
+    if (spiffs_load(old_path, geometry, &a, &a_count) != 0) {
+        return EXIT_TROUBLE;
+    }
+    if (spiffs_load(new_path, geometry, &b, &b_count) != 0) {
+        spiffs_image_free(a, a_count);
+        return EXIT_TROUBLE;
+    }
+    // Both lists are sorted by name, so one merge pass finds every difference
+    int differences = 0;
+    size_t i = 0, j = 0;
+    while (i < a_count || j < b_count) {
+        int cmp = i == a_count ? 1 : j == b_count ? -1 : strcmp(a[i].name, b[j].name);
+        if (cmp < 0) {
+            printf("- %10" PRIu32 "  %08" PRIx32 "  %s\n", a[i].size, file_crc(&a[i]), a[i].name);
+            i++;
+            differences++;
+        } else if (cmp > 0) {
+            printf("+ %10" PRIu32 "  %08" PRIx32 "  %s\n", b[j].size, file_crc(&b[j]), b[j].name);
+            j++;
+            differences++;
+        } else {
+            if (a[i].size != b[j].size || memcmp(a[i].data, b[j].data, a[i].size) != 0) {
+                printf("~ %10" PRIu32 "  %08" PRIx32 "  %s\n", b[j].size, file_crc(&b[j]), b[j].name);
+                differences++;
+            }
+            i++;
+            j++;
+        }
+    }
+    spiffs_image_free(a, a_count);
+    spiffs_image_free(b, b_count);
+    return differences ? EXIT_DIFFERENT : EXIT_SAME;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s nvs <image>...                    Print NVS images as nvs_partition_gen CSV\n"
+            "       %s nvs-diff <old> <new>              Show NVS keys removed (-) and added or changed (+)\n"
+            "       %s spiffs [options] <image>...       List SPIFFS files: size, CRC-32, name\n"
+            "       %s spiffs-diff [options] <old> <new> Show SPIFFS files removed (-), added (+), changed (~)\n"
+            "\n"
+            "Images are partition dumps as saved by /download.\n"
+            "\n"
+            "SPIFFS options (must match the firmware's sdkconfig):\n"
+            "  --page-size <n>      CONFIG_SPIFFS_PAGE_SIZE (default 256)\n"
+            "  --block-size <n>     Flash sector size (default 4096)\n"
+            "  --obj-name-len <n>   CONFIG_SPIFFS_OBJ_NAME_LEN (default 32)\n"
+            "  --meta-len <n>       CONFIG_SPIFFS_META_LENGTH (default 4)\n"
+            "\n"
+            "Diff commands exit with 0 when the images match, 1 when they differ and 2 on errors.\n",
+            prog, prog, prog, prog);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        usage(argv[0]);
+        return EXIT_TROUBLE;
+    }
+    const char *command = argv[1];
+    spiffs_image_geometry_t geometry = SPIFFS_IMAGE_GEOMETRY_DEFAULT;
+
+    // Collect geometry options, leaving the image paths in args
+    char **args = argv + 2;
+    int nargs = 0;
+    for (int i = 2; i < argc; i++) {
+        size_t *option = NULL;
+        if (strcmp(argv[i], "--page-size") == 0) {
+            option = &geometry.page_size;
+        } else if (strcmp(argv[i], "--block-size") == 0) {
+            option = &geometry.block_size;
+        } else if (strcmp(argv[i], "--obj-name-len") == 0) {
+            option = &geometry.obj_name_len;
+        } else if (strcmp(argv[i], "--meta-len") == 0) {
+            option = &geometry.meta_len;
+        }
+        if (option) {
+            if (++i == argc) {
+                usage(argv[0]);
+                return EXIT_TROUBLE;
+            }
+            *option = strtoul(argv[i], NULL, 0);
+        } else {
+            args[nargs++] = argv[i];
+        }
+    }
+
+    if (strcmp(command, "nvs") == 0 && nargs >= 1) {
+        return cmd_nvs(nargs, args);
+    }
+    if (strcmp(command, "nvs-diff") == 0 && nargs == 2) {
+        return cmd_nvs_diff(args[0], args[1]);
+    }
+    if (strcmp(command, "spiffs") == 0 && nargs >= 1) {
+        return cmd_spiffs(nargs, args, &geometry);
+    }
+    if (strcmp(command, "spiffs-diff") == 0 && nargs == 2) {
+        return cmd_spiffs_diff(args[0], args[1], &geometry);
+    }
+    usage(argv[0]);
+    return EXIT_TROUBLE;
+}
@@ -0,0 +1,146 @@
+/*
+ * Read-only SPIFFS image decoder
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "spiffs_image.h"
+
+// Page header: obj_id (u16), span_ix (u16), flags (u8); flags are active low
+#define PAGE_HEADER_SIZE    5
+#define PAGE_HEADER_ALIGNED 8
+#define FLAG_USED           (1 << 0)
+#define FLAG_FINAL          (1 << 1)
+#define FLAG_INDEX          (1 << 2)
+#define FLAG_IXDELE         (1 << 6)
+#define FLAG_DELET          (1 << 7)
+#define OBJ_ID_IX_FLAG      0x8000
+
+// Object index header: aligned page header, size (u32), type (u8), name, metadata
+#define IX_SIZE_OFFSET      PAGE_HEADER_ALIGNED
+#define IX_NAME_OFFSET      (PAGE_HEADER_ALIGNED + 5)
+#define SIZE_UNDEFINED      0xFFFFFFFF
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(((const spiffs_image_file_t *)a)->name, ((const spiffs_image_file_t *)b)->name);
+}
+
+// Pages that are written, finalized and not deleted
+static bool page_live(uint8_t flags)
+{
+    return (flags & (FLAG_USED | FLAG_FINAL | FLAG_DELET)) == FLAG_DELET;
+}
+
+int spiffs_image_read(const uint8_t *image, size_t len, const spiffs_image_geometry_t *geometry,
+                      spiffs_image_file_t **files, size_t *count)
+{
+    size_t page_size = geometry->page_size;
+    size_t block_size = geometry->block_size;
+    *files = NULL;
+    *count = 0;
+    if (page_size < 64 || block_size % page_size != 0 || geometry->obj_name_len > SPIFFS_IMAGE_NAME_MAX ||
+        IX_NAME_OFFSET + geometry->obj_name_len + geometry->meta_len >= page_size) {
+        return -1;
+    }
+    size_t pages_per_block = block_size / page_size;
+    size_t lookup_pages = pages_per_block * sizeof(uint16_t) / page_size;
+    lookup_pages = lookup_pages ? lookup_pages : 1;
+    size_t data_len = page_size - PAGE_HEADER_SIZE;
+    size_t page_count = len / page_size;
+
+    // Pass 1: object index headers name the files
+    size_t capacity = 16;
+    spiffs_image_file_t *out = calloc(capacity, sizeof(spiffs_image_file_t));
+    if (!out) {
+        return -1;
+    }
+    for (size_t pix = 0; pix < page_count; pix++) {
+        if (pix % pages_per_block < lookup_pages) {
+            continue;
+        }
+        const uint8_t *page = image + pix * page_size;
+        uint16_t obj_id = get_u16(page);
+        uint8_t flags = page[4];
+        if (!page_live(flags) || (flags & FLAG_INDEX) || !(flags & FLAG_IXDELE) ||
+            !(obj_id & OBJ_ID_IX_FLAG) || get_u16(page + 2) != 0) {
+            continue;
+        }
+        if (*count == capacity) {
+            spiffs_image_file_t *grown = realloc(out, capacity * 2 * sizeof(spiffs_image_file_t));
+            if (!grown) {
+                spiffs_image_free(out, *count);
+                return -1;
+            }
+            out = grown;
+            capacity *= 2;
+        }
+        spiffs_image_file_t *file = &out[(*count)++];
+        memset(file, 0, sizeof(*file));
+        file->obj_id = obj_id & ~OBJ_ID_IX_FLAG;
+        file->size = get_u32(page + IX_SIZE_OFFSET);
+        file->size = file->size == SIZE_UNDEFINED ? 0 : file->size;
+        memcpy(file->name, page + IX_NAME_OFFSET, geometry->obj_name_len);
+        file->name[geometry->obj_name_len] = '\0';
+        file->data = malloc(file->size ? file->size : 1);
+        if (!file->data) {
+            spiffs_image_free(out, *count);
+            return -1;
+        }
+        memset(file->data, 0xFF, file->size);
+    }
+
+    // Pass 2: data pages carry their object id and position (span index) in the file
+    size_t *found = calloc(*count ? *count : 1, sizeof(size_t));
+    if (!found) {
+        spiffs_image_free(out, *count);
+        return -1;
+    }
+    for (size_t pix = 0; pix < page_count; pix++) {
+        if (pix % pages_per_block < lookup_pages) {
+            continue;
+        }
+        const uint8_t *page = image + pix * page_size;
+        uint16_t obj_id = get_u16(page);
+        uint8_t flags = page[4];
+        if (!page_live(flags) || !(flags & FLAG_INDEX) || (obj_id & OBJ_ID_IX_FLAG)) {
+            continue;
+        }
+        size_t offset = (size_t)get_u16(page + 2) * data_len;
+        for (size_t i = 0; i < *count; i++) {
+            if (out[i].obj_id == obj_id && offset < out[i].size) {
+                size_t n = out[i].size - offset < data_len ? out[i].size - offset : data_len;
+                memcpy(out[i].data + offset, page + PAGE_HEADER_SIZE, n);
+                found[i]++;
+                break;
+            }
+        }
+    }
+    for (size_t i = 0; i < *count; i++) {
+        out[i].complete = found[i] == (out[i].size + data_len - 1) / data_len;
+    }
+    free(found);
+
+    qsort(out, *count, sizeof(spiffs_image_file_t), compare_names);
+    *files = out;
+    return 0;
+}
+
+void spiffs_image_free(spiffs_image_file_t *files, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        free(files[i].data);
+    }
+    free(files);
+}
@@ -0,0 +1,54 @@
+/*
+ * Read-only SPIFFS image decoder for partition dumps taken with /download.
+ *
+ * Files are rebuilt from the object index header pages (name, size) and the
+ * data pages of each object; the lookup tables are not needed for that.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SPIFFS_IMAGE_NAME_MAX   64
+
+/**
+ * @brief Filesystem geometry; must match the CONFIG_SPIFFS_* settings of the firmware
+ */
+typedef struct {
+    size_t page_size;       /**<! CONFIG_SPIFFS_PAGE_SIZE */
+    size_t block_size;      /**<! Flash sector size */
+    size_t obj_name_len;    /**<! CONFIG_SPIFFS_OBJ_NAME_LEN */
+    size_t meta_len;        /**<! CONFIG_SPIFFS_META_LENGTH */
+} spiffs_image_geometry_t;
+
+/* ESP-IDF's default SPIFFS configuration */
+#define SPIFFS_IMAGE_GEOMETRY_DEFAULT { .page_size = 256, .block_size = 4096, .obj_name_len = 32, .meta_len = 4 }
+
+typedef struct {
+    char name[SPIFFS_IMAGE_NAME_MAX + 1];
+    uint16_t obj_id;
+    uint32_t size;
+    uint8_t *data;          /**<! size bytes; missing pages read as 0xFF */
+    bool complete;          /**<! Every data page was found */
+} spiffs_image_file_t;
+
+/**
+ * @brief Decode every file of an image
+ *
+ * @param files Receives a heap array of files, sorted by name; free with spiffs_image_free()
+ * @return 0 on success, -1 for an invalid geometry or out of memory
+ */
+int spiffs_image_read(const uint8_t *image, size_t len, const spiffs_image_geometry_t *geometry,
+                      spiffs_image_file_t **files, size_t *count);
+
+void spiffs_image_free(spiffs_image_file_t *files, size_t count);
+
+#ifdef __cplusplus
+}
+#endif